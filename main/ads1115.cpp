@@ -0,0 +1,94 @@
+#include "ads1115.hpp"
+
+#include <algorithm>
+
+#include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <freertos/FreeRTOS.h>
+
+static const char* TAG = "Ads1115";
+
+Ads1115Bank::Ads1115Bank(i2c_port_t port, int devices) : port_(port), devices_(devices) {
+    configASSERT(devices > 0 && devices <= MAX_DEVICES);
+}
+
+esp_err_t Ads1115Bank::init() {
+    int found = 0;
+
+    for (int device = 0; device < devices_; device++) {
+        auto& dev = devs_[device];
+        dev.port = port_;
+        dev.addr = BASE_ADDR + device;
+        dev.clk_speed = I2C_FREQ_HZ;
+
+        uint8_t config[2];
+        present_[device] = i2c_dev_read_reg(&dev, REG_CONFIG, config, sizeof(config)) == ESP_OK;
+
+        if (present_[device]) {
+            found++;
+        } else {
+            ESP_LOGE(TAG, "No ADS1115 at 0x%02x", dev.addr);
+        }
+    }
+
+    ESP_LOGI(TAG, "%d of %d ADS1115 found", found, devices_);
+
+    return found == devices_ ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void Ads1115Bank::read(int probe, uint16_t* samples, int count) {
+    int device = probe / CHANNELS;
+    int input = probe % CHANNELS;
+
+    for (int i = 0; i < count; i++) {
+        if (start(device, input) != ESP_OK) {
+            samples[i] = 0;
+            continue;
+        }
+
+        esp_rom_delay_us(CONVERSION_US);
+        samples[i] = result(device);
+    }
+}
+
+void Ads1115Bank::sweep(uint16_t* samples, int count) {
+    for (int input = 0; input < CHANNELS; input++) {
+        for (int i = 0; i < count; i++) {
+            std::array<bool, MAX_DEVICES> started = {};
+
+            // Devices convert in parallel, the wait is shared
+            for (int device = 0; device < devices_; device++) {
+                started[device] = start(device, input) == ESP_OK;
+            }
+
+            esp_rom_delay_us(CONVERSION_US);
+
+            for (int device = 0; device < devices_; device++) {
+                int probe = device * CHANNELS + input;
+                samples[probe * count + i] = started[device] ? result(device) : 0;
+            }
+        }
+    }
+}
+
+esp_err_t Ads1115Bank::start(int device, int input) {
+    if (!present_[device]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint16_t config = CONFIG_START | ((MUX_SINGLE_ENDED | input) << MUX_SHIFT);
+    uint8_t data[2] = {(uint8_t)(config >> 8), (uint8_t)config};
+
+    return i2c_dev_write_reg(&devs_[device], REG_CONFIG, data, sizeof(data));
+}
+
+uint16_t Ads1115Bank::result(int device) {
+    uint8_t data[2];
+    if (i2c_dev_read_reg(&devs_[device], REG_CONVERSION, data, sizeof(data)) != ESP_OK) {
+        return 0;
+    }
+
+    // 125 uV per count in +-4.096 V range, 8 counts are 1 mV. Below ground is noise.
+    int value = (int16_t)((data[0] << 8) | data[1]);
+    return std::min(std::max(value, 0) >> 3, 4095);
+}
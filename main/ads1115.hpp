@@ -0,0 +1,56 @@
+#pragma once
+
+#include "probe_backend.hpp"
+
+#include <array>
+
+#include <i2cdev.h>
+
+/// ADS1115 ADCs on an I2C bus brought up elsewhere, 4 single-ended probes each. Devices are at
+/// consecutive addresses from 0x48 (ADDR pin to GND, VDD, SDA, SCL). Conversions are started on
+/// all devices at once, a sweep costs one conversion time per input and sample however many
+/// devices there are.
+class Ads1115Bank : public ProbeBackend {
+ public:
+    static const int CHANNELS = 4;
+    static const int MAX_DEVICES = 4;
+
+    Ads1115Bank(i2c_port_t port, int devices);
+
+    esp_err_t init() override;
+
+    int probes() const override {
+        return devices_ * CHANNELS;
+    }
+
+    void read(int probe, uint16_t* samples, int count) override;
+    void sweep(uint16_t* samples, int count) override;
+
+    /// Raw reading is in mV already
+    uint32_t millivolts(uint16_t raw) const override {
+        return raw;
+    }
+
+ private:
+    static const uint8_t BASE_ADDR = 0x48;
+    static const uint8_t REG_CONVERSION = 0x00;
+    static const uint8_t REG_CONFIG = 0x01;
+
+    // Start single-shot conversion, +-4.096 V range, 860 samples/s, comparator off. Input
+    // multiplexer is OR-ed in, AINx against GND.
+    static const uint16_t CONFIG_START = 0x8000 | (0b001 << 9) | (1 << 8) | (0b111 << 5) | 0b11;
+    static const int MUX_SHIFT = 12;
+    static const uint16_t MUX_SINGLE_ENDED = 0b100;
+
+    // 1.16 ms at 860 samples/s, internal oscillator may be 10% slow
+    static const uint32_t CONVERSION_US = 1300;
+
+    esp_err_t start(int device, int input);
+    uint16_t result(int device);
+
+    i2c_port_t port_;
+    int devices_;
+    std::array<i2c_dev_t, MAX_DEVICES> devs_ = {};
+    // Device answered at init, absent ones read 0 so their probes show as disconnected
+    std::array<bool, MAX_DEVICES> present_ = {};
+};
@@ -2,10 +2,13 @@
 
 #include "clock_service.hpp"
 #include "ds3231.h"
+#include "event_bus.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "moisture_service.hpp"
+#include "reactor.hpp"
 #include "socket.hpp"
+#include "static_alloc.hpp"
 #include "watering_service.hpp"
 #include "web_server.hpp"
 #include "wifi_service.hpp"
@@ -14,15 +17,80 @@
 #include <cmath>
 #include <utility>
 
+#include <esp_heap_caps.h>
+
 #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
 #include <esp_log.h>
 static const char* TAG = "Application";
 
-template <typename T>
-void service(void* param) {
-    T* service = (T*)param;
+// How long sender waits for the free slot in the peer's queue
+static const TickType_t SEND_DEADLINE = pdMS_TO_TICKS(100);
+// Messages one service sends another in a row at most, e.g. both alarms expired
+static const size_t SERVICE_QUEUE_DEPTH = 2;
+
+// Coroutine frames live on heap or in the frame pool, stack only needs to fit the deepest handler
+static const uint32_t SERVICES_STACK_SIZE = 1024 * 6;
+
+// All services are driven by one reactor on one task
+struct Services {
+    Reactor& reactor;
+    ServiceBase* services[3];
+};
+
+static void run_services(void* param) {
+    auto* ctx = (Services*)param;
+
+    for (auto* service : ctx->services) {
+        service->start();
+    }
+
+    ctx->reactor.run();
+}
+
+static void start_services(Services* services) {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    static StackType_t stack[SERVICES_STACK_SIZE / sizeof(StackType_t)];
+    static StaticTask_t task;
 
-    service->run_service();
+    xTaskCreateStatic(run_services, "services", SERVICES_STACK_SIZE, services, 2, stack, &task);
+#else
+    xTaskCreate(run_services, "services", SERVICES_STACK_SIZE, services, 2, NULL);
+#endif
+}
+
+/// What was reserved statically and what heap was consumed during boot, from now on heap use
+/// should stay flat
+static void report_memory(size_t heap_free_at_start) {
+    auto heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    auto task_static = SERVICES_STACK_SIZE + sizeof(StaticTask_t);
+#else
+    auto task_static = 0;
+#endif
+
+    ESP_LOGI(TAG,
+             "Static: arena %u/%u bytes, coroutine frames %u bytes, services task %u bytes",
+             static_alloc_used(),
+             static_alloc_capacity(),
+             frame_pool_capacity(),
+             task_static);
+
+    ESP_LOGI(TAG,
+             "Coroutine frames: largest %u bytes, slot %u bytes",
+             frame_largest_request(),
+             frame_slot_size());
+
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    // Frames probed at boot fit the slots, none can fail later
+    configASSERT(frame_largest_request() <= frame_slot_size());
+#endif
+
+    ESP_LOGI(TAG,
+             "Heap: %u bytes used during boot, %u free, %u minimum free",
+             heap_free_at_start - heap_free,
+             heap_free,
+             heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
 }
 
 void StartApplication() {
@@ -58,28 +126,74 @@ void StartApplication() {
                            `'-...-'    '.(_,_).'  ''-'   `'-'   '-----'`        `'-..-'   '--'    '--'
 )foo");
 
-    start_wifi();
-
-    auto watering_clock = SockPtr(new Socket(1));
-    auto watering_moisture = SockPtr(new Socket(1));
+    auto heap_free_at_start = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
 
-    auto web_clock = SockPtr(new Socket(1));
-    auto web_moisture = SockPtr(new Socket(1));
-    auto web_watering = SockPtr(new Socket(1));
-
-    Clock clock(watering_clock->connect(), web_clock->connect());
-    Moisture moisture(watering_moisture->connect(), web_moisture->connect());
-    Watering watering(
-        std::move(watering_clock), std::move(watering_moisture), web_watering->connect());
-
-    WebServer web_server(std::move(web_clock), std::move(web_moisture), std::move(web_watering));
+    start_wifi();
 
-    xTaskCreate(service<Clock>, "clock", 1024 * 4, &clock, 2, NULL);
-    xTaskCreate(service<Moisture>, "moisture", 1024 * 4, &moisture, 2, NULL);
-    xTaskCreate(service<Watering>, "watering", 1024 * 4, &watering, 2, NULL);
+    // Services share the reactor task, a sender waiting for room would wait for itself. Queues
+    // between them hold what a handler sends in a row and sends never wait.
+    auto watering_clock = Socket::make(SERVICE_QUEUE_DEPTH, Socket::Overflow::Block, 0);
+    auto watering_moisture = Socket::make(SERVICE_QUEUE_DEPTH, Socket::Overflow::Block, 0);
+
+    // Web waits for the reply anyway, if previous request still sits in the queue wait a bit
+    auto web_clock = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+    auto web_moisture = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+    auto web_watering = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+    // Stop has its own, it never queues behind another web request
+    auto web_watering_stop = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+
+    // Services never block on replies to the web, if queue is full web gave up on previous
+    // request and the reply is dropped.
+    // Services carry their handler tables, keep them off the main task stack.
+    static Reactor reactor;
+    static EventBus events;
+
+    static Clock clock(reactor,
+                       events,
+                       watering_clock->connect(Socket::Overflow::Block, 0),
+                       web_clock->connect());
+    static Moisture moisture(reactor,
+                             events,
+                             watering_moisture->connect(Socket::Overflow::Block, 0),
+                             web_moisture->connect());
+    static Watering watering(reactor,
+                             events,
+                             std::move(watering_clock),
+                             std::move(watering_moisture),
+                             web_watering->connect(),
+                             web_watering_stop->connect());
+
+    auto versions = StateVersions{.clock = clock.status_version(),
+                                  .moisture = moisture.status_version(),
+                                  .watering = watering.status_version(),
+                                  .configuration = watering.configuration_version()};
+
+    auto counters = ServiceCounters{.clock = clock.counters(),
+                                    .moisture = moisture.counters(),
+                                    .watering = watering.counters()};
+
+    // Subscribes to events before services start publishing them. Carries event queues of
+    // clients, keep it off the main task stack too.
+    static WebServer web_server(reactor,
+                                events,
+                                versions,
+                                counters,
+                                std::move(web_clock),
+                                std::move(web_moisture),
+                                std::move(web_watering),
+                                std::move(web_watering_stop));
+
+    // Before the services task runs, the frame pool is free and the cycle is not started yet
+    watering.probe_frames();
+
+    // Clock goes first, it brings up I2C bus
+    static Services services = {reactor, {&clock, &moisture, &watering}};
+    start_services(&services);
 
     web_server.start_webserver();
 
+    report_memory(heap_free_at_start);
+
     for (int i = 0;; i++) {
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
@@ -0,0 +1,92 @@
+#include "async_pool.hpp"
+
+#include "static_alloc.hpp"
+
+#include <freertos/task.h>
+
+#include <esp_idf_version.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+// httpd_req_async_handler_begin() and _complete() first shipped in ESP-IDF v5.1
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+#error "AsyncPool needs ESP-IDF v5.1 or newer for httpd async handlers"
+#endif
+
+static const char* TAG = "AsyncPool";
+
+void AsyncPool::start() {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    jobs_ = xQueueCreateStatic(WORKERS,
+                               sizeof(Job),
+                               static_alloc<uint8_t>(WORKERS * sizeof(Job)),
+                               static_alloc<StaticQueue_t>());
+    idle_ = xSemaphoreCreateCountingStatic(WORKERS, WORKERS, static_alloc<StaticSemaphore_t>());
+
+    static StackType_t stacks[WORKERS][STACK_SIZE / sizeof(StackType_t)];
+    static StaticTask_t tasks[WORKERS];
+
+    for (int i = 0; i < WORKERS; i++) {
+        xTaskCreateStatic(worker, "web_worker", STACK_SIZE, this, 5, stacks[i], &tasks[i]);
+    }
+#else
+    jobs_ = xQueueCreate(WORKERS, sizeof(Job));
+    idle_ = xSemaphoreCreateCounting(WORKERS, WORKERS);
+
+    for (int i = 0; i < WORKERS; i++) {
+        xTaskCreate(worker, "web_worker", STACK_SIZE, this, 5, nullptr);
+    }
+#endif
+
+    configASSERT(jobs_);
+    configASSERT(idle_);
+
+    ESP_LOGI(TAG, "Started %d workers", WORKERS);
+}
+
+esp_err_t AsyncPool::submit(httpd_req_t* req, Handler handler, Histogram* latency) {
+    auto start_us = esp_timer_get_time();
+
+    if (xSemaphoreTake(idle_, 0) != pdPASS) {
+        rejected_++;
+        ESP_LOGW(TAG, "All workers busy, rejecting %s", req->uri);
+
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_sendstr(req, "Busy, try again later");
+    }
+
+    httpd_req_t* copy = nullptr;
+
+    if (httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+        xSemaphoreGive(idle_);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot go async");
+    }
+
+    // There is a slot for every worker, it cannot be full while a worker is idle
+    auto job = Job{.req = copy, .handler = handler, .latency = latency, .start_us = start_us};
+    xQueueSend(jobs_, &job, portMAX_DELAY);
+
+    return ESP_OK;
+}
+
+void AsyncPool::worker(void* arg) {
+    auto* pool = (AsyncPool*)arg;
+
+    for (;;) {
+        Job job;
+
+        if (xQueueReceive(pool->jobs_, &job, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+
+        job.handler(job.req);
+        httpd_req_async_handler_complete(job.req);
+
+        if (job.latency) {
+            job.latency->record(esp_timer_get_time() - job.start_us);
+        }
+
+        xSemaphoreGive(pool->idle_);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "histogram.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+/// Runs httpd handlers on worker tasks, so a handler waiting for a service does not hold up the
+/// server task, which keeps serving other connections. Number of workers caps how many such
+/// handlers run at once, request that finds all of them busy gets 503. Needs ESP-IDF v5.1 or newer.
+class AsyncPool {
+ public:
+    using Handler = esp_err_t (*)(httpd_req_t* req);
+
+    void start();
+
+    /// Hands the request over to a free worker, or answers it with 503 if there is none. Time
+    /// from now until the handler returns is recorded in latency, if given.
+    esp_err_t submit(httpd_req_t* req, Handler handler, Histogram* latency = nullptr);
+
+    uint32_t rejected() const {
+        return rejected_;
+    }
+
+ private:
+    static const int WORKERS = CONFIG_GARDEN_WEB_WORKERS;
+    static const uint32_t STACK_SIZE = 1024 * 4;
+
+    struct Job {
+        httpd_req_t* req;
+        Handler handler;
+        Histogram* latency;
+        int64_t start_us;
+    };
+
+    static void worker(void* arg);
+
+    QueueHandle_t jobs_ = nullptr;
+    // Counts workers waiting for a job
+    SemaphoreHandle_t idle_ = nullptr;
+
+    std::atomic<uint32_t> rejected_{0};
+};
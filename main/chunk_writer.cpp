@@ -0,0 +1,90 @@
+#include "chunk_writer.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <esp_log.h>
+
+static const char* TAG = "ChunkWriter";
+
+void ChunkWriter::write(const char* data, size_t len) {
+    while (len > 0) {
+        if (used_ == BUFFER_SIZE) {
+            flush();
+        }
+
+        size_t n = std::min(len, BUFFER_SIZE - used_);
+        memcpy(buffer_ + used_, data, n);
+
+        used_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChunkWriter::write(const char* str) {
+    write(str, strlen(str));
+}
+
+void ChunkWriter::put(char c) {
+    if (used_ == BUFFER_SIZE) {
+        flush();
+    }
+
+    buffer_[used_++] = c;
+}
+
+void ChunkWriter::print(const char* fmt, ...) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t space = BUFFER_SIZE - used_;
+
+        // Buffer has one spare byte for the terminator, it is overwritten by the next write
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buffer_ + used_, space + 1, fmt, args);
+        va_end(args);
+
+        if (n < 0) {
+            return;
+        }
+
+        if ((size_t)n <= space) {
+            used_ += n;
+            return;
+        }
+
+        if (used_ == 0) {
+            ESP_LOGW(TAG, "Print of %d bytes truncated", n);
+            used_ = BUFFER_SIZE;
+            return;
+        }
+
+        flush();
+    }
+}
+
+esp_err_t ChunkWriter::finish() {
+    flush();
+
+    if (err_ == ESP_OK) {
+        err_ = httpd_resp_send_chunk(req_, nullptr, 0);
+    }
+
+    return err_;
+}
+
+void ChunkWriter::flush() {
+    if (used_ > 0 && err_ == ESP_OK) {
+        err_ = httpd_resp_send_chunk(req_, buffer_, used_);
+
+        if (err_ != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to send chunk: %s", esp_err_to_name(err_));
+        } else if (sent_) {
+            *sent_ += used_;
+        }
+    }
+
+    used_ = 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/// Buffers the response body and sends it in HTTP chunks whenever the buffer fills up. Memory
+/// needed is the same regardless of the size of the response.
+class ChunkWriter {
+ public:
+    /// Bytes successfully sent are added to sent, if given
+    explicit ChunkWriter(httpd_req_t* req, std::atomic<uint32_t>* sent = nullptr)
+        : req_(req), sent_(sent) {
+    }
+
+    void write(const char* data, size_t len);
+    void write(const char* str);
+    void put(char c);
+
+    /// Formatted output, single print must fit in the buffer, longer output is truncated
+    void print(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    /// Sends what is buffered and terminates the response, returns first error that occurred
+    esp_err_t finish();
+
+    /// Once sending failed all further writes are ignored
+    esp_err_t error() const {
+        return err_;
+    }
+
+ private:
+    static const size_t BUFFER_SIZE = 256;
+
+    void flush();
+
+    httpd_req_t* req_;
+    std::atomic<uint32_t>* sent_;
+    // Spare byte for the terminator written by vsnprintf
+    char buffer_[BUFFER_SIZE + 1];
+    size_t used_ = 0;
+    esp_err_t err_ = ESP_OK;
+};
@@ -1,10 +1,13 @@
 #include "clock_service.hpp"
 
 #include "ds3231.h"
+#include "static_alloc.hpp"
 
+#include <algorithm>
 #include <ctime>
 
 #include <esp_check.h>
+#include <esp_timer.h>
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
 #include <esp_log.h>
 
@@ -23,16 +26,60 @@ static std::string tm_to_str(struct tm date_tm, const char *format = "%H:%M:%S")
     return buf;
 }
 
-Clock::Clock(SockPtr watering, SockPtr web)
-    : watering_(std::move(watering)),
+Clock::Clock(Reactor& reactor, EventBus& events, SockPtr watering, SockPtr web)
+    : ServiceBase(reactor, events),
+      watering_(std::move(watering)),
       web_(std::move(web)),
-      interrupt_arrived_(xSemaphoreCreateBinary()) {
-    xQueueAddToSet(interrupt_arrived_, queues_);
-    xQueueAddToSet(watering_->get_rx(), queues_);
-    xQueueAddToSet(web_->get_rx(), queues_);
+      interrupt_arrived_(create_semaphore()) {
+    reactor_.on_signal(interrupt_arrived_, Lane::Control, "rtc_int", [this] { on_interrupt(); });
+
+    reactor_.listen(*watering_, Lane::Control, "watering");
+    reactor_.on(*watering_, Message::Type::SetAlarm1, [this](const Message& msg) {
+        set_alarm1(msg);
+    });
+    reactor_.on(*watering_, Message::Type::SetAlarm2, [this](const Message& msg) {
+        set_alarm2(msg);
+    });
+    reactor_.on(*watering_, Message::Type::ClearAlarm1, [this](const Message&) {
+        ESP_LOGI(TAG, "ClearAlarm1!");
+        ds3231_disable_alarm_ints(&dev_, DS3231_ALARM_1);
+        status_version_.bump();
+    });
+    reactor_.on(*watering_, Message::Type::ClearAlarm2, [this](const Message&) {
+        ESP_LOGI(TAG, "ClearAlarm2!");
+        ds3231_disable_alarm_ints(&dev_, DS3231_ALARM_2);
+        status_version_.bump();
+    });
+
+    reactor_.listen(*web_, Lane::Web, "web");
+    reactor_.on(*web_, Message::Type::Status, [this](const Message& msg) {
+        ESP_LOGI(TAG, "Status request from the web");
+        Message resp = {};
+        resp.type = Message::Type::Status;
+        resp.seq = msg.seq;
+        resp.clock_status = get_status();
+
+        web_->send(resp);
+    });
+
+    auto sync = reactor_.add_timer("time_sync", pdMS_TO_TICKS(10 * 60 * 1000), true, [this] {
+        log_status();
+
+        adjust_system_time();
+        publish_temperature();
+    });
+    reactor_.start_timer(sync);
 }
 
-void Clock::run_service() {
+SemaphoreHandle_t Clock::create_semaphore() {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    return xSemaphoreCreateBinaryStatic(static_alloc<StaticSemaphore_t>());
+#else
+    return xSemaphoreCreateBinary();
+#endif
+}
+
+void Clock::start() {
     ESP_LOGI(TAG, "Starting service");
 
     esp_err_t ret = init_rtc();
@@ -41,117 +88,98 @@ void Clock::run_service() {
         ESP_LOGE(TAG, "Clock service is not operational! Err code %s", esp_err_to_name(ret));
     }
 
-    ESP_LOGD(TAG, "%s", get_status().get());
+    log_status();
     adjust_system_time();
+    publish_temperature();
+}
+
+void Clock::on_interrupt() {
+    auto latency = esp_timer_get_time() - isr_time_us_;
+    irq_latency_max_us_ = std::max(irq_latency_max_us_, latency);
+
+    ESP_LOGI(TAG, "interrupt arrived, handled after %lldus", latency);
 
-    while (1) {
-        QueueSetMemberHandle_t active_member =
-            xQueueSelectFromSet(queues_, pdMS_TO_TICKS(10 * 60 * 1000));
-
-        if (active_member == nullptr) {
-            ESP_LOGD(TAG, "%s", get_status().get());
-
-            adjust_system_time();
-        }
-
-        if (active_member == interrupt_arrived_) {
-            xSemaphoreTake(interrupt_arrived_, 0);
-
-            ESP_LOGI(TAG, "interrupt arrived %d", ret);
-
-            ds3231_alarm_t alarms = DS3231_ALARM_NONE;
-            ds3231_get_alarm_flags(&dev_, &alarms);
-            ESP_LOGI(TAG, "alarm elapsed 0x%02x", alarms);
-
-            // Alarm flag is set regardless of the state of interrupt
-            // So additional check for alarm int status must be done
-            uint8_t control = 0;
-            ds3231_get_control(&dev_, &control);
-
-            if ((alarms & 0x1) && (control & 0x1)) {
-                auto msg = Message{};
-                msg.type = Message::Type::Alarm1Expired;
-
-                watering_->send(msg);
-            }
-
-            if ((alarms & 0x2) && (control & 0x2)) {
-                auto msg = Message{};
-                msg.type = Message::Type::Alarm2Expired;
-
-                watering_->send(msg);
-            }
-
-            // Clearing alarm puts INT pin back to high
-            ds3231_clear_alarm_flags(&dev_, alarms);
-        }
-
-        if (active_member == watering_->get_rx()) {
-            if (auto data = watering_->rcv(0)) {
-                auto msg = *data;
-
-                switch (msg.type) {
-                    case Message::Type::SetAlarm1: {
-                        ESP_LOGI(TAG, "SetAlarm1! %s", tm_to_str(msg.alarm_tm).c_str());
-
-                        ds3231_enable_alarm_ints(&dev_, DS3231_ALARM_1);
-                        ds3231_set_alarm(&dev_,
-                                         DS3231_ALARM_1,
-                                         &msg.alarm_tm,
-                                         DS3231_ALARM1_MATCH_SECMINHOUR,
-                                         nullptr,
-                                         (ds3231_alarm2_rate_t)0);
-                        break;
-                    }
-
-                    case Message::Type::SetAlarm2: {
-                        ESP_LOGI(TAG, "SetAlarm2! %s", tm_to_str(msg.alarm_tm).c_str());
-
-                        // Enable interrupt, might be disabled in previous clear call
-                        ds3231_enable_alarm_ints(&dev_, DS3231_ALARM_2);
-                        ds3231_set_alarm(&dev_,
-                                         DS3231_ALARM_2,
-                                         nullptr,
-                                         (ds3231_alarm1_rate_t)0,
-                                         &msg.alarm_tm,
-                                         DS3231_ALARM2_MATCH_MINHOUR);
-                        break;
-                    }
-                    case Message::Type::ClearAlarm1: {
-                        ESP_LOGI(TAG, "ClearAlarm1!");
-                        ds3231_disable_alarm_ints(&dev_, DS3231_ALARM_1);
-                        break;
-                    }
-                    case Message::Type::ClearAlarm2: {
-                        ESP_LOGI(TAG, "ClearAlarm2!");
-                        ds3231_disable_alarm_ints(&dev_, DS3231_ALARM_2);
-                        break;
-                    }
-                    default:
-                        ESP_LOGE(TAG, "Unexpected msg %d from watering service!", (int)msg.type);
-                }
-            }
-        }
-
-        if (active_member == web_->get_rx()) {
-            if (auto data = web_->rcv(0)) {
-                auto msg = *data;
-
-                switch (msg.type) {
-                    case Message::Type::Status: {
-                        ESP_LOGI(TAG, "Status request from the web");
-                        Message resp = {};
-                        resp.type = Message::Type::Status;
-                        resp.status = get_status().release();
-
-                        web_->send(resp);
-                    }
-                    default:
-                        break;
-                }
-            }
-        }
+    ds3231_alarm_t alarms = DS3231_ALARM_NONE;
+    ds3231_get_alarm_flags(&dev_, &alarms);
+    ESP_LOGI(TAG, "alarm elapsed 0x%02x", alarms);
+
+    // Alarm flag is set regardless of the state of interrupt
+    // So additional check for alarm int status must be done
+    uint8_t control = 0;
+    ds3231_get_control(&dev_, &control);
+
+    if ((alarms & 0x1) && (control & 0x1)) {
+        auto msg = Message{};
+        msg.type = Message::Type::Alarm1Expired;
+
+        watering_->send(msg);
+        publish_alarm(1);
     }
+
+    if ((alarms & 0x2) && (control & 0x2)) {
+        auto msg = Message{};
+        msg.type = Message::Type::Alarm2Expired;
+
+        watering_->send(msg);
+        publish_alarm(2);
+    }
+
+    // Clearing alarm puts INT pin back to high
+    ds3231_clear_alarm_flags(&dev_, alarms);
+    status_version_.bump();
+}
+
+void Clock::publish_alarm(int alarm) {
+    counters_.alarms_handled[alarm - 1]++;
+
+    auto event = Event{.type = Event::Type::Alarm, .time_us = esp_timer_get_time()};
+    event.alarm.alarm = alarm;
+
+    events_.publish(event);
+}
+
+// Watering models drying of the soil with it
+void Clock::publish_temperature() {
+    float celsius;
+    if (ds3231_get_temp_float(&dev_, &celsius) != ESP_OK) {
+        return;
+    }
+
+    auto event = Event{.type = Event::Type::Temperature, .time_us = esp_timer_get_time()};
+    event.temperature.celsius = celsius;
+
+    events_.publish(event);
+}
+
+void Clock::set_alarm1(const Message& msg) {
+    ESP_LOGI(TAG, "SetAlarm1! %s", tm_to_str(msg.alarm_tm).c_str());
+
+    auto alarm_tm = msg.alarm_tm;
+
+    ds3231_enable_alarm_ints(&dev_, DS3231_ALARM_1);
+    ds3231_set_alarm(&dev_,
+                     DS3231_ALARM_1,
+                     &alarm_tm,
+                     DS3231_ALARM1_MATCH_SECMINHOUR,
+                     nullptr,
+                     (ds3231_alarm2_rate_t)0);
+    status_version_.bump();
+}
+
+void Clock::set_alarm2(const Message& msg) {
+    ESP_LOGI(TAG, "SetAlarm2! %s", tm_to_str(msg.alarm_tm).c_str());
+
+    auto alarm_tm = msg.alarm_tm;
+
+    // Enable interrupt, might be disabled in previous clear call
+    ds3231_enable_alarm_ints(&dev_, DS3231_ALARM_2);
+    ds3231_set_alarm(&dev_,
+                     DS3231_ALARM_2,
+                     nullptr,
+                     (ds3231_alarm1_rate_t)0,
+                     &alarm_tm,
+                     DS3231_ALARM2_MATCH_MINHOUR);
+    status_version_.bump();
 }
 
 void Clock::int_handler(void* arg) {
@@ -160,6 +188,8 @@ void Clock::int_handler(void* arg) {
     ESP_DRAM_LOGE(DRAM_STR("CLOCK ISR"), "interrupt! handle");
     BaseType_t higher_prio_was_woken = false;
 
+    that->isr_time_us_ = esp_timer_get_time();
+
     xSemaphoreGiveFromISR(that->interrupt_arrived_, &higher_prio_was_woken);
 
     // It is possible (although unlikely, and dependent on the semaphore type) that a semaphore
@@ -221,71 +251,54 @@ err:
     return ret;
 }
 
-std::unique_ptr<char[]> Clock::get_status() {
-    float temp;
-    struct tm rtcinfo;
-
-    struct tm alarm1_info = {};
-    struct tm alarm2_info = {};
-
-    // C++ string formatting using streams is so ugly I cannot stand it,
-    // on the other hand std::format is not there, so only option left
-    // is to use old C API
+ClockStatus Clock::get_status() {
+    ClockStatus res = {};
 
-    if (ds3231_get_temp_float(&dev_, &temp) != ESP_OK) {
-        char* err = nullptr;
-        asprintf(&err, "%s", "Could not get temperature.");
-        ESP_LOGE(TAG, "%s", err);
-
-        // Argument template deduction failed, that's so pathetic!
-        return std::unique_ptr<char[]>(err);
+    if (ds3231_get_temp_float(&dev_, &res.temperature) == ESP_OK) {
+        res.temperature_valid = true;
+    } else {
+        ESP_LOGE(TAG, "Could not get temperature.");
     }
 
-    if (ds3231_get_time(&dev_, &rtcinfo) != ESP_OK) {
-        char* err = nullptr;
-        asprintf(&err, "%s", "Could not get time.");
-
-        ESP_LOGE(TAG, "%s", err);
-        return std::unique_ptr<char[]>(err);
+    if (ds3231_get_time(&dev_, &res.time) == ESP_OK) {
+        res.time_valid = true;
+        res.time.tm_year -= 1900;
+    } else {
+        ESP_LOGE(TAG, "Could not get time.");
     }
 
-    ds3231_get_alarm1(&dev_, &alarm1_info);
-    ds3231_get_alarm2(&dev_, &alarm2_info);
+    ds3231_get_alarm1(&dev_, &res.alarm1);
+    ds3231_get_alarm2(&dev_, &res.alarm2);
 
     //     7        6    5    4        3            2       1             0
     // osc status | NA | NA | NA | sqw status | busy | alarm 2 expired | alarm 1 expired
-    uint8_t status = 0;
-    ds3231_get_status(&dev_, &status);
+    ds3231_get_status(&dev_, &res.status_reg);
 
     //  7        6           5             4           3            2                    1 0
     // osc en| sqw en | convert temp | sqw rate2 | sqw rate 1 | INT/SQW switch | alarm 2/1 notify by interrupt
     // enable | alarm 1 int enable
-    uint8_t ctrl;
-    ds3231_get_control(&dev_, &ctrl);
+    ds3231_get_control(&dev_, &res.control_reg);
 
-    auto alarm1_set = ctrl & 0x1;
-    auto alarm2_set = ctrl & 0x2;
+    res.alarm1_set = res.control_reg & 0x1;
+    res.alarm2_set = res.control_reg & 0x2;
 
-    char* res = nullptr;
-    asprintf(&res,
-             "CLOCK:\n"
-             "Time: %s, %.2f deg Cel\n"
-             "Alarm1 set %s %s\n"
-             "Alarm2 set %s %s\n"
-             "Status reg 0x%02X ctrl 0x%02X\n",
-             tm_to_str(rtcinfo, "%Y-%m-%d  %H:%M:%S").c_str(),
-             temp,
+    res.irq_latency_max_us = irq_latency_max_us_;
 
-             alarm1_set ? "true" : "false",
-             alarm1_set ? tm_to_str(alarm1_info).c_str() : "",
+    res.sockets.add(watering_->status("watering"));
+    res.sockets.add(web_->status("web"));
 
-             alarm2_set ? "true" : "false",
-             alarm2_set ? tm_to_str(alarm2_info).c_str() : "",
+    return res;
+}
 
-             status, ctrl
-             );
+void Clock::log_status() {
+    auto status = get_status();
 
-    return std::unique_ptr<char[]>(res);
+    ESP_LOGD(TAG,
+             "%.2f deg Cel, status reg 0x%02X ctrl 0x%02X, interrupt latency max %lldus",
+             status.temperature,
+             status.status_reg,
+             status.control_reg,
+             status.irq_latency_max_us);
 }
 
 // @brief Use RTC time and hammer system clock to it
@@ -313,6 +326,7 @@ void Clock::adjust_system_time() {
     ESP_LOGI(TAG, "Time sync: diff %ld", now - secs_from_epoch);
 
     settimeofday(&t_val, nullptr);
+    status_version_.bump();
 
     // Lets use CET
     // setenv("TZ", "CET2CEST0", 1);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "service_base.hpp"
+#include "service_counters.hpp"
 #include "socket.hpp"
 
 #include <freertos/semphr.h>
@@ -9,14 +10,26 @@
 
 class Clock : public ServiceBase {
  public:
-    Clock(SockPtr requestor, SockPtr web);
-    void run_service();
+    Clock(Reactor& reactor, EventBus& events, SockPtr requestor, SockPtr web);
+    void start() override;
+
+    const ClockCounters& counters() const {
+        return counters_;
+    }
 
  private:
     static void int_handler(void* arg);
+    static SemaphoreHandle_t create_semaphore();
+
+    void on_interrupt();
+    void publish_alarm(int alarm);
+    void publish_temperature();
+    void set_alarm1(const Message& msg);
+    void set_alarm2(const Message& msg);
 
     esp_err_t init_rtc();
-    std::unique_ptr<char []>  get_status();
+    ClockStatus get_status();
+    void log_status();
     void adjust_system_time();
 
     i2c_dev_t dev_;
@@ -25,4 +38,10 @@ class Clock : public ServiceBase {
     SockPtr web_;
 
     SemaphoreHandle_t interrupt_arrived_;
+
+    // Time of the last RTC interrupt, set from ISR
+    volatile int64_t isr_time_us_ = 0;
+    int64_t irq_latency_max_us_ = 0;
+
+    ClockCounters counters_;
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "static_alloc.hpp"
+
+#include <coroutine>
+#include <cstdlib>
+#include <optional>
+#include <utility>
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    // Coroutine awaiting this one, resumed when this one completes
+    std::coroutine_handle<> continuation;
+    // Nobody owns the frame, it frees itself on completion
+    bool detached = false;
+
+    // Frames come from a fixed pool in static allocation mode
+    static void* operator new(size_t size) {
+        return frame_alloc(size);
+    }
+
+    static void operator delete(void* frame) {
+        frame_free(frame);
+    }
+
+    // Tasks are lazy, they start when awaited or detached
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            auto& promise = handle.promise();
+
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+
+            if (promise.detached) {
+                handle.destroy();
+            }
+
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {
+        }
+    };
+
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+
+    // Exceptions are disabled
+    void unhandled_exception() {
+        abort();
+    }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    void return_value(T v) {
+        value = std::move(v);
+    }
+
+    T result() {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    void return_void() {
+    }
+
+    void result() {
+    }
+};
+
+}  // namespace detail
+
+/// Coroutine that can be awaited by other coroutine, or detached to run on its own.
+/// Resumption is done by whoever completes the awaited operation, in practice the Reactor.
+template <typename T>
+class Task {
+ public:
+    struct promise_type : detail::Promise<T> {
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    }
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+
+        return handle_;
+    }
+
+    T await_resume() {
+        return handle_.promise().result();
+    }
+
+    /// Starts the coroutine, it runs until first suspension, frame is freed when it completes
+    void detach() {
+        auto handle = std::exchange(handle_, {});
+        handle.promise().detached = true;
+
+        handle.resume();
+    }
+
+ private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+};
@@ -0,0 +1,67 @@
+#include "drying_model.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void DryingModel::add(time_t time, float moisture, float temperature) {
+    if (std::isnan(moisture) || moisture <= 0) {
+        return;
+    }
+
+    if (!anchored_ || moisture > last_moisture_ + WETTING_STEP) {
+        anchor(time, moisture);
+        return;
+    }
+
+    auto interval = time - last_time_;
+    if (interval < MIN_INTERVAL_S) {
+        return;
+    }
+
+    if (std::isnan(temperature)) {
+        temperature = DEFAULT_TEMPERATURE;
+    }
+
+    // Rise within noise counts as no drying
+    float hours = interval / 3600.0f;
+    float k = std::max(std::log(last_moisture_ / moisture) / hours, 0.0f);
+
+    weight_ = FORGET * weight_ + 1;
+    sum_t_ = FORGET * sum_t_ + temperature;
+    sum_tt_ = FORGET * sum_tt_ + temperature * temperature;
+    sum_k_ = FORGET * sum_k_ + k;
+    sum_tk_ = FORGET * sum_tk_ + temperature * k;
+
+    anchor(time, moisture);
+}
+
+float DryingModel::rate(float temperature) const {
+    if (!ready()) {
+        return 0;
+    }
+
+    if (std::isnan(temperature)) {
+        temperature = DEFAULT_TEMPERATURE;
+    }
+
+    float mean_t = sum_t_ / weight_;
+    float mean_k = sum_k_ / weight_;
+    float variance = sum_tt_ / weight_ - mean_t * mean_t;
+
+    // Temperature hardly varied, its effect cannot be told from noise
+    if (variance < MIN_TEMPERATURE_VARIANCE) {
+        return mean_k;
+    }
+
+    float slope = (sum_tk_ / weight_ - mean_t * mean_k) / variance;
+
+    return std::max(mean_k + slope * (temperature - mean_t), 0.0f);
+}
+
+float DryingModel::predict(float moisture, float hours, float temperature) const {
+    if (!ready()) {
+        return nanf("");
+    }
+
+    return moisture * std::exp(-rate(temperature) * hours);
+}
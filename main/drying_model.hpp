@@ -0,0 +1,58 @@
+#pragma once
+
+#include <ctime>
+
+/// Drying of a section's soil, moisture falls as m * exp(-k * t). Rate k per hour depends on air
+/// temperature, k = a + b * T is fitted by least squares over the rates seen between consecutive
+/// samples. Older samples weigh less, so the model follows the season. Adding a sample is O(1).
+class DryingModel {
+ public:
+    /// Reading of the section and air temperature at that time, NaN temperature if unknown
+    void add(time_t time, float moisture, float temperature);
+
+    /// Section got water, drying starts over from the next sample
+    void restart() {
+        anchored_ = false;
+    }
+
+    /// Enough drying was seen to predict
+    bool ready() const {
+        return weight_ >= MIN_WEIGHT;
+    }
+
+    /// Drying rate per hour at the temperature, 0 if not ready
+    float rate(float temperature) const;
+
+    /// Moisture after given hours of drying, NaN if not ready
+    float predict(float moisture, float hours, float temperature) const;
+
+ private:
+    // Weight the history keeps with each new sample, about a week of hourly samples
+    static constexpr float FORGET = 0.995f;
+    static constexpr float MIN_WEIGHT = 6.0f;
+    // Samples closer than that carry mostly quantization of the readings
+    static const int MIN_INTERVAL_S = 30 * 60;
+    // Moisture rising more than that is water, not noise
+    static constexpr float WETTING_STEP = 0.02f;
+    // Used when the RTC gives no temperature
+    static constexpr float DEFAULT_TEMPERATURE = 20.0f;
+    // Spread of temperatures in K^2 below which dependence on temperature is not fitted
+    static constexpr float MIN_TEMPERATURE_VARIANCE = 1.0f;
+
+    void anchor(time_t time, float moisture) {
+        anchored_ = true;
+        last_time_ = time;
+        last_moisture_ = moisture;
+    }
+
+    bool anchored_ = false;
+    time_t last_time_ = 0;
+    float last_moisture_ = 0;
+
+    // Weighted sums of 1, T, T^2, k and T * k over the samples
+    float weight_ = 0;
+    float sum_t_ = 0;
+    float sum_tt_ = 0;
+    float sum_k_ = 0;
+    float sum_tk_ = 0;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+
+/// Something that happened in a service, worth telling the outside world about as it happens
+struct Event {
+    enum class Type : uint8_t {
+        Moisture,
+        Valves,
+        Alarm,
+        Temperature,
+    } type;
+
+    // esp_timer timestamp
+    int64_t time_us;
+
+    union {
+        // Moisture, reading changed noticeably
+        struct {
+            int section;
+            float moisture;
+        } moisture;
+
+        // Valves, bit per section, set if open
+        struct {
+            uint32_t open_mask;
+        } valves;
+
+        // Alarm, RTC alarm expired
+        struct {
+            int alarm;
+        } alarm;
+
+        // Temperature, periodic reading of the RTC sensor
+        struct {
+            float celsius;
+        } temperature;
+    };
+};
+
+/// Fan-out of service events. Listeners are called on the publisher's task, they must not block,
+/// in practice they copy the event and return.
+class EventBus {
+ public:
+    using Listener = void (*)(void* ctx, const Event& event);
+
+    /// Listeners are registered before services start, the list is not guarded
+    void subscribe(Listener listener, void* ctx) {
+        configASSERT(listeners_count_ < MAX_LISTENERS);
+
+        listeners_[listeners_count_++] = Subscription{.listener = listener, .ctx = ctx};
+    }
+
+    void publish(const Event& event) const {
+        for (size_t i = 0; i < listeners_count_; i++) {
+            listeners_[i].listener(listeners_[i].ctx, event);
+        }
+    }
+
+ private:
+    static const size_t MAX_LISTENERS = 4;
+
+    struct Subscription {
+        Listener listener;
+        void* ctx;
+    };
+
+    std::array<Subscription, MAX_LISTENERS> listeners_ = {};
+    size_t listeners_count_ = 0;
+};
@@ -0,0 +1,239 @@
+#include "event_stream.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <esp_log.h>
+
+static const char* TAG = "EventStream";
+
+EventStream::EventStream(EventBus& bus) {
+    for (auto& client : clients_) {
+        client = Client{};
+        client.fd = -1;
+    }
+
+    bus.subscribe(on_event, this);
+}
+
+esp_err_t EventStream::handle(httpd_req_t* req) {
+    if (req->method == HTTP_GET) {
+        int fd = httpd_req_to_sockfd(req);
+        bool added = false;
+
+        // Clients that went away are only noticed on send, reclaim their slots now. Socket number
+        // of the new client may also be reused after one of them.
+        for (auto& client : clients_) {
+            if (client.fd >= 0 &&
+                (client.fd == fd ||
+                 httpd_ws_get_fd_info(req->handle, client.fd) != HTTPD_WS_CLIENT_WEBSOCKET)) {
+                remove(client, false);
+            }
+        }
+
+        portENTER_CRITICAL(&lock_);
+        for (auto& client : clients_) {
+            if (client.fd < 0) {
+                client = Client{};
+                client.fd = fd;
+                stats_.clients++;
+                added = true;
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&lock_);
+
+        if (!added) {
+            ESP_LOGW(TAG, "Too many event clients, refusing %d", fd);
+            httpd_sess_trigger_close(req->handle, fd);
+            return ESP_OK;
+        }
+
+        ESP_LOGI(TAG, "Event client %d connected", fd);
+        return ESP_OK;
+    }
+
+    // Clients are not expected to say anything, read and drop whatever arrives. Failure closes
+    // the connection, so does anything big.
+    uint8_t buf[32];
+    httpd_ws_frame_t frame = {};
+    frame.payload = buf;
+
+    auto ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK || frame.len == 0) {
+        return ret;
+    }
+
+    return httpd_ws_recv_frame(req, &frame, sizeof(buf));
+}
+
+EventStream::Stats EventStream::stats() const {
+    portENTER_CRITICAL(&lock_);
+    auto res = stats_;
+    portEXIT_CRITICAL(&lock_);
+
+    return res;
+}
+
+void EventStream::on_event(void* ctx, const Event& event) {
+    ((EventStream*)ctx)->publish(event);
+}
+
+void EventStream::publish(const Event& event) {
+    if (server_ == nullptr) {
+        return;
+    }
+
+    bool any = false;
+
+    portENTER_CRITICAL(&lock_);
+    for (auto& client : clients_) {
+        if (client.fd < 0 || client.evict) {
+            continue;
+        }
+
+        if (client.count == CLIENT_QUEUE) {
+            // Queue did not drain since the last CLIENT_QUEUE events, client cannot keep up
+            client.evict = true;
+            stats_.dropped++;
+        } else {
+            client.pending[(client.head + client.count) % CLIENT_QUEUE] = event;
+            client.count++;
+        }
+
+        any = true;
+    }
+    portEXIT_CRITICAL(&lock_);
+
+    if (any && !flush_queued_.exchange(true)) {
+        if (httpd_queue_work(server_, flush_work, this) != ESP_OK) {
+            flush_queued_ = false;
+        }
+    }
+}
+
+void EventStream::flush_work(void* arg) {
+    ((EventStream*)arg)->flush();
+}
+
+void EventStream::flush() {
+    // Events published from now on need another flush
+    flush_queued_ = false;
+
+    for (auto& client : clients_) {
+        for (;;) {
+            Event event;
+            int fd = -1;
+            bool evict = false;
+
+            portENTER_CRITICAL(&lock_);
+            if (client.fd >= 0) {
+                evict = client.evict;
+
+                if (!evict && client.count > 0) {
+                    fd = client.fd;
+                    event = client.pending[client.head];
+                    client.head = (client.head + 1) % CLIENT_QUEUE;
+                    client.count--;
+                }
+            }
+            portEXIT_CRITICAL(&lock_);
+
+            if (evict) {
+                ESP_LOGW(TAG, "Event client %d too slow, disconnecting", client.fd);
+                remove(client, true);
+                break;
+            }
+
+            if (fd < 0) {
+                break;
+            }
+
+            if (!send(fd, event)) {
+                remove(client, false);
+                break;
+            }
+        }
+    }
+}
+
+bool EventStream::send(int fd, const Event& event) {
+    // Session might have been closed by the client meanwhile
+    if (httpd_ws_get_fd_info(server_, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+        ESP_LOGI(TAG, "Event client %d gone", fd);
+        return false;
+    }
+
+    char text[128] = {};
+    int len = 0;
+
+    switch (event.type) {
+        case Event::Type::Moisture:
+            len = snprintf(text,
+                           sizeof(text),
+                           R"({"type":"moisture","time_us":%)" PRId64
+                           R"(,"section":%d,"moisture":%.3f})",
+                           event.time_us,
+                           event.moisture.section,
+                           event.moisture.moisture);
+            break;
+
+        case Event::Type::Valves:
+            len = snprintf(text,
+                           sizeof(text),
+                           R"({"type":"valves","time_us":%)" PRId64 R"(,"open_mask":%)" PRIu32 "}",
+                           event.time_us,
+                           event.valves.open_mask);
+            break;
+
+        case Event::Type::Alarm:
+            len = snprintf(text,
+                           sizeof(text),
+                           R"({"type":"alarm","time_us":%)" PRId64 R"(,"alarm":%d})",
+                           event.time_us,
+                           event.alarm.alarm);
+            break;
+
+        case Event::Type::Temperature:
+            len = snprintf(text,
+                           sizeof(text),
+                           R"({"type":"temperature","time_us":%)" PRId64 R"(,"celsius":%.2f})",
+                           event.time_us,
+                           event.temperature.celsius);
+            break;
+    }
+
+    httpd_ws_frame_t frame = {};
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.final = true;
+    frame.payload = (uint8_t*)text;
+    frame.len = len;
+
+    if (httpd_ws_send_frame_async(server_, fd, &frame) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send event to %d", fd);
+        return false;
+    }
+
+    portENTER_CRITICAL(&lock_);
+    stats_.sent++;
+    portEXIT_CRITICAL(&lock_);
+
+    return true;
+}
+
+void EventStream::remove(Client& client, bool close) {
+    int fd = client.fd;
+
+    portENTER_CRITICAL(&lock_);
+    if (close) {
+        stats_.evicted++;
+    }
+    stats_.clients--;
+    client.fd = -1;
+    client.count = 0;
+    portEXIT_CRITICAL(&lock_);
+
+    if (close) {
+        httpd_sess_trigger_close(server_, fd);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "event_bus.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+
+/// Pushes events to WebSocket clients of /events. Each client has a bounded queue of pending
+/// events, drained on the server task. Client that lets its queue fill up is too slow to keep up
+/// and is disconnected, so it cannot hold back the others or the publisher.
+class EventStream {
+ public:
+    struct Stats {
+        uint32_t clients;
+        uint32_t sent;
+        // Events not queued, client queue was full
+        uint32_t dropped;
+        // Clients disconnected for being too slow
+        uint32_t evicted;
+    };
+
+    explicit EventStream(EventBus& bus);
+
+    void attach(httpd_handle_t server) {
+        server_ = server;
+    }
+
+    /// WebSocket handler, registers client on handshake and discards what clients send
+    esp_err_t handle(httpd_req_t* req);
+
+    Stats stats() const;
+
+ private:
+    static const size_t MAX_CLIENTS = 4;
+    static const size_t CLIENT_QUEUE = 8;
+
+    struct Client {
+        // -1 if slot is free
+        int fd;
+        bool evict;
+        std::array<Event, CLIENT_QUEUE> pending;
+        uint8_t head;
+        uint8_t count;
+    };
+
+    static void on_event(void* ctx, const Event& event);
+    static void flush_work(void* arg);
+
+    void publish(const Event& event);
+    void flush();
+    bool send(int fd, const Event& event);
+    void remove(Client& client, bool close);
+
+    httpd_handle_t server_ = nullptr;
+
+    // Guards clients, taken by the publisher and the server task
+    mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+    std::array<Client, MAX_CLIENTS> clients_;
+    Stats stats_ = {};
+
+    // Flush is queued on the server task once, however many events arrive meanwhile
+    std::atomic<bool> flush_queued_{false};
+};
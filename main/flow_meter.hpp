@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+#include <esp_err.h>
+
+/// Pulse flow meter on the water main, each pulse is a fixed volume
+class FlowMeter {
+ public:
+    virtual ~FlowMeter() = default;
+
+    /// Hardware setup, called from Watering::start
+    virtual esp_err_t init() = 0;
+
+    /// Pulses since init, wraps around
+    virtual uint32_t pulses() = 0;
+
+    /// Water starts or stops flowing, only a simulated meter needs to know
+    virtual void set_flowing(bool flowing) {
+    }
+};
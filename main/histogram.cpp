@@ -0,0 +1,22 @@
+#include "histogram.hpp"
+
+void Histogram::record(int64_t us) {
+    size_t bucket = 0;
+    while (bucket < BOUNDS && us > BOUNDS_US[bucket]) {
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&lock_);
+    data_.buckets[bucket]++;
+    data_.count++;
+    data_.sum_us += us;
+    portEXIT_CRITICAL(&lock_);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    portENTER_CRITICAL(&lock_);
+    auto res = data_;
+    portEXIT_CRITICAL(&lock_);
+
+    return res;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+
+/// Latency distribution in fixed buckets, cheap enough to record every request. Recorded and read
+/// from different tasks.
+class Histogram {
+ public:
+    static const size_t BOUNDS = 10;
+
+    /// Upper bounds of the buckets, one more bucket counts everything above the last one
+    static constexpr std::array<int64_t, BOUNDS> BOUNDS_US = {
+        1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000};
+
+    struct Snapshot {
+        // Not cumulative, each sample is counted in one bucket only
+        std::array<uint32_t, BOUNDS + 1> buckets;
+        uint32_t count;
+        int64_t sum_us;
+    };
+
+    void record(int64_t us);
+
+    Snapshot snapshot() const;
+
+ private:
+    mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+    Snapshot data_ = {};
+};
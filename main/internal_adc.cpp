@@ -0,0 +1,91 @@
+#include "internal_adc.hpp"
+
+#include <algorithm>
+
+#include <esp_adc/adc_cali_scheme.h>
+#include <esp_check.h>
+#include <esp_log.h>
+
+static const char* TAG = "InternalAdc";
+
+esp_err_t InternalAdc::init() {
+    adc_oneshot_unit_init_cfg_t unit_config = {
+        .unit_id = ADC_UNIT_1,
+        .ulp_mode = ADC_ULP_MODE_DISABLE,
+    };
+    ESP_RETURN_ON_ERROR(adc_oneshot_new_unit(&unit_config, &unit_), TAG, "Failed to init ADC1");
+
+    adc_oneshot_chan_cfg_t channel_config = {
+        .atten = atten_,
+        .bitwidth = bitwidth_,
+    };
+
+    for (int probe = 0; probe < count_; probe++) {
+        ESP_RETURN_ON_ERROR(adc_oneshot_config_channel(unit_, channels_[probe], &channel_config),
+                            TAG,
+                            "Failed to configure channel %d",
+                            channels_[probe]);
+    }
+
+    if (init_calibration() != ESP_OK) {
+        // Voltage is only reported, moisture comes from raw readings
+        ESP_LOGW(TAG, "No calibration, voltage is estimated");
+        for (int raw = 0; raw < ADC_RANGE; raw++) {
+            voltage_lut_[raw] = raw * UNCALIBRATED_MAX_MV / (ADC_RANGE - 1);
+        }
+
+        return ESP_OK;
+    }
+
+    for (int raw = 0; raw < ADC_RANGE; raw++) {
+        int mv = 0;
+        ESP_RETURN_ON_ERROR(adc_cali_raw_to_voltage(cali_, raw, &mv), TAG, "Failed to calibrate");
+        voltage_lut_[raw] = mv;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t InternalAdc::init_calibration() {
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_curve_fitting_config_t config = {
+        .unit_id = ADC_UNIT_1,
+        .atten = atten_,
+        .bitwidth = bitwidth_,
+    };
+    ESP_RETURN_ON_ERROR(adc_cali_create_scheme_curve_fitting(&config, &cali_),
+                        TAG,
+                        "Curve fitting not available");
+    ESP_LOGD(TAG, "Calibrated using curve fitting");
+    return ESP_OK;
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    // Two point or eFuse Vref values if burnt in, default Vref otherwise
+    adc_cali_line_fitting_config_t config = {
+        .unit_id = ADC_UNIT_1,
+        .atten = atten_,
+        .bitwidth = bitwidth_,
+#if CONFIG_IDF_TARGET_ESP32
+        .default_vref = DEFAULT_VREF,
+#endif
+    };
+    ESP_RETURN_ON_ERROR(adc_cali_create_scheme_line_fitting(&config, &cali_),
+                        TAG,
+                        "Line fitting not available");
+    ESP_LOGD(TAG, "Calibrated using line fitting");
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void InternalAdc::read(int probe, uint16_t* samples, int count) {
+    for (int i = 0; i < count; i++) {
+        int raw = 0;
+        // Failed conversion reads 0, the probe shows as disconnected
+        if (adc_oneshot_read(unit_, channels_[probe], &raw) != ESP_OK) {
+            raw = 0;
+        }
+
+        samples[i] = std::clamp(raw, 0, ADC_RANGE - 1);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "probe_backend.hpp"
+
+#include <array>
+
+#include <esp_adc/adc_cali.h>
+#include <esp_adc/adc_oneshot.h>
+
+/// Probes on ADC1 of the ESP32
+class InternalAdc : public ProbeBackend {
+ public:
+    InternalAdc(const adc_channel_t* channels, int count) : channels_(channels), count_(count) {
+    }
+
+    esp_err_t init() override;
+
+    int probes() const override {
+        return count_;
+    }
+
+    void read(int probe, uint16_t* samples, int count) override;
+
+    uint32_t millivolts(uint16_t raw) const override {
+        return voltage_lut_[raw];
+    }
+
+ private:
+    static const int DEFAULT_VREF = 1100;  // Use adc_vref_to_gpio() to obtain a better estimate
+    static const int ADC_RANGE = 4096;
+    // Full scale at 11 dB attenuation, used when the chip has no calibration scheme
+    static const int UNCALIBRATED_MAX_MV = 3100;
+
+    esp_err_t init_calibration();
+
+    const adc_channel_t* channels_;
+    int count_;
+
+    adc_oneshot_unit_handle_t unit_ = nullptr;
+    adc_cali_handle_t cali_ = nullptr;
+    adc_bitwidth_t bitwidth_ = ADC_BITWIDTH_12;
+    adc_atten_t atten_ = ADC_ATTEN_DB_11;
+
+    // Calibration is the same for all channels, built once instead of converting every read
+    std::array<uint16_t, ADC_RANGE> voltage_lut_ = {};
+};
@@ -0,0 +1,387 @@
+#include "json_reader.hpp"
+
+#include <algorithm>
+
+JsonReader::Token JsonReader::next() {
+    if (error_) {
+        return Token::Error;
+    }
+
+    skip_whitespace();
+    int c = peek();
+
+    // Top level value is complete
+    if (depth_ == 0 && need_separator_) {
+        return c < 0 ? Token::End : fail("unexpected data after the end");
+    }
+
+    if (c < 0) {
+        return fail("unexpected end of input");
+    }
+
+    if (c == '}' || c == ']') {
+        if (depth_ == 0 || (c == '}') != in_object() || have_key_) {
+            return fail("unexpected end of container");
+        }
+
+        get();
+        depth_--;
+        need_separator_ = true;
+
+        return c == '}' ? Token::EndObject : Token::EndArray;
+    }
+
+    if (need_separator_) {
+        if (c != ',') {
+            return fail("expected ','");
+        }
+
+        get();
+        skip_whitespace();
+        need_separator_ = false;
+
+        // Container cannot end right after the comma
+        c = peek();
+        if (c == '}' || c == ']') {
+            return fail("trailing comma");
+        }
+    }
+
+    if (in_object() && !have_key_) {
+        if (c != '"') {
+            return fail("expected member name");
+        }
+
+        if (read_string(Token::Key) == Token::Error) {
+            return Token::Error;
+        }
+
+        skip_whitespace();
+        if (get() != ':') {
+            return fail("expected ':'");
+        }
+
+        have_key_ = true;
+        return Token::Key;
+    }
+
+    have_key_ = false;
+    need_separator_ = true;
+
+    switch (c) {
+        case '{':
+        case '[':
+            if (depth_ == MAX_DEPTH) {
+                return fail("nested too deep");
+            }
+
+            get();
+            containers_ = (containers_ & ~(1u << depth_)) | ((c == '{' ? 1u : 0u) << depth_);
+            depth_++;
+            need_separator_ = false;
+
+            return c == '{' ? Token::BeginObject : Token::BeginArray;
+
+        case '"':
+            return read_string(Token::String);
+
+        case 't':
+            return read_literal("true", Token::True);
+
+        case 'f':
+            return read_literal("false", Token::False);
+
+        case 'n':
+            return read_literal("null", Token::Null);
+
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                return read_number();
+            }
+
+            return fail("unexpected character");
+    }
+}
+
+bool JsonReader::skip(Token token) {
+    if (token != Token::BeginObject && token != Token::BeginArray) {
+        return token != Token::Error && token != Token::End;
+    }
+
+    size_t depth = 1;
+
+    while (depth > 0) {
+        switch (next()) {
+            case Token::BeginObject:
+            case Token::BeginArray:
+                depth++;
+                break;
+
+            case Token::EndObject:
+            case Token::EndArray:
+                depth--;
+                break;
+
+            case Token::Error:
+            case Token::End:
+                return false;
+
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+int JsonReader::peek() {
+    if (pos_ == len_) {
+        if (eof_) {
+            return -1;
+        }
+
+        int ret = source_(ctx_, buffer_, BUFFER_SIZE);
+
+        if (ret <= 0) {
+            eof_ = true;
+            return -1;
+        }
+
+        pos_ = 0;
+        len_ = ret;
+    }
+
+    return (unsigned char)buffer_[pos_];
+}
+
+int JsonReader::get() {
+    int c = peek();
+
+    if (c >= 0) {
+        pos_++;
+    }
+
+    return c;
+}
+
+void JsonReader::skip_whitespace() {
+    for (int c = peek(); c == ' ' || c == '\t' || c == '\n' || c == '\r'; c = peek()) {
+        get();
+    }
+}
+
+JsonReader::Token JsonReader::fail(const char* error) {
+    if (error_ == nullptr) {
+        error_ = error;
+    }
+
+    return Token::Error;
+}
+
+JsonReader::Token JsonReader::read_string(Token token) {
+    // Opening quote
+    get();
+
+    text_len_ = 0;
+    truncated_ = false;
+
+    for (;;) {
+        int c = get();
+
+        if (c < 0) {
+            return fail("unterminated string");
+        }
+
+        if (c == '"') {
+            break;
+        }
+
+        if (c < 0x20) {
+            return fail("control character in string");
+        }
+
+        if (c == '\\') {
+            if (!read_escape()) {
+                return Token::Error;
+            }
+            continue;
+        }
+
+        append(c);
+    }
+
+    text_[text_len_] = '\0';
+    return token;
+}
+
+bool JsonReader::read_escape() {
+    int c = get();
+
+    switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            append(c);
+            return true;
+        case 'b':
+            append('\b');
+            return true;
+        case 'f':
+            append('\f');
+            return true;
+        case 'n':
+            append('\n');
+            return true;
+        case 'r':
+            append('\r');
+            return true;
+        case 't':
+            append('\t');
+            return true;
+        case 'u':
+            break;
+        default:
+            fail("invalid escape");
+            return false;
+    }
+
+    uint32_t code = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int h = get();
+        code <<= 4;
+
+        if (h >= '0' && h <= '9') {
+            code |= h - '0';
+        } else if (h >= 'a' && h <= 'f') {
+            code |= h - 'a' + 10;
+        } else if (h >= 'A' && h <= 'F') {
+            code |= h - 'A' + 10;
+        } else {
+            fail("invalid unicode escape");
+            return false;
+        }
+    }
+
+    // Encode as UTF-8, surrogate pairs are not joined, nothing here needs characters outside BMP
+    if (code < 0x80) {
+        append(code);
+    } else if (code < 0x800) {
+        append(0xC0 | (code >> 6));
+        append(0x80 | (code & 0x3F));
+    } else {
+        append(0xE0 | (code >> 12));
+        append(0x80 | ((code >> 6) & 0x3F));
+        append(0x80 | (code & 0x3F));
+    }
+
+    return true;
+}
+
+JsonReader::Token JsonReader::read_literal(const char* literal, Token token) {
+    for (const char* p = literal; *p; p++) {
+        if (get() != *p) {
+            return fail("invalid literal");
+        }
+    }
+
+    return token;
+}
+
+JsonReader::Token JsonReader::read_number() {
+    text_len_ = 0;
+    truncated_ = false;
+
+    // strtod in newlib may allocate, conversion is done by hand while the text is collected.
+    // Precision is lower than strtod gives, more than enough for configuration values.
+    bool negative = false;
+    int64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+
+    if (peek() == '-') {
+        negative = true;
+        append(get());
+    }
+
+    for (int c = peek(); c >= '0' && c <= '9'; c = peek()) {
+        append(get());
+        digits++;
+
+        if (mantissa < INT64_MAX / 10) {
+            mantissa = mantissa * 10 + (c - '0');
+        } else {
+            exponent++;
+        }
+    }
+
+    if (digits == 0) {
+        return fail("invalid number");
+    }
+
+    if (peek() == '.') {
+        append(get());
+        digits = 0;
+
+        for (int c = peek(); c >= '0' && c <= '9'; c = peek()) {
+            append(get());
+            digits++;
+
+            if (mantissa < INT64_MAX / 10) {
+                mantissa = mantissa * 10 + (c - '0');
+                exponent--;
+            }
+        }
+
+        if (digits == 0) {
+            return fail("invalid number");
+        }
+    }
+
+    if (peek() == 'e' || peek() == 'E') {
+        append(get());
+
+        bool exp_negative = false;
+        if (peek() == '-' || peek() == '+') {
+            exp_negative = peek() == '-';
+            append(get());
+        }
+
+        int exp = 0;
+        digits = 0;
+
+        for (int c = peek(); c >= '0' && c <= '9'; c = peek()) {
+            append(get());
+            digits++;
+            exp = std::min(exp * 10 + (c - '0'), 1000);
+        }
+
+        if (digits == 0) {
+            return fail("invalid number");
+        }
+
+        exponent += exp_negative ? -exp : exp;
+    }
+
+    text_[text_len_] = '\0';
+
+    double value = mantissa;
+    for (; exponent > 0; exponent--) {
+        value *= 10;
+    }
+    for (; exponent < 0; exponent++) {
+        value /= 10;
+    }
+
+    number_ = negative ? -value : value;
+
+    return Token::Number;
+}
+
+void JsonReader::append(char c) {
+    if (text_len_ < MAX_TEXT) {
+        text_[text_len_++] = c;
+    } else {
+        truncated_ = true;
+    }
+}
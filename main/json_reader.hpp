@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Pull parser, reads JSON from a byte stream through a small buffer and returns one token at a
+/// time. Nothing is allocated, the document is never held in memory as a whole. Strings longer
+/// than the text buffer are truncated, which is reported, not an error.
+class JsonReader {
+ public:
+    /// Reads up to len bytes, returns number of bytes read, 0 at the end of input, negative on
+    /// error
+    using Source = int (*)(void* ctx, char* buf, size_t len);
+
+    enum class Token {
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        // Object member name, text() holds it
+        Key,
+        String,
+        Number,
+        True,
+        False,
+        Null,
+        // Top level value is complete and there is nothing but whitespace after it
+        End,
+        Error,
+    };
+
+    JsonReader(Source source, void* ctx) : source_(source), ctx_(ctx) {
+    }
+
+    Token next();
+
+    /// Skips the value that begins with the token, containers are skipped with all contents
+    bool skip(Token token);
+
+    /// Decoded text of the last Key or String, raw text of the last Number, possibly truncated
+    const char* text() const {
+        return text_;
+    }
+
+    bool truncated() const {
+        return truncated_;
+    }
+
+    /// Value of the last Number
+    double number() const {
+        return number_;
+    }
+
+    /// Description of the first error, null if there is none
+    const char* error() const {
+        return error_;
+    }
+
+    static const size_t MAX_TEXT = 32;
+    static const size_t MAX_DEPTH = 32;
+
+ private:
+    static const size_t BUFFER_SIZE = 64;
+
+    int peek();
+    int get();
+    void skip_whitespace();
+
+    Token fail(const char* error);
+    Token read_string(Token token);
+    Token read_literal(const char* literal, Token token);
+    Token read_number();
+    bool read_escape();
+    void append(char c);
+
+    bool in_object() const {
+        return depth_ > 0 && (containers_ >> (depth_ - 1)) & 1;
+    }
+
+    Source source_;
+    void* ctx_;
+
+    char buffer_[BUFFER_SIZE];
+    size_t pos_ = 0;
+    size_t len_ = 0;
+    bool eof_ = false;
+
+    // Bit per nesting level, set for objects
+    uint32_t containers_ = 0;
+    size_t depth_ = 0;
+
+    // Value was completed, comma or end of container is expected
+    bool need_separator_ = false;
+    // Object member name was read, its value is expected
+    bool have_key_ = false;
+
+    char text_[MAX_TEXT + 1] = {};
+    size_t text_len_ = 0;
+    bool truncated_ = false;
+    double number_ = 0;
+
+    const char* error_ = nullptr;
+};
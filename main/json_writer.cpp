@@ -0,0 +1,119 @@
+#include "json_writer.hpp"
+
+#include <cinttypes>
+#include <cmath>
+
+void JsonWriter::begin_object(const char* key) {
+    begin_value(key);
+    out_.put('{');
+    need_comma_ = false;
+}
+
+void JsonWriter::end_object() {
+    out_.put('}');
+    need_comma_ = true;
+}
+
+void JsonWriter::begin_array(const char* key) {
+    begin_value(key);
+    out_.put('[');
+    need_comma_ = false;
+}
+
+void JsonWriter::end_array() {
+    out_.put(']');
+    need_comma_ = true;
+}
+
+void JsonWriter::null(const char* key) {
+    begin_value(key);
+    out_.write("null");
+}
+
+void JsonWriter::boolean(const char* key, bool value) {
+    begin_value(key);
+    out_.write(value ? "true" : "false");
+}
+
+void JsonWriter::integer(const char* key, int64_t value) {
+    begin_value(key);
+    out_.print("%" PRId64, value);
+}
+
+void JsonWriter::number(const char* key, double value, int precision) {
+    begin_value(key);
+
+    if (!std::isfinite(value)) {
+        out_.write("null");
+        return;
+    }
+
+    out_.print("%.*f", precision, value);
+}
+
+void JsonWriter::string(const char* key, const char* value) {
+    begin_value(key);
+
+    if (value == nullptr) {
+        out_.write("null");
+        return;
+    }
+
+    quoted(value);
+}
+
+void JsonWriter::time(const char* key, const struct tm& value, const char* format) {
+    char buf[32] = {};
+    strftime(buf, sizeof(buf), format, &value);
+
+    string(key, buf);
+}
+
+void JsonWriter::begin_value(const char* key) {
+    if (need_comma_) {
+        out_.put(',');
+    }
+
+    // Whatever comes next in this container is preceded by a comma
+    need_comma_ = true;
+
+    if (key != nullptr) {
+        quoted(key);
+        out_.put(':');
+    }
+}
+
+void JsonWriter::quoted(const char* str) {
+    out_.put('"');
+
+    for (; *str; str++) {
+        char c = *str;
+
+        switch (c) {
+            case '"':
+                out_.write("\\\"");
+                break;
+            case '\\':
+                out_.write("\\\\");
+                break;
+            case '\n':
+                out_.write("\\n");
+                break;
+            case '\r':
+                out_.write("\\r");
+                break;
+            case '\t':
+                out_.write("\\t");
+                break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    out_.print("\\u%04x", c);
+                } else {
+                    out_.put(c);
+                }
+                break;
+        }
+    }
+
+    out_.put('"');
+}
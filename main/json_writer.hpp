@@ -0,0 +1,35 @@
+#pragma once
+
+#include "chunk_writer.hpp"
+
+#include <cstdint>
+#include <ctime>
+
+/// Emits JSON straight to the response as it goes, nothing is built in memory. Key is null for
+/// array elements. Caller is responsible for matching begin/end calls.
+class JsonWriter {
+ public:
+    explicit JsonWriter(ChunkWriter& out) : out_(out) {
+    }
+
+    void begin_object(const char* key = nullptr);
+    void end_object();
+    void begin_array(const char* key = nullptr);
+    void end_array();
+
+    void null(const char* key);
+    void boolean(const char* key, bool value);
+    void integer(const char* key, int64_t value);
+    // NaN and infinities have no JSON representation, they are written as null
+    void number(const char* key, double value, int precision = 3);
+    void string(const char* key, const char* value);
+    // Time formatted with strftime, tm as struct tm defines it
+    void time(const char* key, const struct tm& value, const char* format = "%Y-%m-%dT%H:%M:%S");
+
+ private:
+    void begin_value(const char* key);
+    void quoted(const char* str);
+
+    ChunkWriter& out_;
+    bool need_comma_ = false;
+};
@@ -0,0 +1,64 @@
+#include "moisture_filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+MoistureFilter::Sample MoistureFilter::reduce(uint16_t* samples, int count) const {
+    // Few dozens of samples, insertion sort is small and quick enough
+    for (int i = 1; i < count; i++) {
+        auto value = samples[i];
+        int j = i;
+
+        for (; j > 0 && samples[j - 1] > value; j--) {
+            samples[j] = samples[j - 1];
+        }
+
+        samples[j] = value;
+    }
+
+    int lower = count / 4;
+    int upper = count - 1 - count / 4;
+    uint16_t raw = 0;
+
+    if (config_.reducer == Reducer::Median || upper <= lower) {
+        raw = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    } else {
+        uint32_t sum = 0;
+        for (int i = lower; i <= upper; i++) {
+            sum += samples[i];
+        }
+
+        raw = sum / (upper - lower + 1);
+    }
+
+    return Sample{.raw = raw, .spread = (uint16_t)(samples[upper] - samples[lower])};
+}
+
+MoistureFilter::Reading MoistureFilter::update(const Sample& sample) {
+    if (sample.raw <= RAIL_MARGIN || sample.raw >= ADC_MAX - RAIL_MARGIN) {
+        return Reading{.raw = sample.raw, .confidence = 0};
+    }
+
+    float confidence = 1.0f - (float)std::min<int>(sample.spread, MAX_SPREAD) / MAX_SPREAD;
+
+    bool jump = primed_ && config_.max_step > 0 &&
+                std::fabs(sample.raw - smoothed_) > config_.max_step;
+
+    if (jump && rejects_ < config_.max_rejects) {
+        // Keep the previous value, it is less likely to be wrong
+        rejects_++;
+        return Reading{.raw = (uint32_t)std::lround(smoothed_), .confidence = confidence / 2};
+    }
+
+    if (!primed_ || jump) {
+        // Jump that persisted is a real change, e.g. the probe was moved, start over from here
+        smoothed_ = sample.raw;
+        primed_ = true;
+    } else {
+        smoothed_ += config_.alpha * (sample.raw - smoothed_);
+    }
+
+    rejects_ = 0;
+
+    return Reading{.raw = (uint32_t)std::lround(smoothed_), .confidence = confidence};
+}
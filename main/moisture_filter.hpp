@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+/// Turns bursts of raw ADC samples of one probe into readings. A burst is reduced to one value
+/// robust to spikes, e.g. from a relay switching next to the ADC, readings are then smoothed over
+/// time and a reading that jumps further than soil moisture can change is rejected. Each reading
+/// comes with the confidence in it.
+class MoistureFilter {
+ public:
+    static const int MAX_SAMPLES = 64;
+
+    enum class Reducer {
+        Median,
+        // Mean of the middle half of the samples
+        TrimmedMean,
+    };
+
+    struct Config {
+        Reducer reducer;
+        // Raw conversions per reading
+        int samples;
+        // Weight of the new reading in the smoothed value, 1 turns smoothing off
+        float alpha;
+        // Largest believable change between readings in raw counts, 0 turns rejection off
+        int max_step;
+        // Readings rejected in a row, after that the change is taken as real
+        int max_rejects;
+    };
+
+    /// Burst of samples reduced to one value
+    struct Sample {
+        uint16_t raw;
+        // Interquartile range of the burst
+        uint16_t spread;
+    };
+
+    struct Reading {
+        uint32_t raw;
+        // From 0 to 1, 0 if the probe looks disconnected
+        float confidence;
+    };
+
+    /// Sets the configuration and forgets the readings so far
+    void configure(const Config& config) {
+        config_ = config;
+        primed_ = false;
+        rejects_ = 0;
+    }
+
+    int samples() const {
+        return config_.samples;
+    }
+
+    /// Sorts samples in place
+    Sample reduce(uint16_t* samples, int count) const;
+
+    /// Smooths the sample with the readings before it
+    Reading update(const Sample& sample);
+
+ private:
+    static const int ADC_MAX = 4095;
+    // Input stuck at a rail, nothing is connected or the wire is shorted
+    static const int RAIL_MARGIN = 16;
+    // Spread of a burst at which it is all noise
+    static constexpr int MAX_SPREAD = 200;
+
+    Config config_ = {};
+
+    bool primed_ = false;
+    float smoothed_ = 0;
+    int rejects_ = 0;
+};
@@ -1,12 +1,14 @@
 #include "moisture_service.hpp"
 
-#include <driver/adc.h>
 #include <driver/gpio.h>
-#include <esp_adc_cal.h>
+#include <esp_timer.h>
+#include <nvs.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
 
 #include <esp_log.h>
@@ -15,133 +17,347 @@
 
 static const char *TAG = "Moisture";
 
+static const char *NVS_NAMESPACE = "moisture";
+static const char *NVS_CALIBRATION = "calibration";
+
 // Prints status of sensors periodically
 // #define TESTING 1
 
-static void print_char_val_type(esp_adc_cal_value_t val_type) {
-    if (val_type == ESP_ADC_CAL_VAL_EFUSE_TP) {
-        ESP_LOGD(TAG, "Characterized using Two Point Value\n");
-    } else if (val_type == ESP_ADC_CAL_VAL_EFUSE_VREF) {
-        ESP_LOGD(TAG, "Characterized using eFuse Vref\n");
-    } else {
-        ESP_LOGD(TAG, "Characterized using Default Vref\n");
+static bool moisture_changed(float previous, float current) {
+    // NaN marks reading out of range
+    if (std::isnan(previous) || std::isnan(current)) {
+        return std::isnan(previous) != std::isnan(current);
     }
+
+    return std::fabs(previous - current) >= 0.01f;
 }
 
-Moisture::Moisture(SockPtr requestor, SockPtr web)
-    : _adc_chars((esp_adc_cal_characteristics_t *)calloc(1, sizeof(esp_adc_cal_characteristics_t))),
-      width_(ADC_WIDTH_BIT_12),
-      atten_(ADC_ATTEN_DB_11),
+Moisture::Moisture(Reactor &reactor, EventBus &events, SockPtr requestor, SockPtr web)
+    : ServiceBase(reactor, events),
+      internal_(CHANNELS, INTERNAL_PROBES),
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+      external_(I2C_NUM_0, CONFIG_GARDEN_MOISTURE_ADS1115_COUNT),
+#endif
+      banks_{{
+          {&internal_, 0, &FILTER, DEFAULT_CALIBRATION},
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+          {&external_, INTERNAL_PROBES, &EXTERNAL_FILTER, EXTERNAL_CALIBRATION},
+#endif
+      }},
       requestor_(std::move(requestor)),
       web_(std::move(web)) {
-    xQueueAddToSet(requestor_->get_rx(), queues_);
-    xQueueAddToSet(web_->get_rx(), queues_);
+    counters_.channels_count = CHANNELS_SIZE;
+
+    for (int section = 0; section < CHANNELS_SIZE; section++) {
+        filters_[section].configure(*bank_of(section).filter);
+    }
+
+    reactor_.listen(*requestor_, Lane::Control, "watering");
+    reactor_.on(*requestor_, Message::Type::MoistureReq, [this](const Message &msg) {
+        on_moisture_req(msg);
+    });
+    reactor_.on(*requestor_, Message::Type::MoistureWarmUp, [this](const Message &msg) {
+        on_warm_up(msg);
+    });
+
+    reactor_.listen(*web_, Lane::Web, "web");
+    reactor_.on(*web_, Message::Type::Status, [this](const Message &msg) {
+        ESP_LOGI(TAG, "Status request from the web");
+        Message resp = {};
+        resp.type = Message::Type::Status;
+        resp.seq = msg.seq;
+        resp.moisture_status = get_status();
+
+        web_->send(resp);
+    });
+
+    reactor_.on(*web_, Message::Type::Calibrate, [this](const Message &msg) {
+        on_calibrate(msg);
+    });
+
+    settle_timer_ = reactor_.add_timer("settle", SETTLE_TIME, false, [this] { on_settled(); });
+    warm_up_timer_ = reactor_.add_timer("warm_up", SETTLE_TIME, false, [this] { power_up(); });
+    cycle_warm_up_timer_ =
+        reactor_.add_timer("cycle_warm_up", SETTLE_TIME, false, [this] { power_up(); });
+
+    // Web is served from the cache, it never triggers ADC reads
+    auto refresh = reactor_.add_timer("refresh", REFRESH_PERIOD, true, [this] { power_up(); });
+    reactor_.start_timer(refresh);
+
+#if TESTING
+    auto monitor = reactor_.add_timer("status", pdMS_TO_TICKS(1000), true, [this] {
+        auto status = get_status();
+
+        for (int section = 0; section < status.channels_count; section++) {
+            const auto& channel = status.channels[section];
+            ESP_LOGD(TAG,
+                     "Section: %d raw: %u Voltage: %umV moisture %f",
+                     section,
+                     channel.raw,
+                     channel.voltage,
+                     channel.moisture);
+        }
+    });
+    reactor_.start_timer(monitor);
+#endif
 }
 
-void Moisture::run_service() {
+void Moisture::start() {
     ESP_LOGI(TAG, "Service started");
 
-    for (auto channel : CHANNELS) {
-        ESP_ERROR_CHECK(adc1_config_channel_atten(channel, atten_));
+    setup_power();
+    ESP_ERROR_CHECK(internal_.init());
+
+    // Missing external ADC is not fatal, its probes read as disconnected
+    for (const auto& bank : banks_) {
+        if (bank.backend != &internal_ && bank.backend->init() != ESP_OK) {
+            ESP_LOGE(TAG, "Probes from %d on are not available", bank.first);
+        }
     }
 
-    // Characterize ADC
-    esp_adc_cal_value_t val_type =
-        esp_adc_cal_characterize(ADC_UNIT_1, atten_, width_, DEFAULT_VREF, _adc_chars);
-    print_char_val_type(val_type);
+    load_calibration();
 
-#if TESTING
-    int interval = 1000;
-#else
-    int interval = -1;
-#endif
+    for (int section = 0; section < CHANNELS_SIZE; section++) {
+        build_moisture_lut(section);
+    }
+
+    power_up();
+}
+
+const Moisture::Bank& Moisture::bank_of(int section) const {
+    int bank = BANKS - 1;
+    while (banks_[bank].first > section) {
+        bank--;
+    }
+
+    return banks_[bank];
+}
+
+void Moisture::refresh() {
+    for (const auto& bank : banks_) {
+        int count = bank.filter->samples;
+        bank.backend->sweep(samples_.data(), count);
+
+        for (int probe = 0; probe < bank.backend->probes(); probe++) {
+            int section = bank.first + probe;
+            auto& filter = filters_[section];
+            auto reading = filter.update(filter.reduce(&samples_[probe * count], count));
+
+            counters_.reads[section]++;
+            update_reading(section, convert(section, reading.raw, reading.confidence));
+        }
+    }
+}
+
+void Moisture::on_moisture_req(const Message &msg) {
+    ESP_LOGD(TAG, "Got moisture req for channel %d", msg.section);
+    int section = msg.section;
+
+    if (section < 0 || section >= MAX_CHANNELS) {
+        ESP_LOGE(TAG, "No channel %d", section);
+        return;
+    }
+
+    // Section without a probe reads NaN
+    if (section >= CHANNELS_SIZE) {
+        reply_moisture(1u << section);
+        return;
+    }
+
+    // Watering decides on a fresh reading, prepared ahead if it announced the read
+    if (swept_at_ && xTaskGetTickCount() - *swept_at_ <= MAX_READING_AGE) {
+        reply_moisture(1u << section);
+        return;
+    }
+
+    pending_ |= 1u << section;
+    power_up();
+}
+
+void Moisture::on_warm_up(const Message &msg) {
+    time_t now;
+    time(&now);
+
+    // Sweep is done by the time the read comes
+    auto until_read = Reactor::ms_to_ticks(std::max<int64_t>(msg.read_at - now, 0) * 1000);
+    ESP_LOGD(TAG, "Read expected in %u ticks", (unsigned)until_read);
+
+    auto timer = msg.cycle ? cycle_warm_up_timer_ : warm_up_timer_;
+
+    if (until_read <= SETTLE_TIME) {
+        reactor_.stop_timer(timer);
+        power_up();
+    } else {
+        reactor_.start_timer(timer, until_read - SETTLE_TIME);
+    }
+}
 
-    while (1) {
-        QueueSetMemberHandle_t active_member =
-            xQueueSelectFromSet(queues_, pdMS_TO_TICKS(interval));
-
-        if (active_member == requestor_->get_rx()) {
-            if (auto data = requestor_->rcv(0)) {
-                auto msg = *data;
-                switch (msg.type) {
-                    case Message::Type::MoistureReq: {
-                        ESP_LOGD(TAG, "Got moisture req for channel %d", msg.section);
-
-                        ChannelReading reading = {};
-                        if (msg.section < CHANNELS_SIZE) {
-                            reading = read_channel(CHANNELS[msg.section]);
-                        }
-
-                        float moisture = calc_moisture(reading.raw);
-
-                        ESP_LOGD(TAG,
-                                 "Channel %d raw: %d\tVoltage: %dmV moisture %f%%",
-                                 msg.section,
-                                 reading.raw,
-                                 reading.voltage,
-                                 moisture);
-
-                        auto resp = Message{};
-                        resp.type = Message::Type::MoistureRes;
-                        resp.section_r = msg.section;
-                        resp.moisture = moisture;
-
-                        requestor_->send(resp);
-                        break;
-                    }
-
-                    default:
-                        break;
-                }
-            }
-
-        } else if (active_member == web_->get_rx()) {
-            if (auto data = web_->rcv(0)) {
-                auto msg = *data;
-
-                switch (msg.type) {
-                    case Message::Type::Status: {
-                        ESP_LOGI(TAG, "Status request from the web");
-                        Message resp = {};
-                        resp.type = Message::Type::Status;
-                        resp.status = get_status().release();
-
-                        web_->send(resp);
-                    }
-                    default:
-                        break;
-                }
-            }
-
-        } else {
-            ESP_LOGD(TAG, "%s", get_status().get());
+void Moisture::on_calibrate(const Message &msg) {
+    // Capture needs the probes powered, done by the sweep
+    if (POWER_GATING && msg.calibration_request.raw < 0) {
+        if (pending_calibration_) {
+            Message resp = {};
+            resp.type = Message::Type::Calibrate;
+            resp.seq = msg.seq;
+            resp.calibration_result = CalibrationResult{
+                .error = "calibration in progress", .channel = msg.calibration_request.channel};
+
+            web_->send(resp);
+            return;
         }
+
+        pending_calibration_ = msg;
+        power_up();
+        return;
+    }
+
+    Message resp = {};
+    resp.type = Message::Type::Calibrate;
+    resp.seq = msg.seq;
+    resp.calibration_result = calibrate(msg.calibration_request);
+
+    web_->send(resp);
+}
+
+void Moisture::reply_moisture(uint32_t sections) {
+    auto resp = Message{};
+    resp.type = Message::Type::MoistureRes;
+    resp.sections = sections;
+
+    for (int section = 0; section < MAX_CHANNELS; section++) {
+        if (!(sections & (1u << section))) {
+            continue;
+        }
+
+        ChannelStatus reading = {};
+        reading.moisture = nanf("");
+
+        if (section < CHANNELS_SIZE) {
+            reading = readings_[section];
+        }
+
+        ESP_LOGD(TAG,
+                 "Channel %d raw: %" PRIu32 "\tVoltage: %" PRIu32 "mV moisture %f%%",
+                 section,
+                 reading.raw,
+                 reading.voltage,
+                 reading.moisture);
+
+        resp.moisture[section] = reading.moisture;
+    }
+
+    requestor_->send(resp);
+}
+
+gpio_num_t Moisture::power_pin(int section) const {
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+    if (section >= INTERNAL_PROBES) {
+        return EXTERNAL_POWER_PINS[(section - INTERNAL_PROBES) / Ads1115Bank::CHANNELS];
+    }
+#endif
+
+    return POWER_PINS[section];
+}
+
+void Moisture::setup_power() {
+    if (!POWER_GATING) {
+        return;
+    }
+
+    gpio_config_t io_conf = {};
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+
+    for (int section = 0; section < CHANNELS_SIZE; section++) {
+        io_conf.pin_bit_mask |= 1ULL << power_pin(section);
+    }
+
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+    set_power(false);
+}
+
+void Moisture::set_power(bool on) {
+    if (!POWER_GATING) {
+        return;
+    }
+
+    // Shared switches are set more than once, harmless
+    for (int section = 0; section < CHANNELS_SIZE; section++) {
+        gpio_set_level(power_pin(section), on ? 1 : 0);
     }
 }
 
-Moisture::ChannelReading Moisture::read_channel(adc1_channel_t channel) {
-    uint32_t adc_reading = 0;
-    for (int i = 0; i < NO_OF_SAMPLES; i++) {
-        adc_reading += adc1_get_raw(channel);
+/// Opens a powered window, all probes are swept in it at once. Does nothing if one is open.
+void Moisture::power_up() {
+    if (powered_) {
+        return;
     }
 
-    adc_reading /= NO_OF_SAMPLES;
-    // Convert adc_reading to voltage in mV
-    uint32_t voltage = esp_adc_cal_raw_to_voltage(adc_reading, _adc_chars);
+    set_power(true);
+    powered_ = true;
+    reactor_.start_timer(settle_timer_);
+}
+
+void Moisture::on_settled() {
+    refresh();
 
-    return ChannelReading{.raw = adc_reading, .voltage = voltage};
+    if (pending_calibration_) {
+        Message resp = {};
+        resp.type = Message::Type::Calibrate;
+        resp.seq = pending_calibration_->seq;
+        resp.calibration_result = calibrate(pending_calibration_->calibration_request);
+        pending_calibration_.reset();
+
+        web_->send(resp);
+    }
+
+    set_power(false);
+    powered_ = false;
+    swept_at_ = xTaskGetTickCount();
+
+    // One reply for all, Watering drains its queue only after this handler returns
+    if (pending_) {
+        reply_moisture(pending_);
+    }
+
+    pending_ = 0;
 }
 
-float Moisture::calc_moisture(int adc_raw) {
-    static const int AIR_DRY = 2590;
-    static const int SOAKED_SOIL = 1200;
+MoistureFilter::Sample Moisture::sample(int section) {
+    const auto& bank = bank_of(section);
+    auto& filter = filters_[section];
+
+    bank.backend->read(section - bank.first, samples_.data(), filter.samples());
+    counters_.reads[section]++;
+
+    return filter.reduce(samples_.data(), filter.samples());
+}
+
+ChannelStatus Moisture::convert(int section, uint32_t raw, float confidence) const {
+    auto moisture = moisture_lut_[section][raw >> LUT_SHIFT];
+    bool valid = moisture != MOISTURE_INVALID && confidence >= MIN_CONFIDENCE;
+
+    return ChannelStatus{
+        .raw = raw,
+        .voltage = bank_of(section).backend->millivolts(raw),
+        .moisture = valid ? (float)moisture / MOISTURE_SCALE : nanf(""),
+        .confidence = confidence,
+        .calibration = calibration_[section],
+    };
+}
 
-    if (adc_raw < SOAKED_SOIL * 0.8f || adc_raw > AIR_DRY * 1.2f) {
+float Moisture::calc_moisture(int adc_raw, const ChannelCalibration& calibration) {
+    int low = std::min(calibration.dry_raw, calibration.wet_raw);
+    int high = std::max(calibration.dry_raw, calibration.wet_raw);
+
+    if (adc_raw < low * 0.8f || adc_raw > high * 1.2f) {
         return nanf("");
     }
 
-    float denominator = (AIR_DRY - SOAKED_SOIL);
-    float res = (adc_raw - SOAKED_SOIL) / denominator;
+    float denominator = calibration.dry_raw - calibration.wet_raw;
+    float res = (adc_raw - calibration.wet_raw) / denominator;
 
     // consider readings outside the range, but reasonable skewed as valid
     res = 1.0f - std::max(std::min(res, 1.0f), 0.0f);
@@ -149,24 +365,155 @@ float Moisture::calc_moisture(int adc_raw) {
     return res;
 }
 
-std::unique_ptr<char[]> Moisture::get_status() {
-    std::string tmp = "MOISTURE\n";
+bool Moisture::calibration_valid(const ChannelCalibration& calibration) {
+    return calibration.dry_raw < ADC_RANGE && calibration.wet_raw < ADC_RANGE &&
+           std::abs(calibration.dry_raw - calibration.wet_raw) >= MIN_CALIBRATION_SPAN;
+}
+
+void Moisture::build_moisture_lut(int section) {
+    auto& lut = moisture_lut_[section];
+
+    for (int i = 0; i < LUT_SIZE; i++) {
+        // Middle of the range the entry covers
+        int raw = (i << LUT_SHIFT) + (1 << LUT_SHIFT) / 2;
+        float moisture = calc_moisture(raw, calibration_[section]);
+
+        lut[i] = std::isnan(moisture) ? MOISTURE_INVALID
+                                        : (uint16_t)std::lround(moisture * MOISTURE_SCALE);
+    }
+}
+
+void Moisture::load_calibration() {
+    for (int section = 0; section < CHANNELS_SIZE; section++) {
+        calibration_[section] = bank_of(section).default_calibration;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        ESP_LOGI(TAG, "No calibration stored, using defaults");
+        return;
+    }
+
+    decltype(calibration_) stored = {};
+    size_t size = sizeof(stored);
+    auto err = nvs_get_blob(nvs, NVS_CALIBRATION, stored.data(), &size);
+    nvs_close(nvs);
+
+    // Size changes with the number of channels, calibration of other probes is no good
+    if (err != ESP_OK || size != sizeof(stored)) {
+        ESP_LOGI(TAG, "No usable calibration stored, using defaults");
+        return;
+    }
 
     for (int section = 0; section < CHANNELS_SIZE; section++) {
-        auto channel = CHANNELS[section];
+        if (calibration_valid(stored[section])) {
+            calibration_[section] = stored[section];
+        }
+
+        ESP_LOGI(TAG,
+                 "Channel %d calibration dry %u wet %u",
+                 section,
+                 calibration_[section].dry_raw,
+                 calibration_[section].wet_raw);
+    }
+}
+
+void Moisture::save_calibration() {
+    nvs_handle_t nvs;
+    auto err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, NVS_CALIBRATION, calibration_.data(), sizeof(calibration_));
+
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+
+        nvs_close(nvs);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store calibration: %s", esp_err_to_name(err));
+    }
+}
 
-        auto reading = read_channel(channel);
-        float moisture = calc_moisture(reading.raw);
+CalibrationResult Moisture::calibrate(const CalibrationRequest& request) {
+    auto res = CalibrationResult{.error = nullptr, .channel = request.channel};
 
-        // Bring that goddam std::format finally!
-        tmp += std::string("Section: ") + std::to_string(section) +
-               " raw: " + std::to_string(reading.raw) +
-               " Voltage: " + std::to_string(reading.voltage) + "mV moisture " +
-               std::to_string(moisture) + "%\n";
+    if (request.channel < 0 || request.channel >= CHANNELS_SIZE) {
+        res.error = "unknown channel";
+        return res;
     }
 
-    char *res = nullptr;
-    asprintf(&res, "%s", tmp.c_str());
+    int section = request.channel;
+    // Probe is being moved in and out of water, filter history does not apply
+    int raw = request.raw < 0 ? sample(section).raw : request.raw;
+
+    auto calibration = calibration_[section];
+    if (request.point == CalibrationRequest::Point::Dry) {
+        calibration.dry_raw = raw;
+    } else {
+        calibration.wet_raw = raw;
+    }
+
+    if (raw >= ADC_RANGE) {
+        res.error = "raw reading out of ADC range";
+    } else if (!calibration_valid(calibration)) {
+        res.error = "dry and wet points too close";
+    }
+
+    if (res.error) {
+        res.calibration = calibration_[section];
+        return res;
+    }
+
+    ESP_LOGI(TAG,
+             "Channel %d calibrated, dry %u wet %u",
+             section,
+             calibration.dry_raw,
+             calibration.wet_raw);
+
+    calibration_[section] = calibration;
+    build_moisture_lut(section);
+    save_calibration();
 
-    return std::unique_ptr<char[]>(res);
-}
\ No newline at end of file
+    // Range is part of the status, so is the moisture it gives
+    status_version_.bump();
+    const auto& cached = readings_[section];
+    update_reading(section, convert(section, cached.raw, cached.confidence));
+
+    res.calibration = calibration;
+    return res;
+}
+
+void Moisture::update_reading(int section, const ChannelStatus& reading) {
+    auto& cached = readings_[section];
+    float moisture = reading.moisture;
+
+    // Raw value jitters all the time, only a change in moisture is worth a new version
+    if (moisture_changed(cached.moisture, moisture)) {
+        status_version_.bump();
+
+        auto event = Event{.type = Event::Type::Moisture, .time_us = esp_timer_get_time()};
+        event.moisture.section = section;
+        event.moisture.moisture = moisture;
+
+        events_.publish(event);
+    }
+
+    cached = reading;
+}
+
+MoistureStatus Moisture::get_status() {
+    MoistureStatus res = {};
+    res.channels_count = CHANNELS_SIZE;
+
+    for (int section = 0; section < CHANNELS_SIZE; section++) {
+        res.channels[section] = readings_[section];
+    }
+
+    res.sockets.add(requestor_->status("watering"));
+    res.sockets.add(web_->status("web"));
+
+    return res;
+}
@@ -1,14 +1,22 @@
 #pragma once
 #include "freertos/FreeRTOS.h"
 #include "service_base.hpp"
+#include "internal_adc.hpp"
+#include "moisture_filter.hpp"
+#include "service_counters.hpp"
 #include "socket.hpp"
 
+#include <array>
 #include <cstdint>
 #include <memory>
-#include <driver/adc.h>
-#include <esp_adc_cal.h>
+#include <optional>
+#include <driver/gpio.h>
 #include <freertos/queue.h>
 
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+#include "ads1115.hpp"
+#endif
+
 struct MoistureMessage {
     float moisture;
     int channel;
@@ -16,32 +24,169 @@ struct MoistureMessage {
 
 class Moisture : public ServiceBase {
  public:
-    Moisture(SockPtr requestor, SockPtr web);
-    void run_service();
+    Moisture(Reactor &reactor, EventBus &events, SockPtr requestor, SockPtr web);
+    void start() override;
+
+    const MoistureCounters& counters() const {
+        return counters_;
+    }
 
-    // TODO: add fourth for terrace?
-    static const int CHANNELS_SIZE = 3;
+    static const int INTERNAL_PROBES = 3;
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+    static const int EXTERNAL_PROBES = Ads1115Bank::CHANNELS * CONFIG_GARDEN_MOISTURE_ADS1115_COUNT;
+#else
+    static const int EXTERNAL_PROBES = 0;
+#endif
+    // Probes on external ADCs follow the internal ones, section N reads probe N
+    static const int CHANNELS_SIZE = INTERNAL_PROBES + EXTERNAL_PROBES;
+    static_assert(CHANNELS_SIZE <= MAX_CHANNELS);
  private:
-    static const int DEFAULT_VREF = 1100;  // Use adc2_vref_to_gpio() to obtain a better estimate
-    static const int NO_OF_SAMPLES = 64;   // Multisampling
+#if CONFIG_GARDEN_MOISTURE_POWER_GATING
+    static constexpr bool POWER_GATING = true;
+    static constexpr TickType_t SETTLE_TIME = pdMS_TO_TICKS(CONFIG_GARDEN_MOISTURE_SETTLE_MS);
+#else
+    static constexpr bool POWER_GATING = false;
+    static constexpr TickType_t SETTLE_TIME = 0;
+#endif
+
+    // Soil dries slowly, probes that are powered for each refresh are refreshed less often
+    static constexpr TickType_t REFRESH_PERIOD = pdMS_TO_TICKS((POWER_GATING ? 60 : 10) * 1000);
+    // Request this soon after a sweep is served from it, probes stay off
+    static constexpr TickType_t MAX_READING_AGE = pdMS_TO_TICKS(5 * 1000);
 
-    static constexpr adc1_channel_t CHANNELS[CHANNELS_SIZE] = {
-                                                               (adc1_channel_t)ADC_CHANNEL_7 /* TBD but currently occupies VEGS*/,
-                                                               (adc1_channel_t)ADC_CHANNEL_6 /* FLOWERS*/,
-                                                               (adc1_channel_t)ADC_CHANNEL_4};
+    // Readings of all backends are 12 bit
+    static const int ADC_RANGE = 4096;
+    // Moisture table has an entry per 4 counts, probes do not resolve finer moisture than that
+    // and the tables of 16+ probes have to fit in RAM
+    static const int LUT_SHIFT = 2;
+    static const int LUT_SIZE = ADC_RANGE >> LUT_SHIFT;
+    // Moisture in the table is in hundredths of a percent
+    static const uint16_t MOISTURE_SCALE = 10000;
+    static const uint16_t MOISTURE_INVALID = UINT16_MAX;
+    // Probes differ, these fit the first one and are used until a probe is calibrated
+    static constexpr ChannelCalibration DEFAULT_CALIBRATION = {.dry_raw = 2590, .wet_raw = 1200};
+    // Closer points make moisture meaningless, most likely the probe was not moved
+    static const int MIN_CALIBRATION_SPAN = 200;
+    // Reading trusted less than that does not give moisture
+    static constexpr float MIN_CONFIDENCE = 0.2f;
+
+    static_assert(CONFIG_GARDEN_MOISTURE_SAMPLES <= MoistureFilter::MAX_SAMPLES);
+
+    // Same for all internal probes, each channel has its own filter
+    static constexpr MoistureFilter::Config FILTER = {
+#if CONFIG_GARDEN_MOISTURE_MEDIAN
+        .reducer = MoistureFilter::Reducer::Median,
+#else
+        .reducer = MoistureFilter::Reducer::TrimmedMean,
+#endif
+        .samples = CONFIG_GARDEN_MOISTURE_SAMPLES,
+        .alpha = CONFIG_GARDEN_MOISTURE_SMOOTHING / 100.0f,
+        .max_step = CONFIG_GARDEN_MOISTURE_MAX_STEP,
+        .max_rejects = 2,
+    };
 
-    struct ChannelReading {
-        uint32_t raw;
-        uint32_t voltage;
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+    // External ADC is quiet, a short burst is enough and keeps the per-probe cost low
+    static constexpr MoistureFilter::Config EXTERNAL_FILTER = {
+        .reducer = MoistureFilter::Reducer::Median,
+        .samples = 4,
+        .alpha = FILTER.alpha,
+        .max_step = FILTER.max_step,
+        .max_rejects = FILTER.max_rejects,
     };
+    // Readings of external probes are in mV, same probe as the first internal one
+    static constexpr ChannelCalibration EXTERNAL_CALIBRATION = {.dry_raw = 2250,
+                                                                .wet_raw = 1100};
+#endif
+
+    static constexpr adc_channel_t CHANNELS[INTERNAL_PROBES] = {
+                                                               ADC_CHANNEL_7 /* TBD but currently occupies VEGS*/,
+                                                               ADC_CHANNEL_6 /* FLOWERS*/,
+                                                               ADC_CHANNEL_4};
+
+    // Power enable of each internal probe, high powers the probe
+    static constexpr gpio_num_t POWER_PINS[INTERNAL_PROBES] = {
+        (gpio_num_t)25, (gpio_num_t)13, (gpio_num_t)4};
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+    // Probes of an external ADC share its power switch
+    static constexpr gpio_num_t EXTERNAL_POWER_PINS[Ads1115Bank::MAX_DEVICES] = {
+        (gpio_num_t)23, (gpio_num_t)19, (gpio_num_t)18, (gpio_num_t)5};
+#endif
+
+    /// Converter of a group of consecutive probes
+    struct Bank {
+        ProbeBackend* backend;
+        int first;
+        const MoistureFilter::Config* filter;
+        ChannelCalibration default_calibration;
+    };
+
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+    static const int BANKS = 2;
+#else
+    static const int BANKS = 1;
+#endif
+
+    void on_moisture_req(const Message &msg);
+    void on_warm_up(const Message &msg);
+    void on_calibrate(const Message &msg);
+    // Single MoistureRes with the reading of each section in the mask
+    void reply_moisture(uint32_t sections);
+
+    gpio_num_t power_pin(int section) const;
+    void setup_power();
+    void set_power(bool on);
+    void power_up();
+    void on_settled();
+
+    const Bank& bank_of(int section) const;
+    void refresh();
+
+    MoistureFilter::Sample sample(int section);
+    ChannelStatus convert(int section, uint32_t raw, float confidence) const;
+    void update_reading(int section, const ChannelStatus& reading);
+
+    static float calc_moisture(int adc_raw, const ChannelCalibration& calibration);
+    static bool calibration_valid(const ChannelCalibration& calibration);
+    void build_moisture_lut(int section);
+    void load_calibration();
+    void save_calibration();
+    CalibrationResult calibrate(const CalibrationRequest& request);
+
+    MoistureStatus get_status();
+
+    InternalAdc internal_;
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+    Ads1115Bank external_;
+#endif
+    std::array<Bank, BANKS> banks_;
+
+    TimerId settle_timer_;
+    TimerId warm_up_timer_;
+    TimerId cycle_warm_up_timer_;
+    // Probes are on, sweep follows when they settle
+    bool powered_ = false;
+    // Bit per section Watering waits for, answered by the sweep
+    uint32_t pending_ = 0;
+    static_assert(CHANNELS_SIZE <= 32);
+    // Calibration capture waiting for the probes to settle
+    std::optional<Message> pending_calibration_;
+    // Ticks of the last sweep, if there was any
+    std::optional<TickType_t> swept_at_;
+
+    // Samples of a whole bank sweep, too big for the reactor stack
+    std::array<uint16_t, CHANNELS_SIZE * MoistureFilter::MAX_SAMPLES> samples_ = {};
+
+    // Last reading of each channel, status is served from here
+    std::array<ChannelStatus, CHANNELS_SIZE> readings_ = {};
 
-    ChannelReading read_channel(adc1_channel_t channel);
-    float calc_moisture(int adc_raw);
+    std::array<ChannelCalibration, CHANNELS_SIZE> calibration_ = {};
+    std::array<MoistureFilter, CHANNELS_SIZE> filters_ = {};
 
-    std::unique_ptr<char[]> get_status();
-    esp_adc_cal_characteristics_t *_adc_chars;
-    adc_bits_width_t width_;
-    adc_atten_t atten_;
+    // Built at start, raw reading is converted with a single load. Voltage is converted by the
+    // backend.
+    std::array<std::array<uint16_t, LUT_SIZE>, CHANNELS_SIZE> moisture_lut_ = {};
+    MoistureCounters counters_;
 
     SockPtr requestor_;
     SockPtr web_;
@@ -0,0 +1,50 @@
+#include "pcnt_flow_meter.hpp"
+
+#include <esp_check.h>
+#include <esp_log.h>
+
+static const char* TAG = "PcntFlowMeter";
+
+esp_err_t PcntFlowMeter::init() {
+    pcnt_unit_config_t unit_config = {};
+    unit_config.low_limit = -1;
+    unit_config.high_limit = HIGH_LIMIT;
+    // Overflow at the limit is added to the count reported
+    unit_config.flags.accum_count = true;
+    ESP_RETURN_ON_ERROR(pcnt_new_unit(&unit_config, &unit_), TAG, "Failed to create unit");
+
+    pcnt_glitch_filter_config_t filter_config = {};
+    filter_config.max_glitch_ns = MAX_GLITCH_NS;
+    ESP_RETURN_ON_ERROR(
+        pcnt_unit_set_glitch_filter(unit_, &filter_config), TAG, "Failed to set glitch filter");
+
+    pcnt_chan_config_t channel_config = {};
+    channel_config.edge_gpio_num = gpio_;
+    channel_config.level_gpio_num = -1;
+    ESP_RETURN_ON_ERROR(
+        pcnt_new_channel(unit_, &channel_config, &channel_), TAG, "Failed to create channel");
+
+    // Rising edges count, falling ones are ignored
+    ESP_RETURN_ON_ERROR(pcnt_channel_set_edge_action(channel_,
+                                                     PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+                                                     PCNT_CHANNEL_EDGE_ACTION_HOLD),
+                        TAG,
+                        "Failed to set edge action");
+    ESP_RETURN_ON_ERROR(
+        pcnt_unit_add_watch_point(unit_, HIGH_LIMIT), TAG, "Failed to add watch point");
+
+    ESP_RETURN_ON_ERROR(pcnt_unit_enable(unit_), TAG, "Failed to enable unit");
+    ESP_RETURN_ON_ERROR(pcnt_unit_clear_count(unit_), TAG, "Failed to clear count");
+    ESP_RETURN_ON_ERROR(pcnt_unit_start(unit_), TAG, "Failed to start unit");
+
+    ESP_LOGI(TAG, "Counting flow meter pulses on GPIO %d", gpio_);
+
+    return ESP_OK;
+}
+
+uint32_t PcntFlowMeter::pulses() {
+    int count = 0;
+    pcnt_unit_get_count(unit_, &count);
+
+    return (uint32_t)count;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "flow_meter.hpp"
+
+#include <driver/gpio.h>
+#include <driver/pulse_cnt.h>
+
+/// Meter pulses counted by the PCNT peripheral, no CPU time per pulse. Counter is 16 bit, the
+/// driver adds up its overflows.
+class PcntFlowMeter : public FlowMeter {
+ public:
+    explicit PcntFlowMeter(gpio_num_t gpio) : gpio_(gpio) {
+    }
+
+    esp_err_t init() override;
+    uint32_t pulses() override;
+
+ private:
+    static const int HIGH_LIMIT = 32767;
+    // Meters give pulses of a few ms, shorter ones are noise on the wire
+    static const uint32_t MAX_GLITCH_NS = 1000;
+
+    gpio_num_t gpio_;
+    pcnt_unit_handle_t unit_ = nullptr;
+    pcnt_channel_handle_t channel_ = nullptr;
+};
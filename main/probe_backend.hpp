@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#include <esp_err.h>
+
+/// Source of raw moisture probe readings. Samples are scaled to 12 bits whatever the converter,
+/// so calibration and lookup tables work the same for all probes. Sample of a failed conversion
+/// is 0, which the filter takes for a disconnected probe.
+class ProbeBackend {
+ public:
+    virtual ~ProbeBackend() = default;
+
+    /// Hardware setup, called from Moisture::start
+    virtual esp_err_t init() = 0;
+
+    virtual int probes() const = 0;
+
+    /// Takes count samples of one probe
+    virtual void read(int probe, uint16_t* samples, int count) = 0;
+
+    /// Takes count samples of every probe, samples of probe p start at samples + p * count.
+    /// Backends that convert on several probes at once do it faster than probe by probe.
+    virtual void sweep(uint16_t* samples, int count) {
+        for (int probe = 0; probe < probes(); probe++) {
+            read(probe, samples + probe * count, count);
+        }
+    }
+
+    virtual uint32_t millivolts(uint16_t raw) const = 0;
+};
@@ -0,0 +1,53 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+
+RateLimiter::Bucket& RateLimiter::find(const Address& client, int64_t now_us) {
+    Bucket* oldest = &buckets_[0];
+
+    for (auto& bucket : buckets_) {
+        if (bucket.used && bucket.client == client) {
+            return bucket;
+        }
+
+        if (!bucket.used || (oldest->used && bucket.updated_us < oldest->updated_us)) {
+            oldest = &bucket;
+        }
+    }
+
+    // Evicted client starts with a full bucket when it comes back, with a table bigger than
+    // the number of clients at home it does not happen in practice
+    *oldest = Bucket{
+        .used = true,
+        .client = client,
+        .tokens = limit_.burst * TOKEN,
+        .updated_us = now_us,
+    };
+
+    return *oldest;
+}
+
+uint32_t RateLimiter::acquire(const Address& client, int64_t now_us) {
+    auto& bucket = find(client, now_us);
+
+    int64_t period_us = (int64_t)limit_.period_ms * 1000;
+    int64_t elapsed_us = std::max<int64_t>(now_us - bucket.updated_us, 0);
+    int64_t refill = elapsed_us * TOKEN / period_us;
+
+    if (refill > 0) {
+        bucket.tokens = (uint32_t)std::min<int64_t>(bucket.tokens + refill, limit_.burst * TOKEN);
+        // Time that did not make a whole thousandth yet is not lost
+        bucket.updated_us += refill * period_us / TOKEN;
+    }
+
+    if (bucket.tokens >= TOKEN) {
+        bucket.tokens -= TOKEN;
+        allowed_++;
+        return 0;
+    }
+
+    limited_++;
+
+    int64_t missing_us = (int64_t)(TOKEN - bucket.tokens) * period_us / TOKEN;
+    return (uint32_t)((missing_us + 999999) / 1000000);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/// Token bucket per client address. Client can make a burst of requests, then one per period.
+/// Known clients are kept in a small table, least recently seen one gives way to a new client.
+/// Used on the server task only, just the counters are read elsewhere.
+class RateLimiter {
+ public:
+    using Address = std::array<uint8_t, 16>;
+
+    struct Limit {
+        uint32_t burst;
+        uint32_t period_ms;
+    };
+
+    explicit RateLimiter(Limit limit) : limit_(limit) {
+    }
+
+    /// Takes a token from the client's bucket. Returns 0 if request is allowed, otherwise
+    /// seconds until the next token is available.
+    uint32_t acquire(const Address& client, int64_t now_us);
+
+    uint32_t allowed() const {
+        return allowed_;
+    }
+
+    uint32_t limited() const {
+        return limited_;
+    }
+
+ private:
+    static const size_t MAX_CLIENTS = 8;
+    // Tokens are counted in thousandths, so partial refills are not lost
+    static const uint32_t TOKEN = 1000;
+
+    struct Bucket {
+        bool used;
+        Address client;
+        uint32_t tokens;
+        int64_t updated_us;
+    };
+
+    Bucket& find(const Address& client, int64_t now_us);
+
+    Limit limit_;
+    std::array<Bucket, MAX_CLIENTS> buckets_ = {};
+
+    std::atomic<uint32_t> allowed_{0};
+    std::atomic<uint32_t> limited_{0};
+};
@@ -0,0 +1,396 @@
+#include "reactor.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <utility>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char* TAG = "Reactor";
+
+void Reactor::listen(Socket& socket, Lane lane, const char* name) {
+    auto& member = add_member(socket.get_rx(), lane, socket.depth());
+    member.name = name;
+    member.socket = &socket;
+}
+
+void Reactor::on(Socket& socket, Message::Type type, Handler handler) {
+    auto* member = find_member(socket.get_rx());
+    configASSERT(member && member->socket);
+
+    auto route = add_route(member->name, type);
+    routes_[route].handler = std::move(handler);
+
+    member->routes[(size_t)type] = route;
+}
+
+void Reactor::on_signal(SemaphoreHandle_t semaphore,
+                        Lane lane,
+                        const char* name,
+                        Callback callback) {
+    auto& member = add_member(semaphore, lane, 1);
+    member.name = name;
+
+    auto route = add_route(name, Message::Type::Count);
+    routes_[route].signal = std::move(callback);
+
+    member.signal = route;
+}
+
+Reactor::TimerId Reactor::add_timer(const char* name,
+                                    TickType_t period,
+                                    bool periodic,
+                                    Callback callback) {
+    configASSERT(timers_count_ < MAX_TIMERS);
+
+    auto& timer = timers_[timers_count_];
+    timer.name = name;
+    timer.period = period;
+    timer.periodic = periodic;
+    timer.armed = false;
+    timer.callback = std::move(callback);
+
+    return timers_count_++;
+}
+
+void Reactor::start_timer(TimerId timer) {
+    start_timer(timer, timers_[timer].period);
+}
+
+void Reactor::start_timer(TimerId timer, TickType_t delay) {
+    timers_[timer].deadline = xTaskGetTickCount() + delay;
+    timers_[timer].armed = true;
+}
+
+void Reactor::stop_timer(TimerId timer) {
+    timers_[timer].armed = false;
+}
+
+Reactor::RecvAwaiter Reactor::recv(Socket& socket,
+                                   Message::Type type,
+                                   TickType_t timeout,
+                                   int key) {
+    auto waiter = Waiter{};
+    waiter.socket = &socket;
+    waiter.type = type;
+    waiter.key = key;
+    waiter.timed = timeout != portMAX_DELAY;
+    waiter.deadline = xTaskGetTickCount() + timeout;
+
+    return RecvAwaiter(*this, waiter);
+}
+
+Reactor::SleepAwaiter Reactor::sleep_for(TickType_t ticks) {
+    auto waiter = Waiter{};
+    waiter.timed = true;
+    waiter.deadline = xTaskGetTickCount() + ticks;
+
+    return SleepAwaiter(*this, waiter);
+}
+
+Reactor::SleepAwaiter Reactor::sleep_until(time_t when) {
+    time_t now;
+    time(&now);
+
+    return sleep_for(ms_to_ticks((int64_t)(when - now) * 1000));
+}
+
+TickType_t Reactor::ms_to_ticks(int64_t ms) {
+    // pdMS_TO_TICKS multiplies in TickType_t, which overflows past ~11.9 h at 100 Hz
+    auto ticks = std::max<int64_t>(ms, 0) * configTICK_RATE_HZ / 1000;
+
+    return (TickType_t)std::min<int64_t>(ticks, MAX_WAIT_TICKS);
+}
+
+void Reactor::spawn(Task<> task) {
+    spawned_++;
+    task.detach();
+}
+
+void Reactor::run() {
+    while (1) {
+        if (auto* member = select(next_timeout())) {
+            dispatch(*member);
+        }
+
+        fire_timers();
+    }
+}
+
+void Reactor::write_stats(JsonWriter& json) const {
+    auto write = [&json](const HandlerStats& stats) {
+        json.integer("calls", stats.calls);
+        json.integer("avg_us", stats.total_us / stats.calls);
+        json.integer("max_us", stats.max_us);
+    };
+
+    json.begin_array("handlers");
+    for (size_t i = 0; i < routes_count_; i++) {
+        const auto& route = routes_[i];
+        if (route.stats.calls == 0) {
+            continue;
+        }
+
+        json.begin_object();
+        json.string("source", route.source);
+        json.integer("type", (int)route.type);
+        write(route.stats);
+        json.end_object();
+    }
+    json.end_array();
+
+    json.begin_array("timers");
+    for (size_t i = 0; i < timers_count_; i++) {
+        const auto& timer = timers_[i];
+        if (timer.stats.calls == 0) {
+            continue;
+        }
+
+        json.begin_object();
+        json.string("name", timer.name);
+        write(timer.stats);
+        json.end_object();
+    }
+    json.end_array();
+
+    size_t waiting = 0;
+    for (const auto& waiter : waiters_) {
+        waiting += waiter.handle ? 1 : 0;
+    }
+
+    json.integer("coroutines_spawned", spawned_);
+    json.integer("coroutines_suspended", waiting);
+}
+
+Reactor::Member& Reactor::add_member(QueueSetMemberHandle_t handle, Lane lane, size_t depth) {
+    configASSERT(members_count_ < MAX_MEMBERS);
+
+    // Set holds an entry per queued item, it must not fill up before its members do
+    queued_max_ += depth;
+    configASSERT(queued_max_ <= QUEUE_SET_SIZE);
+
+    xQueueAddToSet(handle, queues_);
+
+    size_t idx = members_count_;
+    while (idx > 0 && members_[idx - 1].lane > lane) {
+        members_[idx] = members_[idx - 1];
+        idx--;
+    }
+
+    auto& member = members_[idx];
+    member = Member{};
+    member.handle = handle;
+    member.lane = lane;
+    member.routes.fill(NO_ROUTE);
+    member.signal = NO_ROUTE;
+
+    members_count_++;
+
+    return member;
+}
+
+Reactor::Member* Reactor::find_member(QueueSetMemberHandle_t handle) {
+    for (size_t i = 0; i < members_count_; i++) {
+        if (members_[i].handle == handle) {
+            return &members_[i];
+        }
+    }
+
+    return nullptr;
+}
+
+int8_t Reactor::add_route(const char* source, Message::Type type) {
+    configASSERT(routes_count_ < MAX_ROUTES);
+
+    auto& route = routes_[routes_count_];
+    route.source = source;
+    route.type = type;
+
+    return routes_count_++;
+}
+
+void Reactor::add_waiter(const Waiter& waiter) {
+    for (auto& slot : waiters_) {
+        if (!slot.handle) {
+            slot = waiter;
+            return;
+        }
+    }
+
+    ESP_LOGE(TAG, "Too many suspended coroutines!");
+    abort();
+}
+
+bool Reactor::resume_waiter(Socket* socket, Message& msg) {
+    for (auto& waiter : waiters_) {
+        if (!waiter.handle || waiter.socket != socket || waiter.type != msg.type) {
+            continue;
+        }
+
+        if (waiter.key != ANY && !matches(msg, waiter.key)) {
+            continue;
+        }
+
+        // Free the slot before resuming, coroutine is likely to await again
+        auto handle = std::exchange(waiter.handle, {});
+        *waiter.result = msg;
+
+        handle.resume();
+
+        return true;
+    }
+
+    return false;
+}
+
+void Reactor::interrupt(Socket& socket, Message::Type type) {
+    for (auto& waiter : waiters_) {
+        if (!waiter.handle || waiter.socket != &socket || waiter.type != type) {
+            continue;
+        }
+
+        // Result stays empty, as on timeout
+        std::exchange(waiter.handle, {}).resume();
+        return;
+    }
+}
+
+/// Queue set is used only as a wakeup, it holds one entry per item posted to any member, each
+/// wakeup serves exactly one item from the highest priority lane, so counts stay in sync even if
+/// items are served out of order.
+Reactor::Member* Reactor::select(TickType_t timeout) {
+    QueueSetMemberHandle_t active_member = xQueueSelectFromSet(queues_, timeout);
+
+    if (active_member == nullptr) {
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < members_count_; i++) {
+        if (uxQueueMessagesWaiting(members_[i].handle) > 0) {
+            return &members_[i];
+        }
+    }
+
+    return find_member(active_member);
+}
+
+TickType_t Reactor::next_timeout() const {
+    TickType_t timeout = portMAX_DELAY;
+    auto now = xTaskGetTickCount();
+
+    for (size_t i = 0; i < timers_count_; i++) {
+        if (!timers_[i].armed) {
+            continue;
+        }
+
+        auto left = (int32_t)(timers_[i].deadline - now);
+        timeout = std::min(timeout, (TickType_t)std::max<int32_t>(left, 0));
+    }
+
+    for (const auto& waiter : waiters_) {
+        if (!waiter.handle || !waiter.timed) {
+            continue;
+        }
+
+        auto left = (int32_t)(waiter.deadline - now);
+        timeout = std::min(timeout, (TickType_t)std::max<int32_t>(left, 0));
+    }
+
+    return timeout;
+}
+
+void Reactor::dispatch(Member& member) {
+    if (member.socket == nullptr) {
+        xSemaphoreTake(member.handle, 0);
+
+        auto& route = routes_[member.signal];
+        measure(route.stats, route.signal);
+
+        return;
+    }
+
+    auto data = member.socket->rcv(0);
+    if (!data) {
+        // Item was already served out of order
+        return;
+    }
+
+    auto& msg = *data;
+    queue_latency_[(size_t)member.lane].record(esp_timer_get_time() - msg.sent_us);
+
+    if (resume_waiter(member.socket, msg)) {
+        return;
+    }
+
+    auto idx = member.routes[(size_t)msg.type];
+
+    if (idx == NO_ROUTE) {
+        ESP_LOGE(TAG, "Unexpected msg %d from %s!", (int)msg.type, member.name);
+
+        return;
+    }
+
+    auto& route = routes_[idx];
+    measure(route.stats, [&] { route.handler(msg); });
+}
+
+void Reactor::fire_timers() {
+    auto now = xTaskGetTickCount();
+
+    for (size_t i = 0; i < timers_count_; i++) {
+        auto& timer = timers_[i];
+
+        if (!timer.armed || (int32_t)(now - timer.deadline) < 0) {
+            continue;
+        }
+
+        if (timer.periodic) {
+            timer.deadline += timer.period;
+
+            // Do not try to catch up missed periods
+            if ((int32_t)(now - timer.deadline) >= 0) {
+                timer.deadline = now + timer.period;
+            }
+        } else {
+            timer.armed = false;
+        }
+
+        // Callback is free to rearm or stop the timer
+        measure(timer.stats, timer.callback);
+    }
+
+    for (auto& waiter : waiters_) {
+        if (!waiter.handle || !waiter.timed || (int32_t)(now - waiter.deadline) < 0) {
+            continue;
+        }
+
+        // Result, if any, stays empty
+        std::exchange(waiter.handle, {}).resume();
+    }
+}
+
+bool Reactor::matches(const Message& msg, int key) {
+    switch (msg.type) {
+        case Message::Type::MoistureRes:
+            return key >= 0 && key < 32 && (msg.sections & (1u << key));
+
+        default:
+            return true;
+    }
+}
+
+template <typename F>
+void Reactor::measure(HandlerStats& stats, F&& call) {
+    auto start = esp_timer_get_time();
+
+    call();
+
+    auto elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    stats.calls++;
+    stats.total_us += elapsed;
+    stats.max_us = std::max(stats.max_us, elapsed);
+}
@@ -0,0 +1,245 @@
+#pragma once
+#include "coro.hpp"
+#include "histogram.hpp"
+#include "json_writer.hpp"
+#include "socket.hpp"
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+/// Event loop shared by all services running on one task. Services register handlers for
+/// message types they expect on each socket, and timers. Dispatch is a table lookup by message
+/// type. Coroutines can wait for a message or time to pass, they are resumed by the loop.
+class Reactor {
+ public:
+    Reactor() : queues_(xQueueCreateSet(QUEUE_SET_SIZE)) {
+    }
+
+    /// Lanes are drained in order, control plane always goes before web plane
+    enum class Lane {
+        Control,
+        Web,
+
+        // Keep last, number of lanes
+        Count
+    };
+
+    using Handler = std::function<void(const Message&)>;
+    using Callback = std::function<void()>;
+    using TimerId = size_t;
+
+    /// Execution time of a handler
+    struct HandlerStats {
+        uint32_t calls;
+        uint32_t max_us;
+        uint64_t total_us;
+    };
+
+    /// Message key that matches any message of awaited type
+    static const int ANY = -1;
+
+    /// Registers socket as a source of events, name is used in stats
+    void listen(Socket& socket, Lane lane, const char* name);
+
+    /// Registers handler of a message type arriving on a listened socket
+    void on(Socket& socket, Message::Type type, Handler handler);
+
+    /// Registers binary semaphore, callback is called after it is taken
+    void on_signal(SemaphoreHandle_t semaphore, Lane lane, const char* name, Callback callback);
+
+    /// Registers timer in stopped state
+    TimerId add_timer(const char* name, TickType_t period, bool periodic, Callback callback);
+    void start_timer(TimerId timer);
+    /// Arms timer to fire after delay, periodic timer keeps its period from then on
+    void start_timer(TimerId timer, TickType_t delay);
+    void stop_timer(TimerId timer);
+
+    class RecvAwaiter;
+    class SleepAwaiter;
+
+    /// co_await-able, resumes with the message of given type arriving on socket, or nullopt on
+    /// timeout. Awaiting coroutine takes precedence over the handler registered for that type.
+    /// Key narrows the match, see matches().
+    RecvAwaiter recv(Socket& socket,
+                     Message::Type type,
+                     TickType_t timeout = portMAX_DELAY,
+                     int key = ANY);
+
+    /// Resumes the coroutine awaiting type on socket with nullopt, as if it timed out, so it
+    /// looks at state changed by a handler. Does nothing if none awaits.
+    void interrupt(Socket& socket, Message::Type type);
+
+    /// co_await-able, resumes after given time
+    SleepAwaiter sleep_for(TickType_t ticks);
+    SleepAwaiter sleep_until(time_t when);
+
+    /// Milliseconds to ticks for a wait, computed without overflowing TickType_t. Waits longer than
+    /// MAX_WAIT_TICKS are cut to it, callers waiting for a deadline check it again on wakeup.
+    static TickType_t ms_to_ticks(int64_t ms);
+
+    /// Runs the coroutine on the loop, it lives until it completes
+    void spawn(Task<> task);
+
+    /// Serves events forever
+    void run();
+
+    /// Execution time of each handler that was called at least once. Counters are updated by the
+    /// loop without locking, a report read from other task can be slightly inconsistent.
+    void write_stats(JsonWriter& json) const;
+
+    /// Time messages of a lane wait from being sent until they are dispatched
+    const Histogram& queue_latency(Lane lane) const {
+        return queue_latency_[(size_t)lane];
+    }
+
+ private:
+    // At least the sum of depths of the member queues
+    static const size_t QUEUE_SET_SIZE = 16;
+    static const size_t MAX_MEMBERS = 10;
+    static const size_t MAX_ROUTES = 20;
+    static const size_t MAX_TIMERS = 8;
+    static const size_t MAX_WAITERS = 8;
+    static const size_t TYPES_COUNT = (size_t)Message::Type::Count;
+    static constexpr int8_t NO_ROUTE = -1;
+    // Deadlines are compared as signed tick differences, ~248 days at 100 Hz
+    static const TickType_t MAX_WAIT_TICKS = INT32_MAX;
+
+    struct Member {
+        QueueSetMemberHandle_t handle;
+        Lane lane;
+        const char* name;
+
+        // Null for semaphores
+        Socket* socket;
+
+        // Index to routes_ by message type, or signal route for semaphores
+        std::array<int8_t, TYPES_COUNT> routes;
+        int8_t signal;
+    };
+
+    struct Route {
+        Handler handler;
+        Callback signal;
+
+        // For reporting only, type is Count for semaphores
+        const char* source;
+        Message::Type type;
+
+        HandlerStats stats;
+    };
+
+    struct Timer {
+        const char* name;
+        TickType_t period;
+        bool periodic;
+        bool armed;
+        TickType_t deadline;
+        Callback callback;
+        HandlerStats stats;
+    };
+
+    /// Suspended coroutine, waiting for a message, time, or both
+    struct Waiter {
+        std::coroutine_handle<> handle;
+
+        // Null if only waiting for time to pass
+        Socket* socket;
+        Message::Type type;
+        int key;
+        std::optional<Message>* result;
+
+        bool timed;
+        TickType_t deadline;
+    };
+
+    Member& add_member(QueueSetMemberHandle_t handle, Lane lane, size_t depth);
+    Member* find_member(QueueSetMemberHandle_t handle);
+    int8_t add_route(const char* source, Message::Type type);
+
+    void add_waiter(const Waiter& waiter);
+    bool resume_waiter(Socket* socket, Message& msg);
+
+    Member* select(TickType_t timeout);
+    TickType_t next_timeout() const;
+
+    void dispatch(Member& member);
+    void fire_timers();
+
+    /// Message carries what the key asks for, e.g. reply covers the section
+    static bool matches(const Message& msg, int key);
+
+    template <typename F>
+    static void measure(HandlerStats& stats, F&& call);
+
+    QueueSetHandle_t queues_;
+
+    // Ordered by lane, insertion order within the lane
+    std::array<Member, MAX_MEMBERS> members_ = {};
+    size_t members_count_ = 0;
+    size_t queued_max_ = 0;
+
+    std::array<Route, MAX_ROUTES> routes_ = {};
+    size_t routes_count_ = 0;
+
+    std::array<Timer, MAX_TIMERS> timers_ = {};
+    size_t timers_count_ = 0;
+
+    std::array<Waiter, MAX_WAITERS> waiters_ = {};
+    uint32_t spawned_ = 0;
+
+    std::array<Histogram, (size_t)Lane::Count> queue_latency_;
+};
+
+class Reactor::RecvAwaiter {
+ public:
+    bool await_ready() noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        waiter_.handle = handle;
+        waiter_.result = &result_;
+        reactor_.add_waiter(waiter_);
+    }
+
+    std::optional<Message> await_resume() {
+        return result_;
+    }
+
+ private:
+    friend class Reactor;
+    RecvAwaiter(Reactor& reactor, const Waiter& waiter) : reactor_(reactor), waiter_(waiter) {
+    }
+
+    Reactor& reactor_;
+    Waiter waiter_;
+    std::optional<Message> result_;
+};
+
+class Reactor::SleepAwaiter {
+ public:
+    bool await_ready() noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        waiter_.handle = handle;
+        reactor_.add_waiter(waiter_);
+    }
+
+    void await_resume() noexcept {
+    }
+
+ private:
+    friend class Reactor;
+    SleepAwaiter(Reactor& reactor, const Waiter& waiter) : reactor_(reactor), waiter_(waiter) {
+    }
+
+    Reactor& reactor_;
+    Waiter waiter_;
+};
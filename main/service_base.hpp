@@ -1,17 +1,29 @@
 #pragma once
+#include "event_bus.hpp"
+#include "reactor.hpp"
 #include "socket.hpp"
+#include "state_version.hpp"
 
-#include <algorithm>
-#include <memory>
-#include <set>
-
-#include <freertos/queue.h>
-
+/// Service is a set of handlers and coroutines registered to the reactor, many services share
+/// one reactor and so one task.
 class ServiceBase {
  public:
-    ServiceBase() : queues_(xQueueCreateSet(10)) {
+    ServiceBase(Reactor& reactor, EventBus& events) : reactor_(reactor), events_(events) {
+    }
+
+    /// Hardware setup, called on the reactor task before it starts serving events
+    virtual void start() = 0;
+
+    /// Changes whenever the status the service reports changes, safe to read from any task
+    const StateVersion& status_version() const {
+        return status_version_;
     }
 
  protected:
-    QueueSetHandle_t queues_;
-};
\ No newline at end of file
+    using Lane = Reactor::Lane;
+    using TimerId = Reactor::TimerId;
+
+    Reactor& reactor_;
+    EventBus& events_;
+    StateVersion status_version_;
+};
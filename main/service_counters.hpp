@@ -0,0 +1,35 @@
+#pragma once
+
+#include "snapshots.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Counters kept by services for /metrics. Only ever incremented by the service, read directly by
+// the web server from any task, so reading them does not cost the services anything.
+
+struct ClockCounters {
+    // Alarm 1 starts the watering cycle, alarm 2 is its backstop
+    std::array<std::atomic<uint32_t>, 2> alarms_handled = {};
+};
+
+struct MoistureCounters {
+    int channels_count = 0;
+    // ADC sweeps done per channel
+    std::array<std::atomic<uint32_t>, MAX_CHANNELS> reads = {};
+};
+
+struct WateringCounters {
+    int sections_count = 0;
+    std::array<const char*, MAX_SECTIONS> names = {};
+
+    std::atomic<uint32_t> cycles = 0;
+    std::array<std::atomic<uint32_t>, MAX_SECTIONS> valve_open_ms = {};
+    // Measured by the flow meter, stays 0 without one
+    std::array<std::atomic<uint32_t>, MAX_SECTIONS> water_ml = {};
+
+    // Manual jobs queued, and stops of all watering asked for
+    std::atomic<uint32_t> jobs = 0;
+    std::atomic<uint32_t> stops = 0;
+};
@@ -0,0 +1,22 @@
+#include "simulated_flow_meter.hpp"
+
+#include <esp_timer.h>
+
+uint32_t SimulatedFlowMeter::pulses() {
+    if (!flowing_) {
+        return (uint32_t)pulses_;
+    }
+
+    auto elapsed_us = esp_timer_get_time() - since_us_;
+    return (uint32_t)(pulses_ + elapsed_us * pulses_per_minute_ / (60 * 1000 * 1000));
+}
+
+void SimulatedFlowMeter::set_flowing(bool flowing) {
+    if (flowing == flowing_) {
+        return;
+    }
+
+    pulses_ = pulses();
+    flowing_ = flowing;
+    since_us_ = esp_timer_get_time();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "flow_meter.hpp"
+
+#include <cstdint>
+
+/// Pulses at a constant flow while water flows, for trying volume watering without a meter
+class SimulatedFlowMeter : public FlowMeter {
+ public:
+    explicit SimulatedFlowMeter(uint32_t pulses_per_minute)
+        : pulses_per_minute_(pulses_per_minute) {
+    }
+
+    esp_err_t init() override {
+        return ESP_OK;
+    }
+
+    uint32_t pulses() override;
+    void set_flowing(bool flowing) override;
+
+ private:
+    uint32_t pulses_per_minute_;
+    // Pulses of the flow that ended, plus the current one counted from its start
+    uint64_t pulses_ = 0;
+    bool flowing_ = false;
+    int64_t since_us_ = 0;
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+#include <sdkconfig.h>
+
+// Plain data exchanged between the web and services, copies of service state and requests to
+// change it. No pointers to owned memory, so a message that is dropped or overwritten does not
+// leak. Strings are static literals.
+
+static const int MAX_SECTIONS = 4;
+// Internal ADC probes, plus 4 on each external ADC
+#if CONFIG_GARDEN_MOISTURE_ADS1115
+static const int MAX_CHANNELS = 4 + 4 * CONFIG_GARDEN_MOISTURE_ADS1115_COUNT;
+#else
+static const int MAX_CHANNELS = 4;
+#endif
+static const int MAX_SOCKETS = 4;
+
+/// Delivery accounting of outgoing messages
+struct DeliveryStats {
+    uint32_t sent;
+    // New message not delivered, send deadline expired
+    uint32_t dropped;
+    // Pending message replaced due to DropOldest policy
+    uint32_t evicted;
+    // Pending message replaced by the newer one of the same type
+    uint32_t coalesced;
+    // Maximum number of messages waiting in the peer's queue
+    uint32_t high_water;
+    // Waiting for an incoming message with a timeout ended with nothing
+    uint32_t rcv_timeouts;
+};
+
+struct SocketStatus {
+    const char* name;
+    uint32_t depth;
+    DeliveryStats delivery;
+};
+
+struct SocketList {
+    int count;
+    SocketStatus items[MAX_SOCKETS];
+
+    void add(const SocketStatus& status) {
+        if (count < MAX_SOCKETS) {
+            items[count++] = status;
+        }
+    }
+};
+
+struct ClockStatus {
+    // As struct tm defines it, years since 1900
+    bool time_valid;
+    struct tm time;
+
+    bool temperature_valid;
+    float temperature;
+
+    bool alarm1_set;
+    struct tm alarm1;
+    bool alarm2_set;
+    struct tm alarm2;
+
+    uint8_t status_reg;
+    uint8_t control_reg;
+
+    int64_t irq_latency_max_us;
+
+    SocketList sockets;
+};
+
+/// Raw ADC readings of a probe in air and in water, moisture is interpolated between them
+struct ChannelCalibration {
+    uint16_t dry_raw;
+    uint16_t wet_raw;
+};
+
+struct ChannelStatus {
+    uint32_t raw;
+    uint32_t voltage;
+    // NaN if the reading is out of range or not trustworthy
+    float moisture;
+    // From 0 to 1, how much the reading can be trusted
+    float confidence;
+    ChannelCalibration calibration;
+};
+
+struct MoistureStatus {
+    int channels_count;
+    ChannelStatus channels[MAX_CHANNELS];
+
+    SocketList sockets;
+};
+
+/// Sets a calibration point of a channel
+struct CalibrationRequest {
+    int channel;
+    enum class Point {
+        Dry,
+        Wet,
+    } point;
+    // Raw reading of the point, -1 to take the current reading of the probe
+    int raw;
+};
+
+struct CalibrationResult {
+    // Null if applied
+    const char* error;
+    int channel;
+    ChannelCalibration calibration;
+};
+
+/// What the drying model expects of a section at the next scheduled cycle
+struct SectionForecast {
+    // Per day at the current temperature, NaN until the model has seen enough drying
+    float drying_rate;
+    // At the next cycle, and a day after it when the following cycle comes
+    float moisture_at_cycle;
+    float moisture_day_after;
+    // Watering time planned for the next cycle, 0 if the section is skipped
+    int planned_seconds;
+};
+
+struct WateringStatus {
+    // Null if no section is selected
+    const char* current_section;
+    bool in_progress;
+
+    int64_t alarm_latency_last_us;
+    int64_t alarm_latency_max_us;
+
+    int64_t uptime_ms;
+
+    uint32_t heap_total;
+    uint32_t heap_allocated;
+    uint32_t heap_free;
+    uint32_t heap_largest_block;
+
+    int sections_count;
+    SectionForecast forecast[MAX_SECTIONS];
+
+    // Water given to each section since the last cycle started, only measured with a flow meter
+    bool flow_meter;
+    float litres_last_cycle[MAX_SECTIONS];
+
+    // Manual jobs waiting, the one watering now not included
+    int jobs_queued;
+    bool paused;
+    // From a stop request leaving the web server until all valves were closed
+    int64_t stop_latency_last_us;
+    int64_t stop_latency_max_us;
+
+    SocketList sockets;
+};
+
+struct SectionConfiguration {
+    const char* name;
+    bool enabled;
+    int duration_seconds;
+    float wet_threshold;
+    // Section stops once that much water went through, duration is then only a cap. 0 waters
+    // for the duration.
+    float target_litres;
+};
+
+/// Time of day when the watering cycle starts
+struct Schedule {
+    int hour;
+    int minute;
+};
+
+struct WateringConfiguration {
+    // False if the requested change was rejected, the rest reflects the current configuration
+    bool applied;
+
+    // Incremented on every change
+    uint32_t version;
+    Schedule schedule;
+
+    int sections_count;
+    SectionConfiguration sections[MAX_SECTIONS];
+};
+
+/// Requested settings of a section, found by name
+struct SectionSettings {
+    char name[32];
+    bool enabled;
+    int duration_seconds;
+    float wet_threshold;
+    float target_litres;
+};
+
+/// Settings of all sections and the schedule, applied all at once or not at all
+struct BulkConfiguration {
+    // Version the change was based on, change is rejected if configuration moved on since then
+    uint32_t base_version;
+    Schedule schedule;
+
+    int sections_count;
+    SectionSettings sections[MAX_SECTIONS];
+};
+
+/// Scheduled sections give way to manual jobs. High priority job interrupts the section that
+/// waters, normal one waits until it ends.
+enum class JobPriority : uint8_t {
+    Scheduled,
+    Normal,
+    High,
+};
+
+/// Manual control of watering
+struct JobRequest {
+    enum class Action {
+        // Queues watering of a section
+        Water,
+        // Closes the valve of the running job, it goes on after Resume
+        Pause,
+        Resume,
+        // Closes all valves, drops queued jobs and the running cycle
+        StopAll,
+    } action;
+
+    // Water only
+    char section_name[32];
+    int duration_seconds;
+    // Section stops once that much water went through, duration is then only a cap. 0 waters
+    // for the duration.
+    float target_litres;
+    JobPriority priority;
+
+    // StopAll only, esp_timer time the web server took the request
+    int64_t admitted_us;
+};
+
+struct JobResult {
+    // Null if done
+    const char* error;
+    // Of the queued job, 0 for other actions
+    uint32_t job_id;
+    int jobs_queued;
+    bool paused;
+    // StopAll, from the web server taking the request until all valves were closed
+    int64_t stop_latency_us;
+};
+
+struct ConfigurationResult {
+    enum class Status {
+        Applied,
+        // Configuration changed since base version was read
+        Conflict,
+        Invalid,
+    } status;
+
+    // Current version, new one if applied
+    uint32_t version;
+
+    // Reason of rejection
+    const char* error;
+};
@@ -0,0 +1,141 @@
+#include "socket.hpp"
+
+#include "static_alloc.hpp"
+
+#include <cinttypes>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+
+/// Serializes taking a message from a queue with replacing the pending one, so a replacement is
+/// counted only when the overwritten message was still there
+static SemaphoreHandle_t queue_lock() {
+    static StaticSemaphore_t storage;
+    static SemaphoreHandle_t lock = xSemaphoreCreateMutexStatic(&storage);
+
+    return lock;
+}
+
+SockPtr Socket::make(size_t queue_depth, Overflow policy, TickType_t deadline) {
+    auto rx = create_queue(queue_depth);
+    auto tx = create_queue(queue_depth);
+
+    return allocate(rx, tx, queue_depth, policy, deadline, false);
+}
+
+SockPtr Socket::allocate(QueueHandle_t rx,
+                         QueueHandle_t tx,
+                         size_t queue_depth,
+                         Overflow policy,
+                         TickType_t deadline,
+                         bool connected) {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    auto* storage = static_alloc<Socket>();
+    return SockPtr(new (storage) Socket(rx, tx, queue_depth, policy, deadline, connected));
+#else
+    return SockPtr(new Socket(rx, tx, queue_depth, policy, deadline, connected));
+#endif
+}
+
+QueueHandle_t Socket::create_queue(size_t queue_depth) {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    auto* buffer = static_alloc<uint8_t>(queue_depth * sizeof(Message));
+    auto* queue = static_alloc<StaticQueue_t>();
+
+    return xQueueCreateStatic(queue_depth, sizeof(Message), buffer, queue);
+#else
+    return xQueueCreate(queue_depth, sizeof(Message));
+#endif
+}
+
+void SocketDeleter::operator()(Socket* socket) const {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    socket->~Socket();
+#else
+    delete socket;
+#endif
+}
+
+BaseType_t Socket::send(Message msg) {
+    msg.sent_us = esp_timer_get_time();
+
+    if (policy_ != Overflow::Block && try_replace(msg)) {
+        stats_.sent++;
+        update_high_water();
+
+        return pdPASS;
+    }
+
+    if (xQueueSendToBack(tx_, &msg, deadline_) != pdPASS) {
+        stats_.dropped++;
+        ESP_LOGW(TAG,
+                 "Peer queue full, dropped msg %d (%" PRIu32 " so far)",
+                 (int)msg.type,
+                 stats_.dropped);
+
+        return errQUEUE_FULL;
+    }
+
+    stats_.sent++;
+    update_high_water();
+
+    return pdPASS;
+}
+
+std::optional<Message> Socket::rcv(int timeout) {
+    Message res;
+
+    // Wait without the lock, the peeked message is taken below, or its replacement if the sender
+    // overwrote it in the meantime
+    if (timeout > 0 && xQueuePeek(rx_, &res, timeout) != pdPASS) {
+        stats_.rcv_timeouts++;
+        return std::nullopt;
+    }
+
+    xSemaphoreTake(queue_lock(), portMAX_DELAY);
+    auto received = xQueueReceive(rx_, &res, 0);
+    xSemaphoreGive(queue_lock());
+
+    if (received != pdPASS) {
+        return std::nullopt;
+    }
+
+    return std::optional(res);
+}
+
+bool Socket::try_replace(const Message& msg) {
+    Message pending;
+    bool replaced = false;
+
+    // The peer takes messages under the same lock, so what is peeked is still pending when it is
+    // overwritten. An empty queue is left to the plain send path.
+    xSemaphoreTake(queue_lock(), portMAX_DELAY);
+    if (xQueuePeek(tx_, &pending, 0) == pdPASS &&
+        (policy_ != Overflow::Coalesce || pending.type == msg.type)) {
+        xQueueOverwrite(tx_, &msg);
+        replaced = true;
+    }
+    xSemaphoreGive(queue_lock());
+
+    if (!replaced) {
+        return false;
+    }
+
+    if (policy_ == Overflow::Coalesce) {
+        stats_.coalesced++;
+    } else {
+        stats_.evicted++;
+        ESP_LOGW(TAG, "Evicted msg %d in favour of %d", (int)pending.type, (int)msg.type);
+    }
+
+    return true;
+}
+
+void Socket::update_high_water() {
+    auto waiting = (uint32_t)uxQueueMessagesWaiting(tx_);
+
+    if (waiting > stats_.high_water) {
+        stats_.high_water = waiting;
+    }
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "snapshots.hpp"
+
 #include <memory>
 #include <optional>
+#include <string>
 #include <utility>
 #include <variant>
 
@@ -14,6 +17,7 @@ struct Message {
     enum class Type {
         MoistureReq,
         MoistureRes,
+        MoistureWarmUp,
         Alarm1Expired,
         Alarm2Expired,
         SetAlarm1,
@@ -22,20 +26,38 @@ struct Message {
         ClearAlarm2,
         Status,
         GetConfiguration,
-        SetConfiguration
+        SetConfiguration,
+        SetBulkConfiguration,
+        Calibrate,
+        Job,
 
+        // Keep last, number of message types
+        Count
     } type;
 
+    // Set by Socket::send, esp_timer timestamp in us, used to measure handling latency
+    int64_t sent_us;
+
+    // Set by the requestor, copied to the reply, pairs them when requests time out
+    uint32_t seq;
+
     union {
         // MoistureReq
         struct {
             int section;
         };
 
-        // MoistureRes
+        // MoistureRes, answers every section requested since the last sweep at once
+        struct {
+            uint32_t sections;
+            float moisture[MAX_CHANNELS];
+        };
+
+        // MoistureWarmUp, wall clock time of the next MoistureReq. Start of the daily cycle is
+        // kept apart from reads of the sections, neither replaces the other.
         struct {
-            int section_r;
-            float moisture;
+            time_t read_at;
+            bool cycle;
         };
 
         // Alarm1Expired
@@ -46,89 +68,146 @@ struct Message {
             struct tm alarm_tm;
         };
 
-        // Status
-        struct {
-            char* status;
-        };
+        // Status replies, each service sends its own
+        ClockStatus clock_status;
+        MoistureStatus moisture_status;
+        WateringStatus watering_status;
 
-        // Get Configuration
-        struct {
-            char* configuration;
-        };
+        // GetConfiguration reply
+        WateringConfiguration configuration;
 
         // Set Configuration
-        struct {
-            char section_name[32];
-            bool enabled;
-            int duration_seconds;
-            float wet_threshold;
-        };
+        SectionSettings section_settings;
+
+        // SetBulkConfiguration request
+        BulkConfiguration bulk_configuration;
+
+        // SetBulkConfiguration reply
+        ConfigurationResult configuration_result;
+
+        // Calibrate request and reply
+        CalibrationRequest calibration_request;
+        CalibrationResult calibration_result;
+
+        // Job request and reply
+        JobRequest job_request;
+        JobResult job_result;
     };
 };
 
 class Socket;
-using SockPtr = std::unique_ptr<Socket>;
+
+/// Sockets live in the static arena in static allocation mode, only destroy them there
+struct SocketDeleter {
+    void operator()(Socket* socket) const;
+};
+
+using SockPtr = std::unique_ptr<Socket, SocketDeleter>;
 
 /// 1-1 bidirectional communication
 class Socket {
  public:
-    Socket(size_t queue_depth) {
-        connected_ = false;
+    /// What send() does when the peer's queue is full
+    enum class Overflow {
+        // Wait up to the send deadline for a free slot, then drop the new message
+        Block,
+        // Replace the oldest pending message with the new one
+        DropOldest,
+        // Replace pending message of the same type, otherwise behave like Block
+        Coalesce,
+    };
 
-        rx_ = xQueueCreate(queue_depth, sizeof(Message));
-        configASSERT(rx_);
+    using Stats = DeliveryStats;
 
-        tx_ = xQueueCreate(queue_depth, sizeof(Message));
-        configASSERT(tx_);
-    }
+    /// Creates socket, with its queues on heap or in the static arena
+    static SockPtr make(size_t queue_depth,
+                        Overflow policy = Overflow::Block,
+                        TickType_t deadline = 0);
 
     virtual ~Socket() {
         vQueueDelete(rx_);
         vQueueDelete(tx_);
     }
 
-    SockPtr connect() {
+    SockPtr connect(Overflow policy = Overflow::Block, TickType_t deadline = 0) {
         if (connected_) {
             // ESP_LOGE(TAG, "Cannot connect to already connected socket");
             abort();
         }
 
-        return SockPtr(new Socket(tx_, rx_));
+        return allocate(tx_, rx_, depth_, policy, deadline, true);
     }
 
-    BaseType_t send(Message msg) {
-        return xQueueSendToBack(tx_, &msg, 0);
-    }
+    void set_overflow(Overflow policy, TickType_t deadline) {
+        // Replacing a pending item is done with xQueueOverwrite, which is the only way to do that
+        // without desynchronizing the queue set the peer waits on, and it works on 1 item queues
+        configASSERT(policy == Overflow::Block || depth_ == 1);
 
-    std::optional<Message> rcv(int timeout) {
-        Message res;
-        if (xQueueReceive(rx_, &res, timeout) == pdPASS) {
-            return std::optional(res);
-        } else {
-            return std::nullopt;
-        }
+        policy_ = policy;
+        deadline_ = deadline;
     }
 
+    /// Sends message according to the overflow policy
+    BaseType_t send(Message msg);
+
+    std::optional<Message> rcv(int timeout);
+
     QueueHandle_t get_rx() {
         return rx_;
     }
 
+    size_t depth() const {
+        return depth_;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    /// Delivery stats for the status report
+    SocketStatus status(const char* name) const {
+        return SocketStatus{.name = name, .depth = (uint32_t)depth_, .delivery = stats_};
+    }
+
  private:
-    Socket(QueueHandle_t rx, QueueHandle_t tx) {
-        connected_ = true;
+    static SockPtr allocate(QueueHandle_t rx,
+                            QueueHandle_t tx,
+                            size_t queue_depth,
+                            Overflow policy,
+                            TickType_t deadline,
+                            bool connected);
+    static QueueHandle_t create_queue(size_t queue_depth);
+
+    Socket(QueueHandle_t rx,
+           QueueHandle_t tx,
+           size_t queue_depth,
+           Overflow policy,
+           TickType_t deadline,
+           bool connected) {
+        connected_ = connected;
+        depth_ = queue_depth;
         rx_ = rx;
         tx_ = tx;
 
         configASSERT(tx_);
         configASSERT(rx_);
+
+        set_overflow(policy, deadline);
     }
 
+    bool try_replace(const Message& msg);
+    void update_high_water();
+
     static constexpr const char *TAG = "Socket";
     bool connected_;
+    size_t depth_;
     QueueHandle_t rx_;
     QueueHandle_t tx_;
 
+    Overflow policy_;
+    TickType_t deadline_;
+    Stats stats_ = {};
+
     Socket(const Socket &) = delete;
     Socket operator=(const Socket &) = delete;
 };
-
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/// Counter bumped by the owning service whenever the state it reports changes. Other tasks read
+/// it without IPC, the web uses it to answer conditional requests.
+class StateVersion {
+ public:
+    void bump() {
+        value_.fetch_add(1, std::memory_order_release);
+    }
+
+    uint32_t get() const {
+        return value_.load(std::memory_order_acquire);
+    }
+
+ private:
+    std::atomic<uint32_t> value_{1};
+};
@@ -0,0 +1,144 @@
+#include "static_alloc.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+
+static const char* TAG = "StaticAlloc";
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Frame sizes are only known to the compiler, they are recorded as coroutines are created
+static size_t frame_largest = 0;
+
+static void note_frame(size_t size) {
+    portENTER_CRITICAL(&lock);
+    frame_largest = std::max(frame_largest, size);
+    portEXIT_CRITICAL(&lock);
+}
+
+size_t frame_largest_request() {
+    return frame_largest;
+}
+
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+
+static const size_t ARENA_SIZE = CONFIG_GARDEN_STATIC_ARENA_SIZE;
+static const size_t FRAMES = CONFIG_GARDEN_CORO_FRAMES;
+static const size_t FRAME_SIZE = CONFIG_GARDEN_CORO_FRAME_SIZE;
+
+alignas(max_align_t) static uint8_t arena[ARENA_SIZE];
+static size_t arena_used = 0;
+
+alignas(max_align_t) static uint8_t frames[FRAMES][FRAME_SIZE];
+static bool frames_taken[FRAMES] = {};
+
+void* static_alloc(size_t size, size_t align) {
+    portENTER_CRITICAL(&lock);
+
+    size_t offset = (arena_used + align - 1) & ~(align - 1);
+    bool fits = offset + size <= ARENA_SIZE;
+    if (fits) {
+        arena_used = offset + size;
+    }
+
+    portEXIT_CRITICAL(&lock);
+
+    if (!fits) {
+        ESP_LOGE(TAG, "Static arena exhausted, %u bytes requested, raise arena size", size);
+        abort();
+    }
+
+    return arena + offset;
+}
+
+size_t static_alloc_used() {
+    return arena_used;
+}
+
+size_t static_alloc_capacity() {
+    return ARENA_SIZE;
+}
+
+void* frame_alloc(size_t size) {
+    note_frame(size);
+
+    // Watering probes its frames at boot, a frame that does not fit is found there
+    if (size > FRAME_SIZE) {
+        ESP_LOGE(TAG, "Coroutine frame of %u bytes does not fit in %u", size, FRAME_SIZE);
+        abort();
+    }
+
+    void* frame = nullptr;
+
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < FRAMES; i++) {
+        if (!frames_taken[i]) {
+            frames_taken[i] = true;
+            frame = frames[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (frame == nullptr) {
+        ESP_LOGE(TAG, "All %u coroutine frames are taken", FRAMES);
+        abort();
+    }
+
+    return frame;
+}
+
+void frame_free(void* frame) {
+    size_t idx = ((uint8_t*)frame - &frames[0][0]) / FRAME_SIZE;
+
+    portENTER_CRITICAL(&lock);
+    frames_taken[idx] = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+size_t frame_pool_capacity() {
+    return sizeof(frames);
+}
+
+size_t frame_slot_size() {
+    return FRAME_SIZE;
+}
+
+#else
+
+void* static_alloc(size_t size, size_t align) {
+    ESP_LOGE(TAG, "Static allocation is disabled");
+    abort();
+}
+
+size_t static_alloc_used() {
+    return 0;
+}
+
+size_t static_alloc_capacity() {
+    return 0;
+}
+
+void* frame_alloc(size_t size) {
+    note_frame(size);
+
+    return ::operator new(size);
+}
+
+void frame_free(void* frame) {
+    ::operator delete(frame);
+}
+
+size_t frame_pool_capacity() {
+    return 0;
+}
+
+size_t frame_slot_size() {
+    return 0;
+}
+
+#endif
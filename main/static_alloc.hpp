@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <sdkconfig.h>
+
+// In CONFIG_GARDEN_STATIC_ALLOCATION mode storage for FreeRTOS objects and coroutine frames comes
+// from buffers sized at compile time, nothing is taken from heap after boot.
+
+/// Takes storage from the static arena, never freed. Aborts if arena is exhausted.
+void* static_alloc(size_t size, size_t align);
+
+template <typename T>
+T* static_alloc(size_t count = 1) {
+    return (T*)static_alloc(sizeof(T) * count, alignof(T));
+}
+
+/// Bytes taken from the static arena so far, and its capacity
+size_t static_alloc_used();
+size_t static_alloc_capacity();
+
+/// Coroutine frame pool, fixed number of fixed size slots. Aborts on a frame bigger than a slot
+/// or when all slots are taken.
+void* frame_alloc(size_t size);
+void frame_free(void* frame);
+
+/// Largest coroutine frame requested so far
+size_t frame_largest_request();
+
+/// Bytes reserved for the frame pool, and size of one frame slot
+size_t frame_pool_capacity();
+size_t frame_slot_size();
@@ -0,0 +1,78 @@
+#include "valve_bank.hpp"
+
+#include <esp_check.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+#include <soc/soc_caps.h>
+
+static const char* TAG = "ValveBank";
+
+ValveBank::ValveBank(const gpio_num_t* pins, int count, int on_level)
+    : count_(count), on_level_(on_level) {
+    configASSERT(count <= MAX_VALVES);
+
+    for (int i = 0; i < count; i++) {
+        pins_[i] = pins[i];
+    }
+
+    all_ = pins_of((1u << count) - 1);
+}
+
+esp_err_t ValveBank::init() {
+    // Output latch is set before the pins become outputs, so no valve opens for a moment
+    drive(all_, false);
+
+    gpio_config_t io_conf = {};
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    io_conf.pin_bit_mask = ((uint64_t)all_.high << 32) | all_.low;
+
+    ESP_RETURN_ON_ERROR(gpio_config(&io_conf), TAG, "Failed to configure valve outputs");
+
+    return ESP_OK;
+}
+
+void ValveBank::set(uint32_t open_sections) {
+    auto open = pins_of(open_sections);
+    auto closed = Pins{.low = all_.low & ~open.low, .high = all_.high & ~open.high};
+
+    // Valves that close go first, two sections are never open at once
+    drive(closed, false);
+    drive(open, true);
+}
+
+ValveBank::Pins ValveBank::pins_of(uint32_t sections) const {
+    auto res = Pins{};
+
+    for (int i = 0; i < count_; i++) {
+        if (!(sections & (1u << i))) {
+            continue;
+        }
+
+        if (pins_[i] < 32) {
+            res.low |= 1u << pins_[i];
+        } else {
+            res.high |= 1u << (pins_[i] - 32);
+        }
+    }
+
+    return res;
+}
+
+void ValveBank::drive(Pins pins, bool open) {
+    bool high = open == (on_level_ != 0);
+
+    if (pins.low) {
+        REG_WRITE(high ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, pins.low);
+    }
+
+#if SOC_GPIO_PIN_COUNT > 32
+    if (pins.high) {
+        REG_WRITE(high ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, pins.high);
+    }
+#endif
+}
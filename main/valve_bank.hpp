@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <driver/gpio.h>
+#include <esp_err.h>
+
+/// Valve outputs of all sections, switched together through the GPIO set and clear registers.
+/// Valves are addressed by a mask of sections, each switch is one write per register that has
+/// a pin to change, instead of a driver call per pin.
+class ValveBank {
+ public:
+    static const int MAX_VALVES = 8;
+
+    /// Pins by section, on_level is the level that opens a valve
+    ValveBank(const gpio_num_t* pins, int count, int on_level);
+
+    /// Configures the outputs with all valves closed
+    esp_err_t init();
+
+    /// Opens valves of sections set in the mask, closes the others
+    void set(uint32_t open_sections);
+
+    void close_all() {
+        set(0);
+    }
+
+ private:
+    // GPIO 0..31 and 32..39 have own registers
+    struct Pins {
+        uint32_t low;
+        uint32_t high;
+    };
+
+    Pins pins_of(uint32_t sections) const;
+    void drive(Pins pins, bool open);
+
+    std::array<gpio_num_t, MAX_VALVES> pins_ = {};
+    int count_;
+    int on_level_;
+    Pins all_ = {};
+};
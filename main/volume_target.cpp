@@ -0,0 +1,42 @@
+#include "volume_target.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+VolumeTarget::VolumeTarget(float litres, uint32_t pulses_per_litre) {
+    if (!(litres > 0)) {
+        return;
+    }
+
+    // Double holds UINT32_MAX exactly, converting anything above it is undefined
+    double pulses = std::round((double)litres * pulses_per_litre);
+    target_ = (uint32_t)std::clamp<double>(pulses, 1, UINT32_MAX);
+}
+
+void VolumeTarget::add(uint32_t since_open) {
+    delivered_ = total(since_open);
+}
+
+VolumeTarget::Outcome VolumeTarget::check(uint32_t since_open,
+                                          int64_t open_us,
+                                          int64_t left_us) const {
+    if (set() && total(since_open) >= target_) {
+        return Outcome::Volume;
+    }
+
+    return open_us >= left_us ? Outcome::Cap : Outcome::Watering;
+}
+
+int64_t VolumeTarget::eta_us(uint32_t since_open, int64_t open_us) const {
+    if (!set() || since_open == 0) {
+        return -1;
+    }
+
+    uint32_t remaining = target_ - std::min(total(since_open), target_);
+    return (int64_t)((double)remaining * open_us / since_open);
+}
+
+uint32_t VolumeTarget::total(uint32_t since_open) const {
+    // Saturates, a target is never that far
+    return since_open > UINT32_MAX - delivered_ ? UINT32_MAX : delivered_ + since_open;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+/// Water a watering job is to deliver, in flow meter pulses, counted over all the times the job
+/// opened its valve. The job's time stays the cap, flow is not guaranteed.
+class VolumeTarget {
+ public:
+    enum class Outcome {
+        Watering,
+        // Target delivered
+        Volume,
+        // Time ran out first
+        Cap,
+    };
+
+    /// No target, the job waters for its time
+    VolumeTarget() = default;
+
+    /// Any litres above 0 are at least one pulse, none or NaN is no target
+    VolumeTarget(float litres, uint32_t pulses_per_litre);
+
+    bool set() const {
+        return target_ > 0;
+    }
+
+    uint32_t target() const {
+        return target_;
+    }
+
+    uint32_t delivered() const {
+        return delivered_;
+    }
+
+    /// Valve closed after counting that many pulses
+    void add(uint32_t since_open);
+
+    /// Where the job is after open_us with the valve open and since_open pulses counted meanwhile,
+    /// left_us is the time the job had left when the valve opened. A job that got its water is
+    /// done by volume, even if its time ran out in the same check.
+    Outcome check(uint32_t since_open, int64_t open_us, int64_t left_us) const;
+
+    /// Time until the target at the flow seen since the valve opened, -1 before the first pulse
+    int64_t eta_us(uint32_t since_open, int64_t open_us) const;
+
+ private:
+    uint32_t total(uint32_t since_open) const;
+
+    uint32_t target_ = 0;
+    uint32_t delivered_ = 0;
+};
@@ -1,8 +1,11 @@
 #include "watering_service.hpp"
 
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
-#include <chrono>
+#include <esp_heap_caps.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <string.h>
@@ -12,27 +15,127 @@ static const char* TAG = "Watering";
 // If defined sets short intervals for each section, and arms timer 1 to fire immediately
 // #define TESTING 1
 
-Watering::Watering(SockPtr clock, SockPtr moisture, SockPtr web)
-    : current_section_(SECTION_SIZE),
+Watering::Watering(Reactor& reactor,
+                   EventBus& events,
+                   SockPtr clock,
+                   SockPtr moisture,
+                   SockPtr web,
+                   SockPtr web_stop)
+    : ServiceBase(reactor, events),
+      current_section_(SECTION_SIZE),
       watering_in_progress_(false),
       clock_(std::move(clock)),
       moisture_(std::move(moisture)),
       web_(std::move(web)),
-      moisture_monitor_(
-          xTimerCreate("moist_monit", pdMS_TO_TICKS(1000), false, this, moisture_monitor_cb)) {
-    xQueueAddToSet(clock_->get_rx(), queues_);
-    xQueueAddToSet(moisture_->get_rx(), queues_);
-    xQueueAddToSet(web_->get_rx(), queues_);
+      web_stop_(std::move(web_stop)),
+      temperature_(nanf("")) {
+    counters_.sections_count = SECTION_SIZE;
+    latest_moisture_.fill(nanf(""));
+
+    events_.subscribe(on_event, this);
+    auto drying = reactor_.add_timer("drying", DRYING_SAMPLE_PERIOD, true, [this] {
+        sample_drying();
+    });
+    reactor_.start_timer(drying);
+
+    for (int section = 0; section < SECTION_SIZE; section++) {
+        counters_.names[section] = sections_names_[section];
+    }
+
+    // MoistureRes is awaited by the runner, MoistureRes that nobody awaits is the reading of the
+    // next section, asked for ahead. Job requests are awaited while a section waters.
+    reactor_.listen(*clock_, Lane::Control, "clock");
+    reactor_.on(*clock_, Message::Type::Alarm1Expired, [this](const Message& msg) {
+        on_alarm1(msg);
+    });
+    reactor_.on(*clock_, Message::Type::Alarm2Expired, [this](const Message& msg) {
+        ESP_LOGE(TAG, "Watering overran its backstop, stopping");
+        track_alarm_latency(msg);
+        stop_all();
+    });
+
+    reactor_.listen(*moisture_, Lane::Control, "moisture");
+    reactor_.on(*moisture_, Message::Type::MoistureRes, [this](const Message& msg) {
+        on_prefetched(msg);
+    });
+
+    reactor_.listen(*web_, Lane::Web, "web");
+    reactor_.on(*web_, Message::Type::Status, [this](const Message& msg) {
+        ESP_LOGI(TAG, "Status request from the web");
+        Message resp = {};
+        resp.type = Message::Type::Status;
+        resp.seq = msg.seq;
+        resp.watering_status = get_status();
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::GetConfiguration, [this](const Message& msg) {
+        ESP_LOGI(TAG, "Configuration get request from the web");
+        Message resp = {};
+        resp.type = Message::Type::GetConfiguration;
+        resp.seq = msg.seq;
+        resp.configuration = get_configuration();
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::SetConfiguration, [this](const Message& msg) {
+        ESP_LOGI(TAG, "Configuration set request from the web");
+
+        Message resp = {};
+        resp.type = Message::Type::GetConfiguration;
+        resp.seq = msg.seq;
+        resp.configuration = set_configuration(msg.section_settings);
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::SetBulkConfiguration, [this](const Message& msg) {
+        ESP_LOGI(TAG, "Bulk configuration request from the web");
+
+        Message resp = {};
+        resp.type = Message::Type::SetBulkConfiguration;
+        resp.seq = msg.seq;
+        resp.configuration_result = apply_configuration(msg.bulk_configuration);
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::Job, [this](const Message& msg) {
+        on_job(msg, *web_);
+    });
+
+    reactor_.listen(*web_stop_, Lane::Control, "web_stop");
+    reactor_.on(*web_stop_, Message::Type::Job, [this](const Message& msg) {
+        on_job(msg, *web_stop_);
+    });
 
     set_next_section();
 }
 
-void Watering::run_service() {
+void Watering::start() {
     ESP_LOGI(TAG, "Service started");
 
-    setup_gpio();
+    ESP_ERROR_CHECK(valves_.init());
     say_hello();
 
+#if CONFIG_GARDEN_FLOW_METER_PCNT || CONFIG_GARDEN_FLOW_METER_SIMULATED
+    if (flow_meter_.init() == ESP_OK) {
+        flow_ = &flow_meter_;
+    } else {
+        ESP_LOGE(TAG, "Flow meter not available, sections water by time");
+    }
+#endif
+
+    arm_schedule();
+}
+
+void Watering::probe_frames() {
+    // Tasks are lazy, none of these runs, each frame is freed when its task goes out of scope
+    auto job = Job{};
+    auto cycle = run();
+    auto section = water(job);
+    auto moisture = read_moisture(0);
+}
+
+void Watering::arm_schedule() {
     struct tm alarm_tm = {};
 
 #if TESTING
@@ -43,247 +146,778 @@ void Watering::run_service() {
     now += 5;
 
     localtime_r(&now, &alarm_tm);
+    time_t read_at = now;
 #else
-//22 09
-    alarm_tm.tm_hour = 18;
-    alarm_tm.tm_min = 30;
+    alarm_tm.tm_hour = schedule_.hour;
+    alarm_tm.tm_min = schedule_.minute;
     alarm_tm.tm_sec = 00;
+
+    time_t read_at = next_cycle();
 #endif
 
     set_the_alarm(alarm_tm);
 
-    while (1) {
-        QueueSetMemberHandle_t active_member = xQueueSelectFromSet(queues_, pdMS_TO_TICKS(-1));
-
-        std::optional<Message> data;
-
-        if (active_member == moisture_->get_rx()) {
-            data = moisture_->rcv(0);
-        } else if (active_member == clock_->get_rx()) {
-            data = clock_->rcv(0);
-        } else if (active_member == web_->get_rx()) {
-            if (auto web_data = web_->rcv(0)) {
-                auto msg = *web_data;
-
-                switch (msg.type) {
-                    case Message::Type::Status: {
-                        ESP_LOGI(TAG, "Status request from the web");
-                        Message resp = {};
-                        resp.type = Message::Type::Status;
-                        resp.status = get_status().release();
-
-                        web_->send(resp);
-                        break;
-                    }
-                    case Message::Type::GetConfiguration: {
-                        ESP_LOGI(TAG, "Configuration get request from the web");
-                        Message resp = {};
-                        resp.type = Message::Type::GetConfiguration;
-                        resp.status = get_configuration().release();
-
-                        web_->send(resp);
-                        break;
-                    }
-                    case Message::Type::SetConfiguration: {
-                        ESP_LOGI(TAG, "Configuration set request from the web");
-
-                        Message resp = {};
-                        resp.type = Message::Type::GetConfiguration;
-                        resp.status = set_configuration(msg).release();
-
-                        web_->send(resp);
-                        break;
-                    }
-
-                    default:
-                        break;
-                }
+    // Cycle starts with a moisture read, probes are ready by then
+    announce_read(read_at, true);
+}
+
+void Watering::on_alarm1(const Message& msg) {
+    track_alarm_latency(msg);
+
+    if (cycle_pending_) {
+        ESP_LOGW(TAG, "Watering cycle already in progress");
+        return;
+    }
+
+    // Nothing should be open unless a manual job waters
+    if (!running_) {
+        turn_off_valves();
+    }
+
+    counters_.cycles++;
+    cycle_pending_ = true;
+    prefetched_.reset();
+    litres_last_cycle_.fill(0);
+
+    start_runner();
+}
+
+void Watering::start_runner() {
+    if (running_) {
+        // Work was added, backstop moves further
+        arm_backstop();
+        return;
+    }
+
+    reactor_.spawn(run());
+}
+
+Task<> Watering::run() {
+    running_ = true;
+    arm_backstop();
+
+    for (;;) {
+        if (stop_requested_) {
+            ESP_LOGW(TAG, "Watering stopped");
+            stop_requested_ = false;
+
+            if (cycle_pending_) {
+                end_cycle();
+            }
+        }
+
+        // Manual jobs go first, interrupted section of the cycle continues after them
+        if (auto job = pop_job()) {
+            ESP_LOGI(TAG, "Running job %" PRIu32 ", section %d", job->id, job->section);
+
+            // Interrupted job goes on after the one that interrupted it
+            if (!co_await water(*job) && !stop_requested_) {
+                push_job(*job, true);
+            }
+            continue;
+        }
+
+        if (!cycle_pending_) {
+            break;
+        }
+
+        if (current_section_ >= SECTION_SIZE) {
+            end_cycle();
+            continue;
+        }
+
+        // Section is planned once, if it gets interrupted it goes on with what is left
+        if (!scheduled_) {
+            // Check if section requires watering
+            float moisture = co_await read_moisture(current_section_);
+
+            ESP_LOGI(TAG,
+                     "Got moisture for section %d, moisture %f, location %s",
+                     current_section_,
+                     moisture,
+                     sections_names_[current_section_]);
+
+            // Section that stays wet until the next cycle is skipped, the others get time for
+            // the expected shortfall
+            auto plan = forecast(current_section_, moisture, 0);
+            if (plan.planned_seconds == 0) {
+                ESP_LOGI(TAG,
+                         "Section %d %s is wet enough, %f expected at the next cycle",
+                         current_section_,
+                         sections_names_[current_section_],
+                         plan.moisture_day_after);
+                set_next_section();
+                continue;
+            }
+
+            // Soil gets wet, drying starts over
+            drying_[current_section_].restart();
+
+            // Volume is scaled like time, duration stays the cap as flow is not guaranteed
+            float fraction = (float)plan.planned_seconds / sections_time_[current_section_];
+            float litres = sections_target_litres_[current_section_] * fraction;
+            int seconds = plan.planned_seconds;
+            if (flow_ && litres > 0) {
+                seconds = sections_time_[current_section_];
             }
+
+            scheduled_ = make_job(JobPriority::Scheduled, current_section_, seconds, litres);
+#if TESTING
+            scheduled_->left_us = 10 * 1000 * 1000;
+#endif
         }
 
-        if (data) {
-            auto msg = *data;
-            handle_watering(msg);
+        if (co_await water(*scheduled_)) {
+            scheduled_.reset();
+            set_next_section();
         }
     }
+
+    clear_backstop();
+    running_ = false;
 }
 
-void Watering::handle_watering(const Message& msg) {
-    switch (msg.type) {
-        case Message::Type::Alarm1Expired: {
-            turn_off_valves();
+void Watering::end_cycle() {
+    ESP_LOGI(TAG, "Watering finished");
+    cycle_pending_ = false;
+    scheduled_.reset();
+    prefetched_.reset();
+    prefetching_ = -1;
 
-            // Check if section requires watering
-            auto req = Message{};
-            req.type = Message::Type::MoistureReq;
-            req.section = current_section_;
+    // First section of the next cycle
+    current_section_ = SECTION_SIZE;
+    set_next_section();
+
+#if TESTING
+    struct tm alarm_tm = {};
+    time_t now;
+    time(&now);
 
-            moisture_->send(req);
+    // Start in next 5 seconds
+    now += 5;
 
-            return;
+    localtime_r(&now, &alarm_tm);
+    set_the_alarm(alarm_tm);
+    announce_read(now, true);
+#else
+    // Alarm 1 fires again tomorrow, probes get ready for it the same way
+    announce_read(next_cycle(), true);
+#endif
+}
+
+Task<bool> Watering::water(Job& job) {
+    active_ = &job;
+
+    // Next section of the cycle is read while this one waters
+    int next = SECTION_SIZE;
+    if (job.priority == JobPriority::Scheduled) {
+        next = next_enabled_section(job.section);
+    }
+    bool prefetched = prefetching_ == next || (prefetched_ && prefetched_->section == next);
+    bool prefetch_pending = next < SECTION_SIZE && !prefetched;
+    int64_t prefetch_us = 0;
+
+    bool done = false;
+
+    for (;;) {
+        if (stop_requested_) {
+            break;
         }
-        case Message::Type::Alarm2Expired: {
-            ESP_LOGI(TAG, "Time expired for section %d", current_section_);
-            switch_to_next_section();
-            return;
+
+        if (preempts(job)) {
+            ESP_LOGI(TAG, "Section %d gives way to job %" PRIu32, job.section, jobs_[0].id);
+            break;
         }
-        case Message::Type::MoistureRes:
-            ESP_LOGI(
-                TAG, "Got moisture res for channel %u, moisture %f, location %s",
-                msg.section_r, msg.moisture, sections_names_[msg.section_r]);
 
+        auto timeout = portMAX_DELAY;
 
-            // TODO: define threshold
-            if (msg.moisture >= sections_wet_threshold_[msg.section_r]) {
-                // Feels wet enough
-                ESP_LOGI(TAG, "Section %d %s is wet enough!", current_section_,
-                        sections_names_[current_section_]);
+        // Paused job waits with the valve closed, for resume or stop
+        if (paused_) {
+            if (open_section_ >= 0) {
+                ESP_LOGI(TAG, "Section %d paused", job.section);
+                close_valve(job);
+            }
+        } else {
+            if (open_section_ < 0) {
+                // Paused right as it was about to end
+                if (job.left_us <= 0) {
+                    done = true;
+                    break;
+                }
 
-                switch_to_next_section();
-            } else {
-                // Keep watering
-                if (!watering_in_progress_) {
-                    ESP_LOGI(TAG, "Watering section %u", current_section_);
-                    gpio_set_level(sections_[current_section_], TURN_ON);
-                    // schedule this watering to last for that period of time
-                    // it can finish earlier, if sensor says so
-                    struct tm alarm_tm = {};
+                open_valve(job.section);
+
+                // Section ends on the esp_timer clock, Alarm 2 only guards the whole run
+                prefetch_us = std::max<int64_t>(
+                    valve_opened_us_ + job.left_us - PREFETCH_LEAD_S * 1000000LL,
+                    valve_opened_us_);
 
+                // Short job asks right away, the request itself powers the probes
+                if (prefetch_pending && prefetch_us > valve_opened_us_) {
                     time_t now;
                     time(&now);
+                    announce_read(now + (prefetch_us - valve_opened_us_) / 1000000, false);
+                }
+            }
 
-#if TESTING
-                    // Alarm 2 has minute resolution, add residual to make sure, at least one minute
-                    // passed
-                    now += 60 + now % 60;
-#else
+            auto now_us = esp_timer_get_time();
+            int64_t ends_us = valve_opened_us_ + job.left_us;
+            uint32_t since_open = flow_ ? flow_->pulses() - pulses_at_open_ : 0;
 
-                    now += sections_time_[current_section_];
+            auto outcome = job.volume.check(since_open, now_us - valve_opened_us_, job.left_us);
+            if (outcome == VolumeTarget::Outcome::Volume) {
+                ESP_LOGI(TAG, "Section %d got its water", job.section);
+                done = true;
+                break;
+            }
 
-#endif
+            if (outcome == VolumeTarget::Outcome::Cap) {
+                ESP_LOGI(TAG, "Time expired for section %d", job.section);
+                done = true;
+                break;
+            }
 
-                    localtime_r(&now, &alarm_tm);
+            // Flow so far tells when the target is reached, prefetch goes out ahead of it
+            auto eta_us = job.volume.eta_us(since_open, now_us - valve_opened_us_);
+            if (eta_us >= 0 && eta_us <= PREFETCH_LEAD_S * 1000000LL) {
+                prefetch_us = now_us;
+            }
 
-                    set_section_alarm(alarm_tm);
-                    watering_in_progress_ = true;
-                }
+            if (prefetch_pending && now_us >= prefetch_us) {
+                request_moisture(next);
+                prefetch_pending = false;
+            }
+
+            int64_t wake_us = ends_us;
+            if (prefetch_pending) {
+                wake_us = std::min(wake_us, prefetch_us);
+            }
 
-                // if (!std::isnan(msg.moisture)) {
-                //     // There is measurement available, monitor it during the watering process
-                //     xTimerStart(moisture_monitor_, 0);
-                // }
+            if (job.volume.set()) {
+                wake_us = std::min(wake_us, now_us + FLOW_CHECK_PERIOD_US);
             }
 
-            return;
+            // Rounded up to the next tick, waking early would only wait again
+            timeout = Reactor::ms_to_ticks((wake_us - now_us + 999) / 1000 + portTICK_PERIOD_MS);
+        }
+
+        // Job requests wake the loop, so pause, stop and preemption take effect at once.
+        // Single await site, the frame holds one message.
+        if (auto req = co_await reactor_.recv(*web_, Message::Type::Job, timeout)) {
+            on_job(*req, *web_);
+        }
+    }
 
-        default:
-            ESP_LOGE(TAG, "Unexpected msg %d in watering state!", (int)msg.type);
-            return;
+    // Stop closed the valve already
+    if (open_section_ >= 0) {
+        close_valve(job);
     }
+
+    active_ = nullptr;
+    co_return done;
 }
 
-std::unique_ptr<char[]> Watering::get_status() {
-    char* res = nullptr;
+void Watering::open_valve(int section) {
+    ESP_LOGI(TAG, "Watering section %u", section);
+    valves_.set(1u << section);
+    open_section_ = section;
+    valve_opened_us_ = esp_timer_get_time();
 
-    // TODO: that should be in OS or something
-    auto total = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    if (flow_) {
+        flow_->set_flowing(true);
+        pulses_at_open_ = flow_->pulses();
+    }
+    watering_in_progress_ = true;
+    status_version_.bump();
+    publish_valves(1u << section);
+}
+
+void Watering::close_valve(Job& job) {
+    // What is left goes on if the job is resumed
+    job.left_us -= esp_timer_get_time() - valve_opened_us_;
+    if (flow_) {
+        job.volume.add(flow_->pulses() - pulses_at_open_);
+    }
+
+    turn_off_valves();
+    watering_in_progress_ = false;
+    status_version_.bump();
+}
+
+Watering::Job Watering::make_job(JobPriority priority, int section, int seconds, float litres) {
+    auto job = Job{
+        .id = next_job_id_++,
+        .priority = priority,
+        .section = section,
+        .left_us = seconds * 1000000LL,
+    };
+
+    // Without a flow meter the section waters for the duration
+    if (flow_) {
+        job.volume = VolumeTarget(litres, PULSES_PER_LITRE);
+    }
+
+    return job;
+}
+
+bool Watering::preempts(const Job& job) const {
+    // Only high priority jobs interrupt, normal ones wait until the section ends
+    return jobs_count_ > 0 && jobs_[0].priority == JobPriority::High &&
+           job.priority < JobPriority::High;
+}
+
+std::optional<Watering::Job> Watering::pop_job() {
+    if (jobs_count_ == 0) {
+        return std::nullopt;
+    }
+
+    auto job = jobs_[0];
+    std::move(jobs_.begin() + 1, jobs_.begin() + jobs_count_, jobs_.begin());
+    jobs_count_--;
+    status_version_.bump();
+
+    return job;
+}
+
+void Watering::on_job(const Message& msg, Socket& requestor) {
+    Message resp = {};
+    resp.type = Message::Type::Job;
+    resp.seq = msg.seq;
+    resp.job_result = handle_job(msg);
+
+    requestor.send(resp);
+}
+
+JobResult Watering::handle_job(const Message& msg) {
+    const auto& req = msg.job_request;
+    auto res = JobResult{};
+
+    switch (req.action) {
+        case JobRequest::Action::Water:
+            res.error = queue_job(req, res.job_id);
+            break;
+
+        case JobRequest::Action::Pause:
+            if (!running_) {
+                res.error = "nothing to pause";
+            } else if (!paused_) {
+                ESP_LOGI(TAG, "Watering paused");
+                paused_ = true;
+                // Pause may take longer than the backstop allows
+                clear_backstop();
+            }
+            break;
+
+        case JobRequest::Action::Resume:
+            if (!paused_) {
+                res.error = "not paused";
+            } else {
+                ESP_LOGI(TAG, "Watering resumed");
+                paused_ = false;
+                arm_backstop();
+            }
+            break;
+
+        case JobRequest::Action::StopAll:
+            stop_all();
+
+            // Web stamped the request as it took it, time it waited there counts too
+            res.stop_latency_us = esp_timer_get_time() - req.admitted_us;
+            stop_latency_last_us_ = res.stop_latency_us;
+            stop_latency_max_us_ = std::max(stop_latency_max_us_, res.stop_latency_us);
+            break;
+    }
+
+    res.jobs_queued = jobs_count_;
+    res.paused = paused_;
+    status_version_.bump();
+
+    return res;
+}
+
+const char* Watering::queue_job(const JobRequest& req, uint32_t& id) {
+    int section = find_section(req.section_name);
+
+    if (section < 0) {
+        return "unknown section";
+    }
+
+    if (req.priority == JobPriority::Scheduled) {
+        return "invalid priority";
+    }
+
+    if (jobs_count_ >= MAX_JOBS) {
+        return "too many jobs queued";
+    }
+
+    auto job = make_job(req.priority, section, req.duration_seconds, req.target_litres);
+    push_job(job, false);
+
+    id = job.id;
+    counters_.jobs++;
+    ESP_LOGI(TAG, "Job %" PRIu32 " queued, section %d for %ds", id, section, req.duration_seconds);
+
+    start_runner();
+
+    return nullptr;
+}
+
+void Watering::push_job(const Job& job, bool first) {
+    // Ordered by priority, first come first served within the same one
+    int at = jobs_count_++;
+    for (; at > 0 && (jobs_[at - 1].priority < job.priority ||
+                      (first && jobs_[at - 1].priority == job.priority));
+         at--) {
+        jobs_[at] = jobs_[at - 1];
+    }
+
+    jobs_[at] = job;
+}
+
+void Watering::stop_all() {
+    // Valves first, the rest can wait
+    turn_off_valves();
+    watering_in_progress_ = false;
+
+    counters_.stops++;
+    jobs_count_ = 0;
+    paused_ = false;
+
+    // Runner drops the cycle and the job it was on
+    if (running_) {
+        stop_requested_ = true;
+    }
+
+    status_version_.bump();
+
+    // Runner waiting in a section sees the stop now, not when the section would end
+    reactor_.interrupt(*web_, Message::Type::Job);
+}
 
+Task<float> Watering::read_moisture(int section) {
+    if (prefetched_ && prefetched_->section == section) {
+        ESP_LOGD(TAG, "Using prefetched moisture of section %d", section);
+        auto moisture = prefetched_->moisture;
+        prefetched_.reset();
+        co_return moisture;
+    }
+
+    // Prefetch that is still on its way is awaited, not asked for again
+    prefetched_.reset();
+    if (prefetching_ != section && !request_moisture(section)) {
+        ESP_LOGE(TAG, "Moisture request for section %d not sent", section);
+        co_return nanf("");
+    }
+
+    auto res = co_await reactor_.recv(
+        *moisture_, Message::Type::MoistureRes, MOISTURE_TIMEOUT, section);
+    prefetching_ = -1;
+
+    if (!res) {
+        ESP_LOGE(TAG, "No moisture reading for section %d", section);
+        co_return nanf("");
+    }
+
+    co_return res->moisture[section];
+}
+
+bool Watering::request_moisture(int section) {
+    auto req = Message{};
+    req.type = Message::Type::MoistureReq;
+    req.section = section;
+
+    // No reply is coming, read_moisture asks again
+    if (moisture_->send(req) != pdPASS) {
+        prefetching_ = -1;
+        return false;
+    }
+
+    prefetching_ = section;
+    return true;
+}
+
+void Watering::on_prefetched(const Message& msg) {
+    // Reply that came too late for read_moisture is dropped, it is not fresh
+    if (prefetching_ < 0 || !(msg.sections & (1u << prefetching_))) {
+        return;
+    }
+
+    prefetched_ = Prefetch{.section = prefetching_, .moisture = msg.moisture[prefetching_]};
+    prefetching_ = -1;
+}
+
+void Watering::announce_read(time_t read_at, bool cycle) {
+    auto msg = Message{};
+    msg.type = Message::Type::MoistureWarmUp;
+    msg.read_at = read_at;
+    msg.cycle = cycle;
+
+    moisture_->send(msg);
+}
+
+// Time from Clock sending the alarm till valves are switched
+void Watering::track_alarm_latency(const Message& msg) {
+    alarm_latency_last_us_ = esp_timer_get_time() - msg.sent_us;
+    alarm_latency_max_us_ = std::max(alarm_latency_max_us_, alarm_latency_last_us_);
+    status_version_.bump();
+}
+
+WateringStatus Watering::get_status() {
+    WateringStatus res = {};
+
+    if (active_) {
+        res.current_section = sections_names_[active_->section];
+    } else if (current_section_ < SECTION_SIZE) {
+        res.current_section = sections_names_[current_section_];
+    }
+
+    res.in_progress = watering_in_progress_;
+    res.alarm_latency_last_us = alarm_latency_last_us_;
+    res.alarm_latency_max_us = alarm_latency_max_us_;
+    res.uptime_ms = (int64_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    // TODO: that should be in OS or something
     multi_heap_info_t info = {};
     heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
 
-    auto uptime = std::chrono::milliseconds(pdTICKS_TO_MS(xTaskGetTickCount()));
-
-    asprintf(
-        &res,
-        "WATERING\n"
-        "Current section %s (%d)\n"
-        "Watering in progress %s\n"
-        "Uptime %llddays %lldh %lldm %llds\n"
-        "RAM total %f, allocated: %f, free: %f, used: %f, largest possible block to allocate: %f",
-        sections_names_[current_section_], current_section_,
-        watering_in_progress_ ? "YEP" : "NOPE",
-        // Another crap that is missing, chrono formatter
-        std::chrono::duration_cast<std::chrono::hours>(uptime).count() / 24,
-        std::chrono::duration_cast<std::chrono::hours>(uptime).count() % 24,
-        std::chrono::duration_cast<std::chrono::minutes>(uptime).count() % 60,
-        std::chrono::duration_cast<std::chrono::seconds>(uptime).count() % 60,
-
-        total / 1024.0f,
-        info.total_allocated_bytes / 1024.0f,
-        info.total_free_bytes / 1024.0f,
-        info.total_allocated_bytes / (float)total,
-        info.largest_free_block / 1024.0f);
-
-    return std::unique_ptr<char[]>(res);
-}
-
-
-std::unique_ptr<char[]> Watering::get_configuration() {
-    char* res = nullptr;
-
-    char conf[256] = {};
-    int offset = 0;
-
-    for (int i = 0; i< SECTION_SIZE; i++) {
-        auto section_time = std::chrono::seconds(sections_time_[i]);
-        auto written = snprintf(conf + offset, 256 - offset, "%s: %lldm %llds, threshold %f%% %s, \n",
-            sections_names_[i],
-            std::chrono::duration_cast<std::chrono::minutes>(section_time).count() % 60,
-            std::chrono::duration_cast<std::chrono::seconds>(section_time).count() % 60,
-            sections_wet_threshold_[i],
-            sections_mask_[i] ? "ENABLED": "DISABLED");
-
-        offset += written;
-    }
-
-    asprintf(
-        &res,
-        "CONFIGURATION\n"
-        "Current section %s (%d)\n"
-        "Watering in progress %s\n"
-        "Sections conf:\n"
-        "%s\n"
-        ,
-        sections_names_[current_section_], current_section_,
-        watering_in_progress_ ? "YEP" : "NOPE",
-        conf
-        );
-
-    return std::unique_ptr<char[]>(res);
-}
-
-std::unique_ptr<char[]> Watering::set_configuration(Message msg) {
-    // TODO: set alarm
-    // TODO: water now given section?
-    // TODO: store in NVM
-    int section_idx = 0;
+    res.heap_total = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    res.heap_allocated = info.total_allocated_bytes;
+    res.heap_free = info.total_free_bytes;
+    res.heap_largest_block = info.largest_free_block;
 
-    for (; section_idx < SECTION_SIZE; section_idx++) {
-        if ( strncmp(sections_names_[section_idx], msg.section_name, 32) == 0 ) {
-            break;
+    time_t now;
+    time(&now);
+    float hours_ahead = std::max<time_t>(next_cycle() - now, 0) / 3600.0f;
+
+    res.sections_count = SECTION_SIZE;
+    res.flow_meter = flow_ != nullptr;
+    for (int section = 0; section < SECTION_SIZE; section++) {
+        res.litres_last_cycle[section] = litres_last_cycle_[section];
+        res.forecast[section] = forecast(section, latest_moisture_[section], hours_ahead);
+
+        if (!sections_mask_[section]) {
+            res.forecast[section].planned_seconds = 0;
         }
     }
 
-    if (section_idx == SECTION_SIZE) {
-        char *err = nullptr;
+    res.jobs_queued = jobs_count_;
+    res.paused = paused_;
+    res.stop_latency_last_us = stop_latency_last_us_;
+    res.stop_latency_max_us = stop_latency_max_us_;
+
+    res.sockets.add(clock_->status("clock"));
+    res.sockets.add(moisture_->status("moisture"));
+    res.sockets.add(web_->status("web"));
+    res.sockets.add(web_stop_->status("web_stop"));
+
+    return res;
+}
+
+time_t Watering::next_cycle() const {
+    time_t now;
+    time(&now);
+
+    // Time of day the schedule says, today or tomorrow
+    struct tm next_tm = {};
+    localtime_r(&now, &next_tm);
+    next_tm.tm_hour = schedule_.hour;
+    next_tm.tm_min = schedule_.minute;
+    next_tm.tm_sec = 0;
+
+    time_t next = mktime(&next_tm);
+    if (next <= now) {
+        next += 24 * 60 * 60;
+    }
+
+    return next;
+}
+
+SectionForecast Watering::forecast(int section, float moisture, float hours_ahead) const {
+    const auto& model = drying_[section];
+    float threshold = sections_wet_threshold_[section];
+    int configured = sections_time_[section];
+
+    auto res = SectionForecast{
+        .drying_rate = nanf(""),
+        .moisture_at_cycle = moisture,
+        .moisture_day_after = nanf(""),
+    };
+
+    // Without the model the reading decides alone, so does a probe that gives none
+    if (!model.ready() || std::isnan(moisture)) {
+        res.planned_seconds = moisture >= threshold ? 0 : configured;
+        return res;
+    }
+
+    res.drying_rate = model.rate(temperature_) * 24;
+    res.moisture_at_cycle = model.predict(moisture, hours_ahead, temperature_);
+    res.moisture_day_after =
+        model.predict(res.moisture_at_cycle, CYCLE_INTERVAL_H, temperature_);
+
+    // Following cycle decides again
+    if (res.moisture_day_after >= threshold) {
+        res.planned_seconds = 0;
+        return res;
+    }
+
+    float deficit = threshold - res.moisture_day_after;
+    float fraction = std::clamp(deficit / FULL_DEFICIT, MIN_DURATION_FRACTION, 1.0f);
+    res.planned_seconds = (int)std::lround(configured * fraction);
 
-        asprintf(
-            &err,
-            "Cannot find section named '%s'", msg.section_name
-        );
+    return res;
+}
 
-        ESP_LOGE(TAG, "%s", err);
+// Publishers are services on the same reactor, so no locking
+void Watering::on_event(void* ctx, const Event& event) {
+    auto self = (Watering*)ctx;
 
-        return std::unique_ptr<char[]>(err);
+    if (event.type == Event::Type::Moisture && event.moisture.section < SECTION_SIZE) {
+        self->latest_moisture_[event.moisture.section] = event.moisture.moisture;
+    } else if (event.type == Event::Type::Temperature) {
+        self->temperature_ = event.temperature.celsius;
     }
+}
 
-    sections_mask_[section_idx] = msg.enabled;
-    sections_time_[section_idx] = msg.duration_seconds;
-    sections_wet_threshold_[section_idx] = msg.wet_threshold;
+void Watering::sample_drying() {
+    time_t now;
+    time(&now);
+
+    for (int section = 0; section < SECTION_SIZE; section++) {
+        drying_[section].add(now, latest_moisture_[section], temperature_);
+    }
+
+    // Forecast moved on
+    status_version_.bump();
+}
+
+WateringConfiguration Watering::get_configuration() {
+    WateringConfiguration res = {};
+    res.applied = true;
+    res.version = config_version_.get();
+    res.schedule = schedule_;
+    res.sections_count = SECTION_SIZE;
+
+    for (int i = 0; i < SECTION_SIZE; i++) {
+        res.sections[i] = SectionConfiguration{
+            .name = sections_names_[i],
+            .enabled = sections_mask_[i],
+            .duration_seconds = sections_time_[i],
+            .wet_threshold = sections_wet_threshold_[i],
+            .target_litres = sections_target_litres_[i],
+        };
+    }
+
+    return res;
+}
+
+WateringConfiguration Watering::set_configuration(const SectionSettings& settings) {
+    // TODO: store in NVM
+    int section_idx = find_section(settings.name);
+
+    if (section_idx < 0) {
+        ESP_LOGE(TAG, "Cannot find section named '%.32s'", settings.name);
+
+        auto res = get_configuration();
+        res.applied = false;
+
+        return res;
+    }
+
+    apply_section(section_idx, settings);
+    config_version_.bump();
 
     return get_configuration();
 }
 
+ConfigurationResult Watering::apply_configuration(const BulkConfiguration& conf) {
+    auto reject = [this](ConfigurationResult::Status status, const char* error) {
+        ESP_LOGE(TAG, "Configuration rejected: %s", error);
+        return ConfigurationResult{
+            .status = status, .version = config_version_.get(), .error = error};
+    };
+
+    if (conf.base_version != config_version_.get()) {
+        return reject(ConfigurationResult::Status::Conflict, "configuration changed meanwhile");
+    }
+
+    if (conf.schedule.hour < 0 || conf.schedule.hour > 23 || conf.schedule.minute < 0 ||
+        conf.schedule.minute > 59) {
+        return reject(ConfigurationResult::Status::Invalid, "invalid schedule");
+    }
+
+    if (conf.sections_count != SECTION_SIZE) {
+        return reject(ConfigurationResult::Status::Invalid, "all sections must be given");
+    }
+
+    // Validate everything first, so nothing is applied if any part is wrong
+    std::array<int, SECTION_SIZE> indexes = {};
+    std::array<bool, SECTION_SIZE> seen = {};
+
+    for (int i = 0; i < SECTION_SIZE; i++) {
+        indexes[i] = find_section(conf.sections[i].name);
+
+        if (indexes[i] < 0) {
+            return reject(ConfigurationResult::Status::Invalid, "unknown section");
+        }
+
+        if (seen[indexes[i]]) {
+            return reject(ConfigurationResult::Status::Invalid, "duplicated section");
+        }
+
+        seen[indexes[i]] = true;
+    }
+
+    for (int i = 0; i < SECTION_SIZE; i++) {
+        apply_section(indexes[i], conf.sections[i]);
+    }
+
+    bool reschedule = conf.schedule.hour != schedule_.hour ||
+                      conf.schedule.minute != schedule_.minute;
+    schedule_ = conf.schedule;
+
+    if (reschedule) {
+        arm_schedule();
+    }
+
+    config_version_.bump();
+
+    ESP_LOGI(TAG,
+             "Configuration version %" PRIu32 " applied, watering at %02d:%02d",
+             config_version_.get(),
+             schedule_.hour,
+             schedule_.minute);
+
+    return ConfigurationResult{.status = ConfigurationResult::Status::Applied,
+                               .version = config_version_.get(),
+                               .error = nullptr};
+}
+
+int Watering::find_section(const char* name) {
+    for (int i = 0; i < SECTION_SIZE; i++) {
+        if (strncmp(sections_names_[i], name, sizeof(SectionSettings::name)) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void Watering::apply_section(int section, const SectionSettings& settings) {
+    sections_mask_[section] = settings.enabled;
+    sections_time_[section] = settings.duration_seconds;
+    sections_wet_threshold_[section] = settings.wet_threshold;
+    sections_target_litres_[section] = settings.target_litres;
+}
+
+int Watering::next_enabled_section(int section) const {
+    section++;
+    while (section < SECTION_SIZE && !sections_mask_[section]) {
+        section++;
+    }
+
+    return section;
+}
+
 void Watering::set_next_section() {
     if (current_section_ >= SECTION_SIZE) {
         current_section_ = 0;
@@ -296,46 +930,17 @@ void Watering::set_next_section() {
     }
 
     ESP_LOGI(TAG, "Next section selected: %d", current_section_);
-}
-
-void Watering::setup_gpio() {
-    // zero-initialize the config structure.
-    gpio_config_t io_conf = {};
-    // disable interrupt
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    // set as output mode
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    // bit mask of the pins that you want to set,e.g.GPIO18/19
-    io_conf.pin_bit_mask = GPIO_SEL_14;
-    // disable pull-down mode
-    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    // disable pull-up mode
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    // configure GPIO with the given settings
-    ESP_ERROR_CHECK(gpio_config(&io_conf));
-    ESP_ERROR_CHECK(gpio_set_level(SECTION_VEGS, TURN_OFF));
-
-    io_conf.pin_bit_mask = GPIO_SEL_27;
-    ESP_ERROR_CHECK(gpio_config(&io_conf));
-    ESP_ERROR_CHECK(gpio_set_level(SECTION_TERRACE, TURN_OFF));
-
-    io_conf.pin_bit_mask = GPIO_SEL_26;
-    ESP_ERROR_CHECK(gpio_config(&io_conf));
-    ESP_ERROR_CHECK(gpio_set_level(SECTION_FLOWERS, TURN_OFF));
-
-    io_conf.pin_bit_mask = GPIO_SEL_33;
-    ESP_ERROR_CHECK(gpio_config(&io_conf));
-    ESP_ERROR_CHECK(gpio_set_level(SECTION_GRASS, TURN_OFF));
+    status_version_.bump();
 }
 
 void Watering::say_hello() {
-    for (auto section : sections_) {
-        gpio_set_level(section, TURN_ON);
+    for (int section = 0; section < SECTION_SIZE; section++) {
+        valves_.set(1u << section);
 
         vTaskDelay(pdMS_TO_TICKS(300));
-
-        gpio_set_level(section, TURN_OFF);
     }
+
+    valves_.close_all();
 }
 
 void Watering::set_the_alarm(struct tm alarm_tm) {
@@ -348,74 +953,81 @@ void Watering::set_the_alarm(struct tm alarm_tm) {
     clock_->send(msg);
 }
 
-void Watering::set_section_alarm(struct tm alarm_tm) {
-    alarm_tm.tm_year += 1900;
-
-    auto msg = Message{};
-    msg.type = Message::Type::SetAlarm2;
-    msg.alarm_tm = alarm_tm;
+void Watering::arm_backstop() {
+    // Longest the run can take is every enabled section of the cycle watering up to its cap,
+    // and all the jobs
+    int64_t seconds = BACKSTOP_MARGIN_S;
+    if (cycle_pending_) {
+        for (int section = 0; section < SECTION_SIZE; section++) {
+            if (sections_mask_[section]) {
+                seconds += sections_time_[section];
+            }
+        }
+    }
 
-    clock_->send(msg);
-}
+    if (active_) {
+        seconds += active_->left_us / 1000000;
+    }
 
-void Watering::turn_off_valves() {
-    ESP_LOGI(TAG, "Disabling valves");
-    for (auto section : sections_) {
-        gpio_set_level(section, TURN_OFF);
+    for (int i = 0; i < jobs_count_; i++) {
+        seconds += jobs_[i].left_us / 1000000;
     }
-}
 
-void Watering::on_moisture_monitor_expire() {
-    // Check if section still requires watering
-    auto req = Message{};
-    req.type = Message::Type::MoistureReq;
-    req.section = current_section_;
+    time_t now;
+    time(&now);
 
-    moisture_->send(req);
-}
+    // Alarm 2 has minute resolution, it expires as the minute starts
+    now += seconds + 60;
 
-void Watering::moisture_monitor_cb(TimerHandle_t timer) {
-    ESP_LOGI("moisture_timer_cb", "Timer expired!");
-    // Naming is unfortunate, we need to live with it
-    auto service = (Watering*)pvTimerGetTimerID(timer);
+    struct tm alarm_tm = {};
+    localtime_r(&now, &alarm_tm);
 
-    service->on_moisture_monitor_expire();
+    set_backstop_alarm(alarm_tm);
 }
 
-void Watering::switch_to_next_section() {
-    xTimerStop(moisture_monitor_, 0);
-    turn_off_valves();
-    watering_in_progress_ = false;
-    set_next_section();
+void Watering::clear_backstop() {
+    auto msg = Message{};
+    msg.type = Message::Type::ClearAlarm2;
 
-    if (current_section_ < SECTION_SIZE) {
-        ESP_LOGI(TAG, "Switch to next section %d", current_section_);
+    clock_->send(msg);
+}
 
-        // Check if next section requires watering
-        auto req = Message{};
-        req.type = Message::Type::MoistureReq;
-        req.section = current_section_;
+void Watering::set_backstop_alarm(struct tm alarm_tm) {
+    alarm_tm.tm_year += 1900;
 
-        moisture_->send(req);
-    } else {
-        ESP_LOGI(TAG, "Watering finished");
+    auto msg = Message{};
+    msg.type = Message::Type::SetAlarm2;
+    msg.alarm_tm = alarm_tm;
 
-        set_next_section();
+    clock_->send(msg);
+}
 
-#if TESTING
-        struct tm alarm_tm = {};
-        time_t now;
-        time(&now);
+void Watering::turn_off_valves() {
+    ESP_LOGI(TAG, "Disabling valves");
+    valves_.close_all();
+
+    if (open_section_ >= 0) {
+        counters_.valve_open_ms[open_section_] +=
+            (uint32_t)((esp_timer_get_time() - valve_opened_us_) / 1000);
+        if (flow_) {
+            auto ml = (uint64_t)(flow_->pulses() - pulses_at_open_) * 1000 / PULSES_PER_LITRE;
+            counters_.water_ml[open_section_] += ml;
+            litres_last_cycle_[open_section_] += ml / 1000.0f;
+        }
 
-        // Start in next 5 seconds
-        now += 5;
+        open_section_ = -1;
+    }
 
-        localtime_r(&now, &alarm_tm);
-        set_the_alarm(alarm_tm);
-#endif
+    if (flow_) {
+        flow_->set_flowing(false);
     }
 
-    auto clear_alarm = Message{};
-    clear_alarm.type = Message::Type::ClearAlarm2;
-    clock_->send(clear_alarm);
-}
\ No newline at end of file
+    publish_valves(0);
+}
+
+void Watering::publish_valves(uint32_t open_mask) {
+    auto event = Event{.type = Event::Type::Valves, .time_us = esp_timer_get_time()};
+    event.valves.open_mask = open_mask;
+
+    events_.publish(event);
+}
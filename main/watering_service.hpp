@@ -1,17 +1,40 @@
 #pragma once
+#include "drying_model.hpp"
 #include "service_base.hpp"
+#include "pcnt_flow_meter.hpp"
+#include "simulated_flow_meter.hpp"
+#include "service_counters.hpp"
+#include "valve_bank.hpp"
+#include "volume_target.hpp"
 
 #include <driver/gpio.h>
 #include <array>
 #include <memory>
-#include <freertos/timers.h>
+#include <optional>
 #include "moisture_service.hpp"
 
 class Watering : public ServiceBase {
  public:
-    Watering(SockPtr clock, SockPtr moisture, SockPtr web);
+    Watering(Reactor& reactor,
+             EventBus& events,
+             SockPtr clock,
+             SockPtr moisture,
+             SockPtr web,
+             SockPtr web_stop);
 
-    void run_service();
+    void start() override;
+
+    /// Creates the cycle coroutines and drops them unstarted, so their frames go through the
+    /// allocator once and the boot memory report shows the largest one
+    void probe_frames();
+
+    const StateVersion& configuration_version() const {
+        return config_version_;
+    }
+
+    const WateringCounters& counters() const {
+        return counters_;
+    }
 
  private:
     static const gpio_num_t SECTION_VEGS = (gpio_num_t)14;
@@ -20,6 +43,32 @@ class Watering : public ServiceBase {
     static const gpio_num_t SECTION_GRASS = (gpio_num_t)33;
 
    static const int SECTION_SIZE = 4;
+   static_assert(SECTION_SIZE <= MAX_SECTIONS);
+   // Moisture replies carry a reading per channel
+   static_assert(SECTION_SIZE <= MAX_CHANNELS);
+   static constexpr TickType_t MOISTURE_TIMEOUT = pdMS_TO_TICKS(1000);
+   // Reading of the next section is asked for this long before the current section ends
+   static const int PREFETCH_LEAD_S = 60;
+
+   // Cycle plans for the drying until the following one
+   static const int CYCLE_INTERVAL_H = 24;
+   // Expected shortfall below threshold that gets the whole configured time
+   static constexpr float FULL_DEFICIT = 0.1f;
+   // Least part of the configured time a watered section gets
+   static constexpr float MIN_DURATION_FRACTION = 0.25f;
+   static constexpr TickType_t DRYING_SAMPLE_PERIOD = pdMS_TO_TICKS(60 * 60 * 1000);
+
+#if CONFIG_GARDEN_FLOW_METER_PCNT || CONFIG_GARDEN_FLOW_METER_SIMULATED
+   static const uint32_t PULSES_PER_LITRE = CONFIG_GARDEN_FLOW_PULSES_PER_LITRE;
+#else
+   static const uint32_t PULSES_PER_LITRE = 1;
+#endif
+   // How often the volume is checked while a section waters by volume
+   static const int64_t FLOW_CHECK_PERIOD_US = 1000 * 1000;
+   // Added to the longest run before the RTC backstop closes the valves
+   static const int BACKSTOP_MARGIN_S = 5 * 60;
+   // Manual jobs waiting, more are refused
+   static const int MAX_JOBS = 4;
 
    static constexpr std::array<gpio_num_t, SECTION_SIZE> sections_ = {SECTION_VEGS, SECTION_FLOWERS, SECTION_TERRACE, SECTION_GRASS};
    static constexpr std::array<const char *, SECTION_SIZE> sections_names_ = {"Vegetables", "Flowers", "Terrace", "Grass"};
@@ -27,6 +76,9 @@ class Watering : public ServiceBase {
 
    std::array<bool, SECTION_SIZE> sections_mask_ = {true, false, false, false};
 
+   // 0 waters for the duration, otherwise the duration is a cap
+   std::array<float, SECTION_SIZE> sections_target_litres_ = {};
+
    // each section can have different threshold
    std::array<float, SECTION_SIZE> sections_wet_threshold_ = {
       /*vegetables */ 0.6,
@@ -37,34 +89,148 @@ class Watering : public ServiceBase {
 
     // TODO: add pulldown resistor?
     static const int TURN_ON = 0;
-    static const int TURN_OFF = 1;
 
-    void say_hello();
+    ValveBank valves_{sections_.data(), SECTION_SIZE, TURN_ON};
 
-    void setup_gpio();
+    void say_hello();
 
     void update_state(const Message& msg);
 
     void set_the_alarm(struct tm alarm_tm);
     void turn_off_valves();
-    void set_section_alarm(struct tm alarm_tm);
-    void on_moisture_monitor_expire();
-    void switch_to_next_section();
-
-    static void moisture_monitor_cb(TimerHandle_t timer);
-
-    void handle_watering(const Message& msg);
-
-    std::unique_ptr<char[]> get_status();
-    std::unique_ptr<char[]> get_configuration();
-    std::unique_ptr<char[]> set_configuration(Message msg);
+    void publish_valves(uint32_t open_mask);
+    // Alarm 2 guards the whole run, should it overrun with a valve open
+    void arm_backstop();
+    void clear_backstop();
+    void set_backstop_alarm(struct tm alarm_tm);
+
+    void on_alarm1(const Message& msg);
+    static void on_event(void* ctx, const Event& event);
+    void sample_drying();
+    // Wall clock time the schedule starts the next cycle
+    time_t next_cycle() const;
+    // Plan of a section with given moisture now, for a cycle hours ahead
+    SectionForecast forecast(int section, float moisture, float hours_ahead) const;
+    /// Watering of a section, a scheduled one or asked for. Time and volume left are kept, so
+    /// a job that gets interrupted goes on where it stopped.
+    struct Job {
+        uint32_t id;
+        JobPriority priority;
+        int section;
+        int64_t left_us;
+        // Not set waters for the time
+        VolumeTarget volume;
+    };
+
+    // Spawns the runner unless it runs already
+    void start_runner();
+    // Waters queued jobs and the pending cycle, until there is nothing left
+    Task<> run();
+    void end_cycle();
+    // True once the job is done, false if it was interrupted or watering stopped
+    Task<bool> water(Job& job);
+    void open_valve(int section);
+    void close_valve(Job& job);
+    Job make_job(JobPriority priority, int section, int seconds, float litres);
+    // True if a queued job should interrupt the one watering
+    bool preempts(const Job& job) const;
+    // First goes ahead of the jobs of the same priority
+    void push_job(const Job& job, bool first);
+    std::optional<Job> pop_job();
+
+    // Reply goes back on the socket the request came on
+    void on_job(const Message& msg, Socket& requestor);
+    JobResult handle_job(const Message& msg);
+    // Error, or null if queued
+    const char* queue_job(const JobRequest& req, uint32_t& id);
+    // Closes all valves at once, the runner drops what it was doing
+    void stop_all();
+
+    Task<float> read_moisture(int section);
+    // Sends MoistureReq, reply is awaited by read_moisture or kept by on_prefetched. False if
+    // the request was dropped.
+    bool request_moisture(int section);
+    void on_prefetched(const Message& msg);
+    // Tells Moisture when the next read comes, so it has the probes powered and sampled. Cycle
+    // is the read that starts the next daily cycle.
+    void announce_read(time_t read_at, bool cycle);
+    void track_alarm_latency(const Message& msg);
+
+    WateringStatus get_status();
+    WateringConfiguration get_configuration();
+    WateringConfiguration set_configuration(const SectionSettings& settings);
+    ConfigurationResult apply_configuration(const BulkConfiguration& conf);
+
+    // Index of the section, -1 if there is none of that name
+    int find_section(const char* name);
+    void apply_section(int section, const SectionSettings& settings);
+    void arm_schedule();
 
     void set_next_section();
+    // SECTION_SIZE if none follows
+    int next_enabled_section(int section) const;
 
     int current_section_;
     bool watering_in_progress_;
     SockPtr clock_;
     SockPtr moisture_;
     SockPtr web_;
-    TimerHandle_t moisture_monitor_;
+    // Stop only, on the control lane, so it does not queue behind web requests
+    SockPtr web_stop_;
+    // Runner coroutine is alive
+    bool running_ = false;
+    // Alarm 1 came, runner goes through the sections after manual jobs
+    bool cycle_pending_ = false;
+    bool paused_ = false;
+    bool stop_requested_ = false;
+
+    // Ordered by priority, one more than accepted, for the interrupted job put back
+    std::array<Job, MAX_JOBS + 1> jobs_ = {};
+    int jobs_count_ = 0;
+    uint32_t next_job_id_ = 1;
+    // Section of the cycle being watered, kept while a manual job interrupts it
+    std::optional<Job> scheduled_;
+    // Job watering now, null if none
+    Job* active_ = nullptr;
+
+    int64_t stop_latency_last_us_ = 0;
+    int64_t stop_latency_max_us_ = 0;
+
+    // Reading of the section that waters next, asked for while the current one waters
+    struct Prefetch {
+        int section;
+        float moisture;
+    };
+    std::optional<Prefetch> prefetched_;
+    // Section whose reading was asked for and did not arrive yet, -1 if none
+    int prefetching_ = -1;
+
+    // Start of the watering cycle
+    Schedule schedule_ = {.hour = 18, .minute = 30};
+    StateVersion config_version_;
+
+    std::array<DryingModel, SECTION_SIZE> drying_;
+    // Last reading of each section Moisture published, NaN if none yet
+    std::array<float, SECTION_SIZE> latest_moisture_;
+    // From the RTC, NaN if unknown
+    float temperature_;
+
+    int64_t alarm_latency_last_us_ = 0;
+    int64_t alarm_latency_max_us_ = 0;
+
+#if CONFIG_GARDEN_FLOW_METER_PCNT
+    PcntFlowMeter flow_meter_{(gpio_num_t)CONFIG_GARDEN_FLOW_METER_GPIO};
+#elif CONFIG_GARDEN_FLOW_METER_SIMULATED
+    SimulatedFlowMeter flow_meter_{CONFIG_GARDEN_FLOW_SIMULATED_LPM * PULSES_PER_LITRE};
+#endif
+    // Null without a working flow meter
+    FlowMeter* flow_ = nullptr;
+    // Meter reading when the valve opened
+    uint32_t pulses_at_open_ = 0;
+    std::array<float, SECTION_SIZE> litres_last_cycle_ = {};
+
+    // Section with the valve open, -1 if all are closed
+    int open_section_ = -1;
+    int64_t valve_opened_us_ = 0;
+    WateringCounters counters_;
 };
\ No newline at end of file
@@ -1,13 +1,55 @@
 #include "web_server.hpp"
 
+#include "chunk_writer.hpp"
+#include "json_reader.hpp"
+#include "json_writer.hpp"
+#include "static_alloc.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <esp_app_desc.h>
 #include <esp_http_server.h>
+#include <esp_random.h>
 #include <esp_system.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
 
 #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
 #include <esp_log.h>
-#include "cJSON.h"
 static const char* TAG = "Webserver";
 
+// How long web waits for the service to reply
+static const TickType_t REPLY_TIMEOUT = pdMS_TO_TICKS(500);
+
+// Socket timeouts tolerated while receiving the request body
+static const int RECV_RETRIES = 3;
+
+static const int MAX_DURATION_SECONDS = 24 * 60 * 60;
+static const int MAX_TARGET_LITRES = 10000;
+
+// Status also carries time, uptime and counters, which change without a version bump. Those are
+// refreshed at least this often.
+static const int64_t STATUS_ETAG_PERIOD_US = 60 * 1000 * 1000;
+
+static const size_t ETAG_SIZE = 48;
+
+// Dashboard only changes with the firmware, revalidated once a day
+static const char* DASHBOARD_CACHE_CONTROL = "public, max-age=86400";
+
+// Dashboard, compressed at build time, mapped from flash
+extern const uint8_t dashboard_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t dashboard_gz_end[] asm("_binary_index_html_gz_end");
+
+// Limits per client, status is polled by the dashboard, configuration changes are rare
+static const RateLimiter::Limit STATUS_LIMIT = {.burst = 5, .period_ms = 1000};
+static const RateLimiter::Limit CONFIGURATION_READ_LIMIT = {.burst = 5, .period_ms = 1000};
+static const RateLimiter::Limit CONFIGURATION_WRITE_LIMIT = {.burst = 3, .period_ms = 5000};
+// Stop has a path of its own and no limit, see stop_post_handler
+static const RateLimiter::Limit JOBS_LIMIT = {.burst = 5, .period_ms = 1000};
+
 /* version GET handler */
 static esp_err_t version_get_handler(httpd_req_t* req) {
     /* Send response with custom headers and body set as the
@@ -21,215 +63,1518 @@ static esp_err_t version_get_handler(httpd_req_t* req) {
     return ESP_OK;
 }
 
-/* status GET handler */
-static esp_err_t status_get_handler(httpd_req_t* req) {
-    /* Send response with custom headers and body set as the
-     * string passed in user context*/
+static void write_sockets(JsonWriter& json, const SocketList& sockets) {
+    json.begin_array("sockets");
+
+    for (int i = 0; i < sockets.count; i++) {
+        const auto& socket = sockets.items[i];
+
+        json.begin_object();
+        json.string("name", socket.name);
+        json.integer("depth", socket.depth);
+        json.integer("sent", socket.delivery.sent);
+        json.integer("dropped", socket.delivery.dropped);
+        json.integer("evicted", socket.delivery.evicted);
+        json.integer("coalesced", socket.delivery.coalesced);
+        json.integer("high_water", socket.delivery.high_water);
+        json.integer("rcv_timeouts", socket.delivery.rcv_timeouts);
+        json.end_object();
+    }
+
+    json.end_array();
+}
+
+static void write_clock(JsonWriter& json, const ClockStatus& status) {
+    json.begin_object("clock");
+
+    if (status.time_valid) {
+        json.time("time", status.time);
+    } else {
+        json.null("time");
+    }
+
+    if (status.temperature_valid) {
+        json.number("temperature", status.temperature, 2);
+    } else {
+        json.null("temperature");
+    }
+
+    json.begin_object("alarm1");
+    json.boolean("set", status.alarm1_set);
+    json.time("time", status.alarm1, "%H:%M:%S");
+    json.end_object();
+
+    json.begin_object("alarm2");
+    json.boolean("set", status.alarm2_set);
+    json.time("time", status.alarm2, "%H:%M:%S");
+    json.end_object();
+
+    json.integer("status_reg", status.status_reg);
+    json.integer("control_reg", status.control_reg);
+    json.integer("irq_latency_max_us", status.irq_latency_max_us);
+
+    write_sockets(json, status.sockets);
+
+    json.end_object();
+}
+
+static void write_moisture(JsonWriter& json, const MoistureStatus& status) {
+    json.begin_object("moisture");
+    json.begin_array("channels");
+
+    for (int i = 0; i < status.channels_count; i++) {
+        const auto& channel = status.channels[i];
+
+        json.begin_object();
+        json.integer("section", i);
+        json.integer("raw", channel.raw);
+        json.integer("voltage_mv", channel.voltage);
+        json.number("moisture", channel.moisture);
+        json.number("confidence", channel.confidence, 2);
+
+        json.begin_object("calibration");
+        json.integer("dry_raw", channel.calibration.dry_raw);
+        json.integer("wet_raw", channel.calibration.wet_raw);
+        json.end_object();
+
+        json.end_object();
+    }
+
+    json.end_array();
+    write_sockets(json, status.sockets);
+    json.end_object();
+}
+
+static void write_watering(JsonWriter& json, const WateringStatus& status) {
+    json.begin_object("watering");
+    json.string("current_section", status.current_section);
+    json.boolean("in_progress", status.in_progress);
+    json.integer("alarm_latency_last_us", status.alarm_latency_last_us);
+    json.integer("alarm_latency_max_us", status.alarm_latency_max_us);
+    json.integer("uptime_ms", status.uptime_ms);
+
+    json.begin_object("heap");
+    json.integer("total", status.heap_total);
+    json.integer("allocated", status.heap_allocated);
+    json.integer("free", status.heap_free);
+    json.integer("largest_block", status.heap_largest_block);
+    json.end_object();
+
+    json.begin_array("forecast");
+    for (int i = 0; i < status.sections_count; i++) {
+        const auto& forecast = status.forecast[i];
+        json.begin_object();
+        json.number("drying_rate", forecast.drying_rate);
+        json.number("moisture_at_cycle", forecast.moisture_at_cycle);
+        json.number("moisture_day_after", forecast.moisture_day_after);
+        json.integer("planned_seconds", forecast.planned_seconds);
+        json.end_object();
+    }
+    json.end_array();
+
+    json.integer("jobs_queued", status.jobs_queued);
+    json.boolean("paused", status.paused);
+    json.integer("stop_latency_last_us", status.stop_latency_last_us);
+    json.integer("stop_latency_max_us", status.stop_latency_max_us);
+
+    if (status.flow_meter) {
+        json.begin_array("litres_last_cycle");
+        for (int i = 0; i < status.sections_count; i++) {
+            json.number(nullptr, status.litres_last_cycle[i]);
+        }
+        json.end_array();
+    } else {
+        json.null("litres_last_cycle");
+    }
+
+    write_sockets(json, status.sockets);
+    json.end_object();
+}
+
+static void write_configuration(JsonWriter& json, const WateringConfiguration& conf) {
+    json.begin_object();
+    json.integer("version", conf.version);
+
+    json.begin_object("schedule");
+    json.integer("hour", conf.schedule.hour);
+    json.integer("minute", conf.schedule.minute);
+    json.end_object();
+
+    json.begin_array("sections");
+
+    for (int i = 0; i < conf.sections_count; i++) {
+        const auto& section = conf.sections[i];
+
+        json.begin_object();
+        json.string("section_name", section.name);
+        json.boolean("enabled", section.enabled);
+        json.integer("duration_seconds", section.duration_seconds);
+        json.number("wet_threshold", section.wet_threshold);
+        json.number("target_litres", section.target_litres);
+        json.end_object();
+    }
+
+    json.end_array();
+    json.end_object();
+}
+
+static bool etag_matches(const char* if_none_match, const char* etag) {
+    if (strcmp(if_none_match, "*") == 0) {
+        return true;
+    }
+
+    // Weak comparison, list of tags is fine as long as ours is there
+    if (strncmp(etag, "W/", 2) == 0) {
+        etag += 2;
+    }
+
+    return strstr(if_none_match, etag) != nullptr;
+}
+
+/// Sets ETag and answers 304 if the client has current representation already. Returns true if
+/// the request was answered. Tag is referenced by the response, it must outlive the handler.
+static bool not_modified(httpd_req_t* req,
+                         const char* etag,
+                         const char* cache_control = "no-cache") {
+    httpd_resp_set_hdr(req, "ETag", etag);
+    // By default let the client cache it, but always revalidate
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+
+    char if_none_match[ETAG_SIZE * 2] = {};
+
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) !=
+        ESP_OK) {
+        return false;
+    }
+
+    if (!etag_matches(if_none_match, etag)) {
+        return false;
+    }
+
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_send(req, nullptr, 0);
+
+    return true;
+}
+
+#if CONFIG_GARDEN_WEB_RATE_LIMIT
+// Address of the client, IPv4 one as IPv4-mapped IPv6
+static RateLimiter::Address client_address(httpd_req_t* req) {
+    RateLimiter::Address res = {};
+
+    struct sockaddr_storage addr = {};
+    socklen_t len = sizeof(addr);
+
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr*)&addr, &len) != 0) {
+        ESP_LOGW(TAG, "Cannot get client address");
+        return res;
+    }
+
+    if (addr.ss_family == AF_INET) {
+        auto* in = (struct sockaddr_in*)&addr;
+        res[10] = 0xff;
+        res[11] = 0xff;
+        memcpy(&res[12], &in->sin_addr, 4);
+    }
+#if CONFIG_LWIP_IPV6
+    else if (addr.ss_family == AF_INET6) {
+        auto* in6 = (struct sockaddr_in6*)&addr;
+        memcpy(res.data(), &in6->sin6_addr, res.size());
+    }
+#endif
+
+    return res;
+}
+#endif
+
+/* status GET, runs on a worker */
+static esp_err_t status_get_async(httpd_req_t* req) {
     auto* ctx = (WebServer*)req->user_ctx;
 
+    char etag[ETAG_SIZE] = {};
+    ctx->status_etag(etag, sizeof(etag));
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    // Each part is written out as soon as it arrives, services that did not reply are null
+    ChunkWriter out(req, &ctx->get_metrics(WebServer::Endpoint::Status).bytes_sent);
+    JsonWriter json(out);
+    json.begin_object();
+
     ESP_LOGD(TAG, "Get clock status...");
-    auto resp = ctx->get_clock_status();
+    if (auto status = ctx->get_clock_status()) {
+        write_clock(json, *status);
+    } else {
+        json.null("clock");
+    }
 
     ESP_LOGD(TAG, "Get moisture status...");
-    resp += ctx->get_moisture_status();
+    if (auto status = ctx->get_moisture_status()) {
+        write_moisture(json, *status);
+    } else {
+        json.null("moisture");
+    }
 
     ESP_LOGD(TAG, "Get watering status...");
-    resp += ctx->get_watering_status();
+    if (auto status = ctx->get_watering_status()) {
+        write_watering(json, *status);
+    } else {
+        json.null("watering");
+    }
 
-    ESP_LOGD(TAG, "system status response '%s'", resp.c_str());
+    json.begin_object("web");
+    write_sockets(json, ctx->get_sockets_status());
 
-    // TODO: be a json someday
-    httpd_resp_send(req, resp.c_str(), HTTPD_RESP_USE_STRLEN);
+    json.integer("rejected_by_workers", ctx->get_rejected_by_workers());
 
-    return ESP_OK;
+    json.begin_object("rate_limited");
+    json.integer("status", ctx->get_rate_limiter(WebServer::Endpoint::Status).limited());
+    json.integer("configuration_read",
+                 ctx->get_rate_limiter(WebServer::Endpoint::ConfigurationRead).limited());
+    json.integer("configuration_write",
+                 ctx->get_rate_limiter(WebServer::Endpoint::ConfigurationWrite).limited());
+    json.integer("jobs", ctx->get_rate_limiter(WebServer::Endpoint::Jobs).limited());
+    json.end_object();
+
+    auto events = ctx->get_event_stream().stats();
+    json.begin_object("events");
+    json.integer("clients", events.clients);
+    json.integer("sent", events.sent);
+    json.integer("dropped", events.dropped);
+    json.integer("evicted", events.evicted);
+    json.end_object();
+
+    json.end_object();
+
+    json.begin_object("reactor");
+    ctx->get_reactor().write_stats(json);
+    json.end_object();
+
+    json.end_object();
+
+    return out.finish();
+}
+
+/* status GET handler, answers 304 right away, services are asked on a worker */
+static esp_err_t status_get_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    char etag[ETAG_SIZE] = {};
+    ctx->status_etag(etag, sizeof(etag));
+
+    if (not_modified(req, etag)) {
+        return ESP_OK;
+    }
+
+    return ctx->admit(req, WebServer::Endpoint::Status, status_get_async);
+}
+
+/* dashboard GET handler, page is sent straight from flash, already compressed */
+static esp_err_t dashboard_get_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    if (not_modified(req, ctx->get_dashboard_etag(), DASHBOARD_CACHE_CONTROL)) {
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+    return httpd_resp_send(
+        req, (const char*)dashboard_gz_start, dashboard_gz_end - dashboard_gz_start);
+}
+
+/* metrics GET handler, served on the server task, nothing there waits for services */
+static esp_err_t metrics_get_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    ChunkWriter out(req);
+    ctx->write_metrics(out);
+
+    return out.finish();
+}
+
+/* events WebSocket handler */
+static esp_err_t events_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    return ctx->get_event_stream().handle(req);
+}
+
+/* configuration GET, runs on a worker */
+static esp_err_t configuration_get_async(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    // Version read before the configuration, if it changes meanwhile the client just gets
+    // a fresh tag on the next request
+    char etag[ETAG_SIZE] = {};
+    ctx->configuration_etag(etag, sizeof(etag));
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    ESP_LOGD(TAG, "Get watering configuration...");
+    auto conf = ctx->get_watering_configuration();
+
+    if (!conf) {
+        return httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to get watering configuration");
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    ChunkWriter out(req, &ctx->get_metrics(WebServer::Endpoint::ConfigurationRead).bytes_sent);
+    JsonWriter json(out);
+    write_configuration(json, *conf);
+
+    return out.finish();
 }
 
 /* configuration GET handler */
 static esp_err_t configuration_get_handler(httpd_req_t* req) {
-    /* Send response with custom headers and body set as the
-     * string passed in user context*/
     auto* ctx = (WebServer*)req->user_ctx;
 
-    ESP_LOGD(TAG, "Get watering configuration...");
-    auto resp = ctx->get_watering_configuration();
+    char etag[ETAG_SIZE] = {};
+    ctx->configuration_etag(etag, sizeof(etag));
+
+    if (not_modified(req, etag)) {
+        return ESP_OK;
+    }
 
-    ESP_LOGD(TAG, "get configuration response '%s'", resp.c_str());
+    return ctx->admit(req, WebServer::Endpoint::ConfigurationRead, configuration_get_async);
+}
 
-    // TODO: be a json someday
-    httpd_resp_send(req, resp.c_str(), HTTPD_RESP_USE_STRLEN);
+// Feeds the parser straight from the socket, body is never held in memory as a whole
+static int recv_body(void* ctx, char* buf, size_t len) {
+    auto* req = (httpd_req_t*)ctx;
 
-    return ESP_OK;
+    for (int retry = 0; retry < RECV_RETRIES; retry++) {
+        int ret = httpd_req_recv(req, buf, len);
+
+        if (ret != HTTPD_SOCK_ERR_TIMEOUT) {
+            return ret;
+        }
+    }
+
+    return HTTPD_SOCK_ERR_TIMEOUT;
 }
 
+static const char* parse_error(const JsonReader& reader, const char* error) {
+    return reader.error() ? reader.error() : error;
+}
 
-/* configuration POST handler */
-static esp_err_t configuration_post_handler(httpd_req_t* req) {
+/// Decodes section object, first is the token that starts it. Returns error description on
+/// failure. Unknown members are skipped.
+static const char* parse_section(JsonReader& reader,
+                                 JsonReader::Token first,
+                                 SectionSettings& section) {
+    enum Field {
+        UNKNOWN = 0,
+        SECTION_NAME = 1 << 0,
+        ENABLED = 1 << 1,
+        DURATION_SECONDS = 1 << 2,
+        WET_THRESHOLD = 1 << 3,
+        TARGET_LITRES = 1 << 4,
+    };
+
+    if (first != JsonReader::Token::BeginObject) {
+        return parse_error(reader, "expected section object");
+    }
 
-    char content[512] = {};
-    size_t recv_size = std::min(req->content_len, sizeof(content));
-    int ret = httpd_req_recv(req, content, recv_size);
+    int seen = 0;
+    // Optional, sections water for the duration unless told otherwise
+    section.target_litres = 0;
+
+    for (auto token = reader.next(); token != JsonReader::Token::EndObject; token = reader.next()) {
+        if (token != JsonReader::Token::Key) {
+            return parse_error(reader, "expected member name");
+        }
+
+        // Value token overwrites the key text
+        Field field = UNKNOWN;
+        if (strcmp(reader.text(), "section_name") == 0) {
+            field = SECTION_NAME;
+        } else if (strcmp(reader.text(), "enabled") == 0) {
+            field = ENABLED;
+        } else if (strcmp(reader.text(), "duration_seconds") == 0) {
+            field = DURATION_SECONDS;
+        } else if (strcmp(reader.text(), "wet_threshold") == 0) {
+            field = WET_THRESHOLD;
+        } else if (strcmp(reader.text(), "target_litres") == 0) {
+            field = TARGET_LITRES;
+        }
+
+        token = reader.next();
+
+        switch (field) {
+            case SECTION_NAME:
+                if (token != JsonReader::Token::String) {
+                    return parse_error(reader, "section_name must be a string");
+                }
+
+                if (reader.truncated() || strlen(reader.text()) >= sizeof(section.name)) {
+                    return "section_name too long";
+                }
+
+                strcpy(section.name, reader.text());
+                break;
+
+            case ENABLED:
+                if (token != JsonReader::Token::True && token != JsonReader::Token::False) {
+                    return parse_error(reader, "enabled must be a boolean");
+                }
+
+                section.enabled = token == JsonReader::Token::True;
+                break;
+
+            case DURATION_SECONDS:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() > MAX_DURATION_SECONDS) {
+                    return parse_error(reader, "duration_seconds out of range");
+                }
+
+                section.duration_seconds = reader.number();
+                break;
+
+            case WET_THRESHOLD:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() > 1) {
+                    return parse_error(reader, "wet_threshold must be within 0..1");
+                }
+
+                section.wet_threshold = reader.number();
+                break;
+
+            case TARGET_LITRES:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() > MAX_TARGET_LITRES) {
+                    return parse_error(reader, "target_litres out of range");
+                }
+
+                section.target_litres = reader.number();
+                break;
+
+            default:
+                if (!reader.skip(token)) {
+                    return parse_error(reader, "invalid value");
+                }
+                break;
+        }
+
+        seen |= field;
+    }
 
-    if (ret <= 0) {
-        ESP_LOGD(TAG, "Failed to fetch request from configuration POST handler, status %d", ret);
-        return ESP_FAIL;
+    if (!(seen & SECTION_NAME)) {
+        return "missing section_name field";
     }
 
+    if (!(seen & ENABLED)) {
+        return "missing enabled field";
+    }
 
+    if (!(seen & DURATION_SECONDS)) {
+        return "missing duration_seconds field";
+    }
 
-    /* Send response with custom headers and body set as the
-     * string passed in user context*/
+    if (!(seen & WET_THRESHOLD)) {
+        return "missing wet_threshold field";
+    }
+
+    return nullptr;
+}
+
+static const char* parse_schedule(JsonReader& reader, JsonReader::Token first, Schedule& schedule) {
+    if (first != JsonReader::Token::BeginObject) {
+        return parse_error(reader, "expected schedule object");
+    }
+
+    schedule = Schedule{.hour = -1, .minute = -1};
+
+    for (auto token = reader.next(); token != JsonReader::Token::EndObject; token = reader.next()) {
+        if (token != JsonReader::Token::Key) {
+            return parse_error(reader, "expected member name");
+        }
+
+        int* field = nullptr;
+        if (strcmp(reader.text(), "hour") == 0) {
+            field = &schedule.hour;
+        } else if (strcmp(reader.text(), "minute") == 0) {
+            field = &schedule.minute;
+        }
+
+        token = reader.next();
+
+        if (field == nullptr) {
+            if (!reader.skip(token)) {
+                return parse_error(reader, "invalid value");
+            }
+            continue;
+        }
+
+        if (token != JsonReader::Token::Number || reader.number() < 0 || reader.number() > 59) {
+            return parse_error(reader, "schedule hour and minute must be numbers");
+        }
+
+        *field = reader.number();
+    }
+
+    // Range is validated by the service, which owns the schedule
+    if (schedule.hour < 0 || schedule.minute < 0) {
+        return "schedule needs hour and minute";
+    }
+
+    return nullptr;
+}
+
+/// Decodes {"version": n, "schedule": {...}, "sections": [{...}, ...]}
+static const char* parse_bulk_configuration(JsonReader& reader, BulkConfiguration& conf) {
+    enum Field {
+        UNKNOWN = 0,
+        VERSION = 1 << 0,
+        SCHEDULE = 1 << 1,
+        SECTIONS = 1 << 2,
+    };
+
+    if (reader.next() != JsonReader::Token::BeginObject) {
+        return parse_error(reader, "expected object");
+    }
+
+    int seen = 0;
+
+    for (auto token = reader.next(); token != JsonReader::Token::EndObject; token = reader.next()) {
+        if (token != JsonReader::Token::Key) {
+            return parse_error(reader, "expected member name");
+        }
+
+        Field field = UNKNOWN;
+        if (strcmp(reader.text(), "version") == 0) {
+            field = VERSION;
+        } else if (strcmp(reader.text(), "schedule") == 0) {
+            field = SCHEDULE;
+        } else if (strcmp(reader.text(), "sections") == 0) {
+            field = SECTIONS;
+        }
+
+        token = reader.next();
+
+        switch (field) {
+            case VERSION:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() > UINT32_MAX) {
+                    return parse_error(reader, "version must be a number");
+                }
+
+                conf.base_version = reader.number();
+                break;
+
+            case SCHEDULE:
+                if (auto* err = parse_schedule(reader, token, conf.schedule)) {
+                    return err;
+                }
+                break;
+
+            case SECTIONS:
+                if (token != JsonReader::Token::BeginArray) {
+                    return parse_error(reader, "sections must be an array");
+                }
+
+                for (token = reader.next(); token != JsonReader::Token::EndArray;
+                     token = reader.next()) {
+                    if (conf.sections_count == MAX_SECTIONS) {
+                        return "too many sections";
+                    }
+
+                    auto& section = conf.sections[conf.sections_count++];
+                    if (auto* err = parse_section(reader, token, section)) {
+                        return err;
+                    }
+                }
+                break;
+
+            default:
+                if (!reader.skip(token)) {
+                    return parse_error(reader, "invalid value");
+                }
+                break;
+        }
+
+        seen |= field;
+    }
+
+    if (reader.next() != JsonReader::Token::End) {
+        return parse_error(reader, "unexpected data after object");
+    }
+
+    if (!(seen & VERSION)) {
+        return "missing version field";
+    }
+
+    if (!(seen & SCHEDULE)) {
+        return "missing schedule field";
+    }
+
+    if (!(seen & SECTIONS)) {
+        return "missing sections field";
+    }
+
+    return nullptr;
+}
+
+/* configuration POST, runs on a worker */
+static esp_err_t configuration_post_async(httpd_req_t* req) {
     auto* ctx = (WebServer*)req->user_ctx;
 
-    ESP_LOGD(TAG, "Get watering configuration...");
-    auto resp = ctx->set_watering_configuration(std::string(content));
+    auto msg = Message{};
+    msg.type = Message::Type::SetConfiguration;
 
-    ESP_LOGD(TAG, "get configuration response '%s'", resp.c_str());
+    JsonReader reader(recv_body, req);
+    const auto* err = parse_section(reader, reader.next(), msg.section_settings);
 
-    // TODO: be a json someday
-    httpd_resp_send(req, resp.c_str(), HTTPD_RESP_USE_STRLEN);
+    if (err == nullptr && reader.next() != JsonReader::Token::End) {
+        err = parse_error(reader, "unexpected data after object");
+    }
 
-    return ESP_OK;
+    if (err) {
+        ESP_LOGW(TAG, "Invalid configuration: %s", err);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, err);
+    }
+
+    const auto& section = msg.section_settings;
+    ESP_LOGI(TAG,
+             "set configuration of %s: enabled %d, duration %ds, threshold %f",
+             section.name,
+             section.enabled,
+             section.duration_seconds,
+             section.wet_threshold);
+
+    auto conf = ctx->set_watering_configuration(msg);
+
+    if (!conf) {
+        return httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set watering configuration");
+    }
+
+    if (!conf->applied) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown section_name");
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    ChunkWriter out(req, &ctx->get_metrics(WebServer::Endpoint::ConfigurationWrite).bytes_sent);
+    JsonWriter json(out);
+    write_configuration(json, *conf);
+
+    return out.finish();
+}
+
+/* configuration PUT, runs on a worker, replaces configuration of all sections and the schedule */
+static esp_err_t configuration_put_async(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    auto msg = Message{};
+    msg.type = Message::Type::SetBulkConfiguration;
+
+    JsonReader reader(recv_body, req);
+
+    if (auto* err = parse_bulk_configuration(reader, msg.bulk_configuration)) {
+        ESP_LOGW(TAG, "Invalid configuration: %s", err);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, err);
+    }
+
+    auto result = ctx->apply_watering_configuration(msg);
+
+    if (!result) {
+        return httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to apply watering configuration");
+    }
+
+    switch (result->status) {
+        case ConfigurationResult::Status::Applied:
+            break;
+        case ConfigurationResult::Status::Conflict:
+            httpd_resp_set_status(req, "409 Conflict");
+            break;
+        case ConfigurationResult::Status::Invalid:
+            httpd_resp_set_status(req, HTTPD_400);
+            break;
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    ChunkWriter out(req, &ctx->get_metrics(WebServer::Endpoint::ConfigurationWrite).bytes_sent);
+    JsonWriter json(out);
+
+    json.begin_object();
+    json.integer("version", result->version);
+    if (result->error) {
+        json.string("error", result->error);
+    }
+    json.end_object();
+
+    return out.finish();
+}
+
+/// Decodes {"channel": n, "point": "dry" | "wet", "raw": n}, raw is optional
+static const char* parse_calibration(JsonReader& reader, CalibrationRequest& request) {
+    enum Field {
+        UNKNOWN = 0,
+        CHANNEL = 1 << 0,
+        POINT = 1 << 1,
+        RAW = 1 << 2,
+    };
+
+    if (reader.next() != JsonReader::Token::BeginObject) {
+        return parse_error(reader, "expected calibration object");
+    }
+
+    request = CalibrationRequest{.channel = -1, .raw = -1};
+    int seen = 0;
+
+    for (auto token = reader.next(); token != JsonReader::Token::EndObject; token = reader.next()) {
+        if (token != JsonReader::Token::Key) {
+            return parse_error(reader, "expected member name");
+        }
+
+        Field field = UNKNOWN;
+        if (strcmp(reader.text(), "channel") == 0) {
+            field = CHANNEL;
+        } else if (strcmp(reader.text(), "point") == 0) {
+            field = POINT;
+        } else if (strcmp(reader.text(), "raw") == 0) {
+            field = RAW;
+        }
+
+        token = reader.next();
+
+        switch (field) {
+            case CHANNEL:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() >= MAX_CHANNELS) {
+                    return parse_error(reader, "channel must be a channel number");
+                }
+                request.channel = reader.number();
+                break;
+
+            case POINT:
+                if (token != JsonReader::Token::String) {
+                    return parse_error(reader, "point must be \"dry\" or \"wet\"");
+                }
+
+                if (strcmp(reader.text(), "dry") == 0) {
+                    request.point = CalibrationRequest::Point::Dry;
+                } else if (strcmp(reader.text(), "wet") == 0) {
+                    request.point = CalibrationRequest::Point::Wet;
+                } else {
+                    return parse_error(reader, "point must be \"dry\" or \"wet\"");
+                }
+                break;
+
+            case RAW:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() > UINT16_MAX) {
+                    return parse_error(reader, "raw must be an ADC reading");
+                }
+                request.raw = reader.number();
+                break;
+
+            default:
+                if (!reader.skip(token)) {
+                    return parse_error(reader, "invalid value");
+                }
+                break;
+        }
+
+        seen |= field;
+    }
+
+    if (!(seen & CHANNEL)) {
+        return "missing channel field";
+    }
+
+    if (!(seen & POINT)) {
+        return "missing point field";
+    }
+
+    if (reader.next() != JsonReader::Token::End) {
+        return parse_error(reader, "unexpected data after object");
+    }
+
+    return nullptr;
+}
+
+/* calibration POST, runs on a worker, sets dry or wet point of a probe, by default from its
+   current reading */
+static esp_err_t calibration_post_async(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    auto msg = Message{};
+    msg.type = Message::Type::Calibrate;
+
+    JsonReader reader(recv_body, req);
+    const auto* err = parse_calibration(reader, msg.calibration_request);
+
+    if (err) {
+        ESP_LOGW(TAG, "Invalid calibration: %s", err);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, err);
+    }
+
+    auto result = ctx->calibrate_moisture(msg);
+
+    if (!result) {
+        return httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to calibrate moisture sensor");
+    }
+
+    if (result->error) {
+        httpd_resp_set_status(req, HTTPD_400);
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    ChunkWriter out(req, &ctx->get_metrics(WebServer::Endpoint::ConfigurationWrite).bytes_sent);
+    JsonWriter json(out);
+
+    json.begin_object();
+    json.integer("channel", result->channel);
+    json.integer("dry_raw", result->calibration.dry_raw);
+    json.integer("wet_raw", result->calibration.wet_raw);
+    if (result->error) {
+        json.string("error", result->error);
+    }
+    json.end_object();
+
+    return out.finish();
+}
+
+/// Decodes {"action": "water" | "pause" | "resume"}, water also takes "section_name",
+/// "duration_seconds", and optionally "target_litres" and "priority": "normal" | "high"
+static const char* parse_job(JsonReader& reader, JobRequest& request) {
+    enum Field {
+        UNKNOWN = 0,
+        ACTION = 1 << 0,
+        SECTION_NAME = 1 << 1,
+        DURATION_SECONDS = 1 << 2,
+        TARGET_LITRES = 1 << 3,
+        PRIORITY = 1 << 4,
+    };
+
+    if (reader.next() != JsonReader::Token::BeginObject) {
+        return parse_error(reader, "expected job object");
+    }
+
+    request = JobRequest{.priority = JobPriority::Normal};
+    int seen = 0;
+
+    for (auto token = reader.next(); token != JsonReader::Token::EndObject; token = reader.next()) {
+        if (token != JsonReader::Token::Key) {
+            return parse_error(reader, "expected member name");
+        }
+
+        Field field = UNKNOWN;
+        if (strcmp(reader.text(), "action") == 0) {
+            field = ACTION;
+        } else if (strcmp(reader.text(), "section_name") == 0) {
+            field = SECTION_NAME;
+        } else if (strcmp(reader.text(), "duration_seconds") == 0) {
+            field = DURATION_SECONDS;
+        } else if (strcmp(reader.text(), "target_litres") == 0) {
+            field = TARGET_LITRES;
+        } else if (strcmp(reader.text(), "priority") == 0) {
+            field = PRIORITY;
+        }
+
+        token = reader.next();
+
+        switch (field) {
+            case ACTION:
+                if (token != JsonReader::Token::String) {
+                    return parse_error(reader, "action must be a string");
+                }
+
+                if (strcmp(reader.text(), "water") == 0) {
+                    request.action = JobRequest::Action::Water;
+                } else if (strcmp(reader.text(), "pause") == 0) {
+                    request.action = JobRequest::Action::Pause;
+                } else if (strcmp(reader.text(), "resume") == 0) {
+                    request.action = JobRequest::Action::Resume;
+                } else if (strcmp(reader.text(), "stop") == 0) {
+                    return "stop is POST /stop";
+                } else {
+                    return parse_error(reader, "unknown action");
+                }
+                break;
+
+            case SECTION_NAME:
+                if (token != JsonReader::Token::String) {
+                    return parse_error(reader, "section_name must be a string");
+                }
+
+                if (reader.truncated() || strlen(reader.text()) >= sizeof(request.section_name)) {
+                    return "section_name too long";
+                }
+
+                strcpy(request.section_name, reader.text());
+                break;
+
+            case DURATION_SECONDS:
+                if (token != JsonReader::Token::Number || reader.number() <= 0 ||
+                    reader.number() > MAX_DURATION_SECONDS) {
+                    return parse_error(reader, "duration_seconds out of range");
+                }
+
+                request.duration_seconds = reader.number();
+                break;
+
+            case TARGET_LITRES:
+                if (token != JsonReader::Token::Number || reader.number() < 0 ||
+                    reader.number() > MAX_TARGET_LITRES) {
+                    return parse_error(reader, "target_litres out of range");
+                }
+
+                request.target_litres = reader.number();
+                break;
+
+            case PRIORITY:
+                if (token != JsonReader::Token::String) {
+                    return parse_error(reader, "priority must be \"normal\" or \"high\"");
+                }
+
+                if (strcmp(reader.text(), "normal") == 0) {
+                    request.priority = JobPriority::Normal;
+                } else if (strcmp(reader.text(), "high") == 0) {
+                    request.priority = JobPriority::High;
+                } else {
+                    return parse_error(reader, "priority must be \"normal\" or \"high\"");
+                }
+                break;
+
+            default:
+                if (!reader.skip(token)) {
+                    return parse_error(reader, "invalid value");
+                }
+                break;
+        }
+
+        seen |= field;
+    }
+
+    if (reader.next() != JsonReader::Token::End) {
+        return parse_error(reader, "unexpected data after object");
+    }
+
+    if (!(seen & ACTION)) {
+        return "missing action field";
+    }
+
+    if (request.action == JobRequest::Action::Water) {
+        if (!(seen & SECTION_NAME)) {
+            return "missing section_name field";
+        }
+
+        if (!(seen & DURATION_SECONDS)) {
+            return "missing duration_seconds field";
+        }
+    }
+
+    return nullptr;
+}
+
+/* jobs POST, runs on a worker, waters a section now, pauses or resumes watering */
+static esp_err_t jobs_post_async(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    auto msg = Message{};
+    msg.type = Message::Type::Job;
+
+    JsonReader reader(recv_body, req);
+    const auto* err = parse_job(reader, msg.job_request);
+
+    if (err) {
+        ESP_LOGW(TAG, "Invalid job: %s", err);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, err);
+    }
+
+    auto result = ctx->request_job(msg);
+
+    if (!result) {
+        return httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to reach watering service");
+    }
+
+    if (result->error) {
+        httpd_resp_set_status(req, "409 Conflict");
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    ChunkWriter out(req, &ctx->get_metrics(WebServer::Endpoint::Jobs).bytes_sent);
+    JsonWriter json(out);
+
+    json.begin_object();
+    if (result->job_id) {
+        json.integer("job_id", result->job_id);
+    }
+    json.integer("jobs_queued", result->jobs_queued);
+    json.boolean("paused", result->paused);
+    if (result->error) {
+        json.string("error", result->error);
+    }
+    json.end_object();
+
+    return out.finish();
+}
+
+static esp_err_t jobs_post_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    return ctx->admit(req, WebServer::Endpoint::Jobs, jobs_post_async);
+}
+
+/* stop POST, closes all valves and drops queued jobs and the cycle. Served right on the server
+ * task, past the rate limiter and the workers, so it gets through however busy the web is. */
+static esp_err_t stop_post_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+    auto admitted_us = esp_timer_get_time();
+
+    auto result = ctx->stop_all(admitted_us);
+
+    if (!result) {
+        return httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to reach watering service");
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+
+    ChunkWriter out(req);
+    JsonWriter json(out);
+
+    json.begin_object();
+    json.integer("jobs_queued", result->jobs_queued);
+    json.boolean("paused", result->paused);
+    json.integer("stop_latency_us", result->stop_latency_us);
+    json.end_object();
+
+    return out.finish();
+}
+
+static esp_err_t calibration_post_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    return ctx->admit(req, WebServer::Endpoint::ConfigurationWrite, calibration_post_async);
+}
+
+static esp_err_t configuration_post_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    return ctx->admit(req, WebServer::Endpoint::ConfigurationWrite, configuration_post_async);
+}
+
+static esp_err_t configuration_put_handler(httpd_req_t* req) {
+    auto* ctx = (WebServer*)req->user_ctx;
+
+    return ctx->admit(req, WebServer::Endpoint::ConfigurationWrite, configuration_put_async);
+}
+
+static const char* ENDPOINT_NAMES[] = {
+    "status", "configuration_read", "configuration_write", "jobs"};
+static_assert(std::size(ENDPOINT_NAMES) == (size_t)WebServer::Endpoint::Count);
+
+static void write_metric_header(ChunkWriter& out,
+                                const char* name,
+                                const char* type,
+                                const char* help) {
+    out.print("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Series of one histogram, labelled with a single label
+static void write_histogram(ChunkWriter& out,
+                            const char* name,
+                            const char* label,
+                            const char* value,
+                            const Histogram::Snapshot& histogram) {
+    uint32_t cumulative = 0;
+
+    for (size_t i = 0; i < Histogram::BOUNDS; i++) {
+        cumulative += histogram.buckets[i];
+        out.print("%s_bucket{%s=\"%s\",le=\"%g\"} %" PRIu32 "\n",
+                  name,
+                  label,
+                  value,
+                  Histogram::BOUNDS_US[i] / 1e6,
+                  cumulative);
+    }
+
+    cumulative += histogram.buckets[Histogram::BOUNDS];
+    out.print("%s_bucket{%s=\"%s\",le=\"+Inf\"} %" PRIu32 "\n", name, label, value, cumulative);
+    out.print("%s_sum{%s=\"%s\"} %.6f\n", name, label, value, histogram.sum_us / 1e6);
+    out.print("%s_count{%s=\"%s\"} %" PRIu32 "\n", name, label, value, histogram.count);
 }
 
-WebServer::WebServer(SockPtr clock, SockPtr moisture, SockPtr watering)
-    : clock_(std::move(clock)),
+WebServer::WebServer(const Reactor& reactor,
+                     EventBus& events,
+                     StateVersions versions,
+                     ServiceCounters counters,
+                     SockPtr clock,
+                     SockPtr moisture,
+                     SockPtr watering,
+                     SockPtr watering_stop)
+    : reactor_(reactor),
+      event_stream_(events),
+      versions_(versions),
+      counters_(counters),
+      boot_id_(esp_random()),
+      limiters_{RateLimiter(STATUS_LIMIT),
+                RateLimiter(CONFIGURATION_READ_LIMIT),
+                RateLimiter(CONFIGURATION_WRITE_LIMIT),
+                RateLimiter(JOBS_LIMIT)},
+      clock_(std::move(clock)),
       moisture_(std::move(moisture)),
-      watering_(std::move(watering)) {
+      watering_(std::move(watering)),
+      watering_stop_(std::move(watering_stop)) {
+}
+
+esp_err_t WebServer::admit(httpd_req_t* req, Endpoint endpoint, AsyncPool::Handler handler) {
+#if CONFIG_GARDEN_WEB_RATE_LIMIT
+    auto& limiter = limiters_[(size_t)endpoint];
+    auto retry_after = limiter.acquire(client_address(req), esp_timer_get_time());
+
+    if (retry_after > 0) {
+        ESP_LOGW(TAG, "Rate limit exceeded on %s", req->uri);
+
+        char value[12] = {};
+        snprintf(value, sizeof(value), "%" PRIu32, retry_after);
+
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", value);
+        return httpd_resp_sendstr(req, "Too many requests, slow down");
+    }
+#endif
+
+    return workers_.submit(req, handler, &metrics_[(size_t)endpoint].latency);
 }
 
 std::string WebServer::get_version() {
     return "Water my garden version 0.0.1";
 }
 
-std::string WebServer::get_clock_status() {
-    auto msg = Message{};
-    msg.type = Message::Type::Status;
+void WebServer::status_etag(char* buf, size_t size) const {
+    snprintf(buf,
+             size,
+             "W/\"%08" PRIx32 "-%" PRIx32 "-%" PRIx32 "-%" PRIx32 "-%" PRIx64 "\"",
+             boot_id_,
+             versions_.clock.get(),
+             versions_.moisture.get(),
+             versions_.watering.get(),
+             esp_timer_get_time() / STATUS_ETAG_PERIOD_US);
+}
+
+void WebServer::configuration_etag(char* buf, size_t size) const {
+    snprintf(buf, size, "\"%08" PRIx32 "-%" PRIx32 "\"", boot_id_, versions_.configuration.get());
+}
 
-    clock_->send(msg);
+SocketList WebServer::get_sockets_status() {
+    SocketList res = {};
 
-    if (auto data = clock_->rcv(pdMS_TO_TICKS(500))) {
-        auto msg = *data;
-        auto guard = std::unique_ptr<char []>(msg.status);
+    res.add(clock_.socket->status("clock"));
+    res.add(moisture_.socket->status("moisture"));
+    res.add(watering_.socket->status("watering"));
+    res.add(watering_stop_.socket->status("watering_stop"));
 
-        return guard.get();
+    return res;
+}
+
+WebServer::Peer::Peer(SockPtr s) : socket(std::move(s)) {
+#if CONFIG_GARDEN_STATIC_ALLOCATION
+    lock = xSemaphoreCreateMutexStatic(static_alloc<StaticSemaphore_t>());
+#else
+    lock = xSemaphoreCreateMutex();
+#endif
+    configASSERT(lock);
+}
+
+std::optional<Message> WebServer::request(Peer& peer, Message msg) {
+    if (xSemaphoreTake(peer.lock, REPLY_TIMEOUT) != pdPASS) {
+        ESP_LOGW(TAG, "Service busy with other request");
+        return std::nullopt;
     }
 
-    return "Failed to get clock status";
+    msg.seq = ++peer.seq;
+
+    std::optional<Message> reply;
+
+    if (peer.socket->send(msg) == pdPASS) {
+        auto start_us = esp_timer_get_time();
+        auto deadline = xTaskGetTickCount() + REPLY_TIMEOUT;
+
+        // Reply to a request that timed out earlier may still arrive, skip it
+        for (;;) {
+            auto left = (int32_t)(deadline - xTaskGetTickCount());
+            if (left <= 0) {
+                break;
+            }
+
+            reply = peer.socket->rcv(left);
+
+            if (!reply) {
+                break;
+            }
+
+            if (reply->seq == msg.seq) {
+                peer.round_trip.record(esp_timer_get_time() - start_us);
+                break;
+            }
+
+            ESP_LOGW(TAG,
+                     "Dropping stale reply %" PRIu32 ", waiting for %" PRIu32,
+                     reply->seq,
+                     msg.seq);
+            reply.reset();
+        }
+    }
+
+    xSemaphoreGive(peer.lock);
+
+    return reply;
 }
 
-std::string WebServer::get_moisture_status() {
+std::optional<ClockStatus> WebServer::get_clock_status() {
     auto msg = Message{};
     msg.type = Message::Type::Status;
 
-    moisture_->send(msg);
-
-    if (auto data = moisture_->rcv(pdMS_TO_TICKS(500))) {
-        auto msg = *data;
-        // Some crazy/ugly stuff is going there.
-        // In union there cannot be anything that has constructor/dtor
-        // so only option is to pass char * that is allocated.
-        // To avoid memleaks I need to wrap it in unique_ptr
-        // Returning data() will call std::string ctor that will copy the
-        // content, and return. Shortly after guard gets deleted.
-        // All of that could be avoided if move semantics would be implicit
-        // As it is in... ekhm Rust, ekhm.
-        auto guard = std::unique_ptr<char []>(msg.status);
-        return guard.get();
+    if (auto reply = request(clock_, msg)) {
+        return reply->clock_status;
     }
 
-    return "Failed to get moisture status";
+    ESP_LOGE(TAG, "Failed to get clock status");
+    return std::nullopt;
 }
 
-std::string WebServer::get_watering_status() {
+std::optional<MoistureStatus> WebServer::get_moisture_status() {
     auto msg = Message{};
     msg.type = Message::Type::Status;
 
-    watering_->send(msg);
+    if (auto reply = request(moisture_, msg)) {
+        return reply->moisture_status;
+    }
+
+    ESP_LOGE(TAG, "Failed to get moisture status");
+    return std::nullopt;
+}
 
-    if (auto data = watering_->rcv(pdMS_TO_TICKS(500))) {
-        auto msg = *data;
-        auto guard = std::unique_ptr<char []>(msg.status);
+std::optional<WateringStatus> WebServer::get_watering_status() {
+    auto msg = Message{};
+    msg.type = Message::Type::Status;
 
-        return guard.get();
+    if (auto reply = request(watering_, msg)) {
+        return reply->watering_status;
     }
 
-    return "Failed to get watering status";
+    ESP_LOGE(TAG, "Failed to get watering status");
+    return std::nullopt;
 }
 
-std::string WebServer::get_watering_configuration() {
+std::optional<WateringConfiguration> WebServer::get_watering_configuration() {
     auto msg = Message{};
     msg.type = Message::Type::GetConfiguration;
 
-    watering_->send(msg);
+    if (auto reply = request(watering_, msg)) {
+        return reply->configuration;
+    }
 
-    if (auto data = watering_->rcv(pdMS_TO_TICKS(500))) {
-        auto msg = *data;
-        auto guard = std::unique_ptr<char []>(msg.status);
+    ESP_LOGE(TAG, "Failed to get watering configuration");
+    return std::nullopt;
+}
 
-        return guard.get();
+std::optional<WateringConfiguration> WebServer::set_watering_configuration(const Message& msg) {
+    if (auto reply = request(watering_, msg)) {
+        return reply->configuration;
     }
 
-    return "Failed to get watering configuration";
+    ESP_LOGE(TAG, "Failed to set watering configuration");
+    return std::nullopt;
 }
 
-std::string WebServer::set_watering_configuration(std::string payload) {
-    ESP_LOGI(TAG, "set configuration=%s", payload.c_str());
+std::optional<ConfigurationResult> WebServer::apply_watering_configuration(const Message& msg) {
+    if (auto reply = request(watering_, msg)) {
+        return reply->configuration_result;
+    }
 
-    auto msg = Message{};
-    msg.type = Message::Type::SetConfiguration;
+    ESP_LOGE(TAG, "Failed to apply watering configuration");
+    return std::nullopt;
+}
 
-    cJSON *conf = cJSON_Parse(payload.c_str());
+void WebServer::write_metrics(ChunkWriter& out) {
+    struct {
+        const char* name;
+        Peer& peer;
+    } peers[] = {{"clock", clock_},
+                 {"moisture", moisture_},
+                 {"watering", watering_},
+                 {"watering_stop", watering_stop_}};
+
+    write_metric_header(out,
+                        "garden_http_request_duration_seconds",
+                        "histogram",
+                        "Time from admission until the response is sent");
+    for (size_t i = 0; i < metrics_.size(); i++) {
+        write_histogram(out,
+                        "garden_http_request_duration_seconds",
+                        "endpoint",
+                        ENDPOINT_NAMES[i],
+                        metrics_[i].latency.snapshot());
+    }
 
-    if (conf == nullptr) {
-        return "failed to parse JSON";
+    write_metric_header(out, "garden_http_response_bytes_total", "counter", "Response body bytes");
+    for (size_t i = 0; i < metrics_.size(); i++) {
+        out.print("garden_http_response_bytes_total{endpoint=\"%s\"} %" PRIu32 "\n",
+                  ENDPOINT_NAMES[i],
+                  metrics_[i].bytes_sent.load());
     }
 
-	if (cJSON_GetObjectItem(conf, "section_name")) {
-        strncpy(msg.section_name, cJSON_GetObjectItem(conf, "section_name")->valuestring, 32);
-	} else {
-        cJSON_Delete(conf);
-        return "missing section_name field";
+    write_metric_header(
+        out, "garden_http_rate_limited_total", "counter", "Requests rejected with 429");
+    for (size_t i = 0; i < limiters_.size(); i++) {
+        out.print("garden_http_rate_limited_total{endpoint=\"%s\"} %" PRIu32 "\n",
+                  ENDPOINT_NAMES[i],
+                  limiters_[i].limited());
     }
 
-	if (cJSON_GetObjectItem(conf, "enabled")) {
-		msg.enabled = cJSON_GetObjectItem(conf,"enabled")->valueint;
-	} else {
-        cJSON_Delete(conf);
-        return "missing enabled field";
+    write_metric_header(
+        out, "garden_http_busy_total", "counter", "Requests rejected with 503, no free worker");
+    out.print("garden_http_busy_total %" PRIu32 "\n", workers_.rejected());
+
+    write_metric_header(out,
+                        "garden_ipc_round_trip_seconds",
+                        "histogram",
+                        "Time from sending a request to a service until its reply arrives");
+    for (auto& [name, peer] : peers) {
+        write_histogram(
+            out, "garden_ipc_round_trip_seconds", "service", name, peer.round_trip.snapshot());
     }
 
-    if (cJSON_GetObjectItem(conf, "duration_seconds")) {
-		msg.duration_seconds = cJSON_GetObjectItem(conf,"duration_seconds")->valueint;
-	} else {
-        cJSON_Delete(conf);
-        return "missing duration_seconds field";
+    write_metric_header(out,
+                        "garden_reactor_queue_seconds",
+                        "histogram",
+                        "Time from sending a message to a service until the reactor dispatches it");
+    write_histogram(out,
+                    "garden_reactor_queue_seconds",
+                    "lane",
+                    "control",
+                    reactor_.queue_latency(Reactor::Lane::Control).snapshot());
+    write_histogram(out,
+                    "garden_reactor_queue_seconds",
+                    "lane",
+                    "web",
+                    reactor_.queue_latency(Reactor::Lane::Web).snapshot());
+
+    write_metric_header(
+        out, "garden_ipc_timeouts_total", "counter", "Service replies that did not arrive in time");
+    for (auto& [name, peer] : peers) {
+        out.print("garden_ipc_timeouts_total{service=\"%s\"} %" PRIu32 "\n",
+                  name,
+                  peer.socket->stats().rcv_timeouts);
     }
 
-    if (cJSON_GetObjectItem(conf, "wet_threshold")) {
-		msg.wet_threshold = cJSON_GetObjectItem(conf,"wet_threshold")->valuedouble;
-	} else {
-        cJSON_Delete(conf);
-        return "missing wet_threshold field";
+    write_metric_header(
+        out, "garden_ipc_dropped_total", "counter", "Requests not delivered to a service");
+    for (auto& [name, peer] : peers) {
+        out.print("garden_ipc_dropped_total{service=\"%s\"} %" PRIu32 "\n",
+                  name,
+                  peer.socket->stats().dropped);
+    }
+
+    write_metric_header(out, "garden_alarms_handled_total", "counter", "RTC alarms handled");
+    for (size_t i = 0; i < counters_.clock.alarms_handled.size(); i++) {
+        out.print("garden_alarms_handled_total{alarm=\"%d\"} %" PRIu32 "\n",
+                  (int)i + 1,
+                  counters_.clock.alarms_handled[i].load());
     }
 
-    cJSON_Delete(conf);
+    write_metric_header(out, "garden_moisture_reads_total", "counter", "ADC sweeps of a channel");
+    for (int i = 0; i < counters_.moisture.channels_count; i++) {
+        out.print("garden_moisture_reads_total{channel=\"%d\"} %" PRIu32 "\n",
+                  i,
+                  counters_.moisture.reads[i].load());
+    }
 
-    watering_->send(msg);
+    write_metric_header(out, "garden_watering_cycles_total", "counter", "Watering cycles started");
+    out.print("garden_watering_cycles_total %" PRIu32 "\n", counters_.watering.cycles.load());
 
-    if (auto data = watering_->rcv(pdMS_TO_TICKS(500))) {
-        auto msg = *data;
-        auto guard = std::unique_ptr<char []>(msg.status);
+    write_metric_header(
+        out, "garden_valve_open_seconds_total", "counter", "Time the valve of a section was open");
+    for (int i = 0; i < counters_.watering.sections_count; i++) {
+        out.print("garden_valve_open_seconds_total{section=\"%s\"} %.3f\n",
+                  counters_.watering.names[i],
+                  counters_.watering.valve_open_ms[i].load() / 1e3);
+    }
 
-        return guard.get();
+    write_metric_header(
+        out, "garden_water_litres_total", "counter", "Water given to a section, by the flow meter");
+    for (int i = 0; i < counters_.watering.sections_count; i++) {
+        out.print("garden_water_litres_total{section=\"%s\"} %.3f\n",
+                  counters_.watering.names[i],
+                  counters_.watering.water_ml[i].load() / 1e3);
     }
 
-    return "Failed to set watering configuration";
+    write_metric_header(out, "garden_watering_jobs_total", "counter", "Manual jobs queued");
+    out.print("garden_watering_jobs_total %" PRIu32 "\n", counters_.watering.jobs.load());
+
+    write_metric_header(
+        out, "garden_watering_stops_total", "counter", "Stops of all watering, asked or backstop");
+    out.print("garden_watering_stops_total %" PRIu32 "\n", counters_.watering.stops.load());
+
+    write_metric_header(out,
+                        "garden_watering_stop_seconds",
+                        "histogram",
+                        "Time from taking a stop request until all valves are closed");
+    write_histogram(out, "garden_watering_stop_seconds", "path", "web", stop_latency_.snapshot());
+
+    write_metric_header(out, "garden_uptime_seconds", "gauge", "Time since boot");
+    out.print("garden_uptime_seconds %.3f\n", esp_timer_get_time() / 1e6);
+}
+
+std::optional<CalibrationResult> WebServer::calibrate_moisture(const Message& msg) {
+    if (auto reply = request(moisture_, msg)) {
+        return reply->calibration_result;
+    }
+
+    ESP_LOGE(TAG, "Failed to calibrate moisture sensor");
+    return std::nullopt;
+}
+
+std::optional<JobResult> WebServer::request_job(const Message& msg) {
+    if (auto reply = request(watering_, msg)) {
+        return reply->job_result;
+    }
+
+    ESP_LOGE(TAG, "Failed to request watering job");
+    return std::nullopt;
+}
+
+std::optional<JobResult> WebServer::stop_all(int64_t admitted_us) {
+    auto msg = Message{};
+    msg.type = Message::Type::Job;
+    msg.job_request.action = JobRequest::Action::StopAll;
+    msg.job_request.admitted_us = admitted_us;
+
+    // Only the server task uses this peer, its lock is never contended
+    if (auto reply = request(watering_stop_, msg)) {
+        stop_latency_.record(reply->job_result.stop_latency_us);
+        return reply->job_result;
+    }
+
+    ESP_LOGE(TAG, "Failed to stop watering");
+    return std::nullopt;
 }
 
 httpd_handle_t WebServer::start_webserver() {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.lru_purge_enable = true;
+    config.max_uri_handlers = 12;
 
     httpd_uri_t version = {.uri = "/version",
                            .method = HTTP_GET,
@@ -239,21 +1584,61 @@ httpd_handle_t WebServer::start_webserver() {
     httpd_uri_t status = {
         .uri = "/status", .method = HTTP_GET, .handler = status_get_handler, .user_ctx = this};
 
+    httpd_uri_t dashboard = {
+        .uri = "/", .method = HTTP_GET, .handler = dashboard_get_handler, .user_ctx = this};
+
+    httpd_uri_t metrics = {
+        .uri = "/metrics", .method = HTTP_GET, .handler = metrics_get_handler, .user_ctx = this};
+
+    httpd_uri_t events = {.uri = "/events",
+                          .method = HTTP_GET,
+                          .handler = events_handler,
+                          .user_ctx = this,
+                          .is_websocket = true};
+
     httpd_uri_t get_configuration = {
         .uri = "/configuration", .method = HTTP_GET, .handler = configuration_get_handler, .user_ctx = this};
 
     httpd_uri_t set_configuration = {
         .uri = "/configuration", .method = HTTP_POST, .handler = configuration_post_handler, .user_ctx = this};
 
+    httpd_uri_t replace_configuration = {
+        .uri = "/configuration", .method = HTTP_PUT, .handler = configuration_put_handler, .user_ctx = this};
+
+    // Page is part of the firmware image, so is its tag
+    char sha[17] = {};
+    esp_app_get_elf_sha256(sha, sizeof(sha));
+    snprintf(dashboard_etag_, sizeof(dashboard_etag_), "\"%s\"", sha);
+
+    httpd_uri_t calibration = {
+        .uri = "/calibration", .method = HTTP_POST, .handler = calibration_post_handler, .user_ctx = this};
+
+    httpd_uri_t jobs = {
+        .uri = "/jobs", .method = HTTP_POST, .handler = jobs_post_handler, .user_ctx = this};
+
+    httpd_uri_t stop = {
+        .uri = "/stop", .method = HTTP_POST, .handler = stop_post_handler, .user_ctx = this};
+
+    workers_.start();
+
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
         // Set URI handlers
         ESP_LOGI(TAG, "Registering URI handlers");
+        httpd_register_uri_handler(server, &dashboard);
         httpd_register_uri_handler(server, &version);
         httpd_register_uri_handler(server, &status);
+        httpd_register_uri_handler(server, &metrics);
+        httpd_register_uri_handler(server, &events);
         httpd_register_uri_handler(server, &get_configuration);
         httpd_register_uri_handler(server, &set_configuration);
+        httpd_register_uri_handler(server, &replace_configuration);
+        httpd_register_uri_handler(server, &calibration);
+        httpd_register_uri_handler(server, &jobs);
+        httpd_register_uri_handler(server, &stop);
+
+        event_stream_.attach(server);
 
         return server;
     }
@@ -1,27 +1,149 @@
 #pragma once
 
+#include "async_pool.hpp"
+#include "event_stream.hpp"
+#include "histogram.hpp"
+#include "rate_limiter.hpp"
+#include "service_counters.hpp"
+#include "reactor.hpp"
+#include "snapshots.hpp"
 #include "socket.hpp"
+#include "state_version.hpp"
 
+#include <array>
+#include <atomic>
+#include <optional>
 #include <string>
 
 #include <esp_http_server.h>
 
+/// Versions of the service state, read directly to answer conditional requests
+struct StateVersions {
+    const StateVersion& clock;
+    const StateVersion& moisture;
+    const StateVersion& watering;
+    const StateVersion& configuration;
+};
+
+/// Counters of the services, read directly for /metrics
+struct ServiceCounters {
+    const ClockCounters& clock;
+    const MoistureCounters& moisture;
+    const WateringCounters& watering;
+};
+
+class ChunkWriter;
+
 class WebServer {
  public:
-    WebServer(SockPtr clock, SockPtr moisture, SockPtr watering);
+    /// Endpoints that reach the services, each has own rate limit per client
+    enum class Endpoint {
+        Status,
+        ConfigurationRead,
+        ConfigurationWrite,
+        Jobs,
+        Count,
+    };
+
+    /// Instrumentation of an endpoint
+    struct EndpointMetrics {
+        // From admission until the handler returns, requests served by workers only
+        Histogram latency;
+        std::atomic<uint32_t> bytes_sent = 0;
+    };
+
+    WebServer(const Reactor& reactor,
+              EventBus& events,
+              StateVersions versions,
+              ServiceCounters counters,
+              SockPtr clock,
+              SockPtr moisture,
+              SockPtr watering,
+              SockPtr watering_stop);
 
     httpd_handle_t start_webserver();
 
     std::string get_version();
 
-    std::string get_clock_status();
-    std::string get_moisture_status();
-    std::string get_watering_status();
-    std::string get_watering_configuration();
-    std::string set_watering_configuration(std::string payload);
+    // Snapshots of the service state, nullopt if service did not reply in time
+    std::optional<ClockStatus> get_clock_status();
+    std::optional<MoistureStatus> get_moisture_status();
+    std::optional<WateringStatus> get_watering_status();
+    std::optional<WateringConfiguration> get_watering_configuration();
+    std::optional<WateringConfiguration> set_watering_configuration(const Message& msg);
+    std::optional<ConfigurationResult> apply_watering_configuration(const Message& msg);
+    std::optional<CalibrationResult> calibrate_moisture(const Message& msg);
+    std::optional<JobResult> request_job(const Message& msg);
+    /// Closes all valves, called on the server task. Admitted is when the request was taken.
+    std::optional<JobResult> stop_all(int64_t admitted_us);
+    SocketList get_sockets_status();
+
+    const Reactor& get_reactor() const {
+        return reactor_;
+    }
+
+    EventStream& get_event_stream() {
+        return event_stream_;
+    }
+
+    /// Continues handling the request on a worker task if the client is within the endpoint's
+    /// rate limit, otherwise answers 429
+    esp_err_t admit(httpd_req_t* req, Endpoint endpoint, AsyncPool::Handler handler);
+
+    const RateLimiter& get_rate_limiter(Endpoint endpoint) const {
+        return limiters_[(size_t)endpoint];
+    }
+
+    EndpointMetrics& get_metrics(Endpoint endpoint) {
+        return metrics_[(size_t)endpoint];
+    }
+
+    /// Prometheus text exposition of web and service counters, asks no service
+    void write_metrics(ChunkWriter& out);
+
+    uint32_t get_rejected_by_workers() const {
+        return workers_.rejected();
+    }
+
+    const char* get_dashboard_etag() const {
+        return dashboard_etag_;
+    }
+
+    // Entity tags of the responses, computed without asking the services
+    void status_etag(char* buf, size_t size) const;
+    void configuration_etag(char* buf, size_t size) const;
 
  private:
-    SockPtr clock_;
-    SockPtr moisture_;
-    SockPtr watering_;
+    /// Service socket, shared by handlers running on workers, one request in flight at a time
+    struct Peer {
+        explicit Peer(SockPtr s);
+
+        SockPtr socket;
+        SemaphoreHandle_t lock;
+        uint32_t seq = 0;
+        // From sending the request until its reply arrives, timeouts are not recorded
+        Histogram round_trip;
+    };
+
+    std::optional<Message> request(Peer& peer, Message msg);
+
+    const Reactor& reactor_;
+    EventStream event_stream_;
+    StateVersions versions_;
+    ServiceCounters counters_;
+
+    // Versions start over on reboot, tags from before must not match
+    uint32_t boot_id_;
+    char dashboard_etag_[20] = {};
+    AsyncPool workers_;
+    std::array<RateLimiter, (size_t)Endpoint::Count> limiters_;
+    std::array<EndpointMetrics, (size_t)Endpoint::Count> metrics_;
+
+    Peer clock_;
+    Peer moisture_;
+    Peer watering_;
+    // Stop only, served on the server task so it never waits for a worker or another request
+    Peer watering_stop_;
+    // From admission until all valves are closed, as measured by watering
+    Histogram stop_latency_;
 };
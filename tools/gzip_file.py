@@ -0,0 +1,24 @@
+#!/usr/bin/env python3
+"""Compresses a file for embedding in the firmware.
+
+Timestamp and name are left out of the gzip header, so the output, and the
+firmware image with it, only changes when the input does.
+"""
+
+import gzip
+import sys
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: gzip_file.py INPUT OUTPUT")
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(gzip.compress(data, compresslevel=9, mtime=0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,436 @@
+// Replays traces of raw ADC bursts through MoistureFilter configurations and compares them with
+// the plain mean of 64 conversions the firmware took before the filter. Traces are synthetic,
+// modelled on the internal ADC: gaussian noise, relay transients hitting a run of samples, soil
+// drying, watering and probes coming loose. Recorded traces can be replayed with --trace.
+//
+//     filter_replay [--check] [--trace FILE]... [--write-traces DIR]
+//
+// Trace file: one burst per line, "TRUTH S0 S1 ...", raw counts. TRUTH is the raw reading the
+// probe should give, "x" if the probe is disconnected then, "-" if unknown, the median of all
+// samples of the trace is then taken, which fits a probe left in soil that does not change.
+// Lines starting with '#' are skipped. Shorter bursts are replayed by configurations that take
+// at most that many samples.
+
+#include "moisture_filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Same as the moisture service, below that a reading gives no moisture
+static const float MIN_CONFIDENCE = 0.2f;
+static const int BURST = MoistureFilter::MAX_SAMPLES;
+static const int READINGS = 400;
+// Raw counts the reading has to be within to count as settled after a step
+static const float SETTLED = 40;
+
+struct Burst {
+    // NaN if the probe is disconnected
+    float truth;
+    std::vector<uint16_t> samples;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Burst> bursts;
+    // Of the burst where the truth jumps, -1 if it does not
+    int step_at = -1;
+};
+
+struct Candidate {
+    const char* name;
+    // Plain mean of all samples, as before the filter
+    bool mean;
+    MoistureFilter::Config config;
+};
+
+// Firmware defaults are trimmed mean of 16, alpha 0.5, max step 300
+static const Candidate CANDIDATES[] = {
+    {"mean-64", true, {.samples = 64}},
+    {"trimmed-16 raw", false, {MoistureFilter::Reducer::TrimmedMean, 16, 1.0f, 0, 0}},
+    {"median-8", false, {MoistureFilter::Reducer::Median, 8, 0.5f, 300, 2}},
+    {"trimmed-8", false, {MoistureFilter::Reducer::TrimmedMean, 8, 0.5f, 300, 2}},
+    {"median-16", false, {MoistureFilter::Reducer::Median, 16, 0.5f, 300, 2}},
+    {"trimmed-16", false, {MoistureFilter::Reducer::TrimmedMean, 16, 0.5f, 300, 2}},
+    {"trimmed-32", false, {MoistureFilter::Reducer::TrimmedMean, 32, 0.5f, 300, 2}},
+};
+
+static const char* FIRMWARE_DEFAULT = "trimmed-16";
+
+struct Result {
+    bool replayed;
+    // Against the truth, over readings of a connected probe that gave moisture
+    float rmse;
+    float max_error;
+    // Readings of a disconnected probe that gave no moisture
+    float flagged;
+    // Readings of a connected probe that gave no moisture
+    float false_flags;
+    // Readings after the step until within SETTLED of the truth, -1 if never
+    int settle;
+};
+
+/// Synthetic traces, the same on every run
+class Generator {
+ public:
+    Generator() : random_(42) {
+    }
+
+    Trace steady(bool relay) {
+        Trace trace{.name = relay ? "steady, relay" : "steady"};
+        for (int i = 0; i < READINGS; i++) {
+            trace.bursts.push_back(burst(2000, relay));
+        }
+        return trace;
+    }
+
+    Trace drying() {
+        Trace trace{.name = "drying, relay"};
+        for (int i = 0; i < READINGS; i++) {
+            trace.bursts.push_back(burst(1400 + 1000.0f * i / READINGS, true));
+        }
+        return trace;
+    }
+
+    Trace watering() {
+        Trace trace{.name = "watering step", .step_at = READINGS / 2};
+        for (int i = 0; i < READINGS; i++) {
+            trace.bursts.push_back(burst(i < trace.step_at ? 2300 : 1500, true));
+        }
+        return trace;
+    }
+
+    /// Loose wire, the input floats and reads anything
+    Trace floating() {
+        Trace trace{.name = "disconnected, floating"};
+        for (int i = 0; i < READINGS; i++) {
+            if (i < READINGS / 2) {
+                trace.bursts.push_back(burst(2000, true));
+                continue;
+            }
+
+            Burst b{.truth = NAN};
+            std::uniform_int_distribution<int> level(1200, 2800);
+            for (int s = 0; s < BURST; s++) {
+                b.samples.push_back(level(random_));
+            }
+            trace.bursts.push_back(b);
+        }
+        return trace;
+    }
+
+    /// Broken probe, input pulled to the rail
+    Trace rail() {
+        Trace trace{.name = "disconnected, rail"};
+        for (int i = 0; i < READINGS; i++) {
+            auto b = burst(i < READINGS / 2 ? 2000 : 4095, true);
+            if (i >= READINGS / 2) {
+                b.truth = NAN;
+            }
+            trace.bursts.push_back(b);
+        }
+        return trace;
+    }
+
+ private:
+    // Noise of the internal ADC at 11 dB attenuation
+    static constexpr float NOISE = 15;
+    // Share of bursts a relay transient overlaps, and its length in samples
+    static constexpr float RELAY_RATE = 0.08f;
+    static const int RELAY_MIN = 2;
+    static const int RELAY_MAX = 6;
+
+    Burst burst(float truth, bool relay) {
+        Burst b{.truth = truth};
+        std::normal_distribution<float> noise(0, NOISE);
+
+        for (int s = 0; s < BURST; s++) {
+            b.samples.push_back(clamp(truth + noise(random_)));
+        }
+
+        if (relay && std::uniform_real_distribution<float>(0, 1)(random_) < RELAY_RATE) {
+            int length = std::uniform_int_distribution<int>(RELAY_MIN, RELAY_MAX)(random_);
+            // Transient may start before the burst or run past its end
+            int start = std::uniform_int_distribution<int>(1 - length, BURST - 1)(random_);
+            int offset = std::uniform_int_distribution<int>(600, 1500)(random_);
+
+            for (int s = std::max(start, 0); s < std::min(start + length, BURST); s++) {
+                b.samples[s] = clamp(b.samples[s] + offset);
+            }
+        }
+
+        return b;
+    }
+
+    static uint16_t clamp(float value) {
+        return (uint16_t)std::clamp<float>(std::lround(value), 0, 4095);
+    }
+
+    std::mt19937 random_;
+};
+
+static bool load_trace(const char* path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    trace.name = path;
+    std::vector<bool> unknown;
+    std::vector<uint16_t> all;
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string truth;
+        fields >> truth;
+
+        Burst b{.truth = truth == "x" ? NAN : truth == "-" ? 0 : std::stof(truth)};
+        int sample;
+        while (fields >> sample && b.samples.size() < BURST) {
+            b.samples.push_back(std::clamp(sample, 0, 4095));
+        }
+
+        unknown.push_back(truth == "-");
+        all.insert(all.end(), b.samples.begin(), b.samples.end());
+        trace.bursts.push_back(b);
+    }
+
+    if (!all.empty()) {
+        std::nth_element(all.begin(), all.begin() + all.size() / 2, all.end());
+        for (size_t i = 0; i < trace.bursts.size(); i++) {
+            if (unknown[i]) {
+                trace.bursts[i].truth = all[all.size() / 2];
+            }
+        }
+    }
+
+    return !trace.bursts.empty();
+}
+
+static void write_trace(const std::string& dir, const Trace& trace) {
+    std::string name = trace.name;
+    std::replace_if(name.begin(), name.end(), [](char c) { return !isalnum(c); }, '_');
+
+    std::ofstream out(dir + "/" + name + ".txt");
+    out << "# " << trace.name << ", synthetic\n";
+
+    for (const auto& b : trace.bursts) {
+        if (std::isnan(b.truth)) {
+            out << "x";
+        } else {
+            out << std::lround(b.truth);
+        }
+
+        for (auto s : b.samples) {
+            out << ' ' << s;
+        }
+        out << '\n';
+    }
+}
+
+static Result replay(const Trace& trace, const Candidate& candidate) {
+    Result res = {.replayed = true, .settle = -1};
+
+    for (const auto& b : trace.bursts) {
+        if ((int)b.samples.size() < candidate.config.samples) {
+            return Result{};
+        }
+    }
+
+    MoistureFilter filter;
+    filter.configure(candidate.config);
+
+    double squares = 0;
+    int valid = 0, disconnected = 0, flagged = 0, connected = 0, false_flags = 0;
+
+    for (size_t i = 0; i < trace.bursts.size(); i++) {
+        const auto& b = trace.bursts[i];
+        uint16_t samples[BURST];
+        std::copy_n(b.samples.begin(), candidate.config.samples, samples);
+
+        MoistureFilter::Reading reading;
+        if (candidate.mean) {
+            uint32_t sum = 0;
+            for (int s = 0; s < candidate.config.samples; s++) {
+                sum += samples[s];
+            }
+            reading.raw = sum / candidate.config.samples;
+            // Only a reading at a rail fell outside the calibration bounds
+            reading.confidence = reading.raw <= 16 || reading.raw >= 4079 ? 0 : 1;
+        } else {
+            reading = filter.update(filter.reduce(samples, candidate.config.samples));
+        }
+
+        bool gives_moisture = reading.confidence >= MIN_CONFIDENCE;
+
+        if (std::isnan(b.truth)) {
+            disconnected++;
+            flagged += !gives_moisture;
+            continue;
+        }
+
+        connected++;
+        false_flags += !gives_moisture;
+
+        float error = std::fabs((float)reading.raw - b.truth);
+
+        // Lag after a step is what settle measures, it stays out of the errors
+        bool settling = trace.step_at >= 0 && (int)i >= trace.step_at && res.settle < 0;
+        if (settling && error <= SETTLED) {
+            res.settle = i - trace.step_at;
+            settling = false;
+        }
+
+        if (gives_moisture && !settling) {
+            squares += error * error;
+            res.max_error = std::max(res.max_error, error);
+            valid++;
+        }
+    }
+
+    res.rmse = valid ? std::sqrt(squares / valid) : NAN;
+    res.flagged = disconnected ? (float)flagged / disconnected : NAN;
+    res.false_flags = connected ? (float)false_flags / connected : NAN;
+
+    return res;
+}
+
+static void print_value(float value, const char* format) {
+    if (std::isnan(value)) {
+        printf("%8s", "-");
+    } else {
+        printf(format, value);
+    }
+}
+
+/// Firmware default against the old mean of 64, returns the number of failed checks
+static int check(const Trace& trace, const Result& firmware, const Result& mean) {
+    int failed = 0;
+    auto fail = [&](const char* what) {
+        printf("FAIL %s: %s\n", trace.name.c_str(), what);
+        failed++;
+    };
+
+    // Fewer conversions have to do at least as well wherever transients hit
+    if (trace.name.find("relay") != std::string::npos && firmware.rmse > mean.rmse) {
+        fail("less accurate than mean-64");
+    }
+    if (!std::isnan(firmware.flagged) && firmware.flagged < 0.9f) {
+        fail("disconnected probe gives moisture");
+    }
+    if (firmware.false_flags > 0.02f) {
+        fail("connected probe gives no moisture");
+    }
+    if (trace.step_at >= 0 && (firmware.settle < 0 || firmware.settle > 4)) {
+        fail("does not follow a real change");
+    }
+
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    bool check_results = false;
+    const char* write_dir = nullptr;
+    std::vector<Trace> traces;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            check_results = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            Trace trace;
+            if (!load_trace(argv[++i], trace)) {
+                fprintf(stderr, "Cannot read trace %s\n", argv[i]);
+                return 2;
+            }
+            traces.push_back(trace);
+        } else if (strcmp(argv[i], "--write-traces") == 0 && i + 1 < argc) {
+            write_dir = argv[++i];
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--check] [--trace FILE]... [--write-traces DIR]\n"
+                    "  without --trace, synthetic traces are replayed\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    if (traces.empty()) {
+        Generator generator;
+        traces = {generator.steady(false),
+                  generator.steady(true),
+                  generator.drying(),
+                  generator.watering(),
+                  generator.floating(),
+                  generator.rail()};
+    }
+
+    if (write_dir) {
+        for (const auto& trace : traces) {
+            write_trace(write_dir, trace);
+        }
+    }
+
+    int failed = 0;
+
+    for (const auto& trace : traces) {
+        printf("\n%s, %zu readings\n", trace.name.c_str(), trace.bursts.size());
+        printf("%-16s%8s%8s%8s%8s%8s%8s\n",
+               "filter",
+               "samples",
+               "rmse",
+               "max",
+               "flagged",
+               "false",
+               "settle");
+
+        Result firmware = {}, mean = {};
+
+        for (const auto& candidate : CANDIDATES) {
+            auto res = replay(trace, candidate);
+            if (!res.replayed) {
+                continue;
+            }
+
+            printf("%-16s%8d", candidate.name, candidate.config.samples);
+            print_value(res.rmse, "%8.1f");
+            print_value(res.max_error, "%8.0f");
+            print_value(res.flagged * 100, "%7.0f%%");
+            print_value(res.false_flags * 100, "%7.1f%%");
+            if (res.settle >= 0) {
+                printf("%8d\n", res.settle);
+            } else {
+                printf("%8s\n", trace.step_at >= 0 ? "never" : "-");
+            }
+
+            if (strcmp(candidate.name, FIRMWARE_DEFAULT) == 0) {
+                firmware = res;
+            } else if (candidate.mean) {
+                mean = res;
+            }
+        }
+
+        if (check_results && firmware.replayed && mean.replayed) {
+            failed += check(trace, firmware, mean);
+        }
+    }
+
+    printf("\nrmse and max in raw counts, against the truth, over readings giving moisture and\n"
+           "not settling after a step\n"
+           "flagged: readings of a disconnected probe giving no moisture, false: of a connected\n"
+           "one, settle: readings after a step until within %.0f counts\n",
+           SETTLED);
+
+    return failed ? 1 : 0;
+}
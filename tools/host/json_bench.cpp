@@ -0,0 +1,340 @@
+// Decodes sample /configuration bodies with JsonReader, as the web server does, and with cJSON, as
+// it did before: whole DOM on heap, then pick the fields. Checks both agree and prints time per
+// parse and heap taken by each.
+//
+//     json_bench [--runs N]
+//
+// cJSON is the copy ESP-IDF ships, see CMakeLists.txt. Times are of the machine it runs on, only
+// their ratio says something about the device.
+
+#include "json_reader.hpp"
+#include "snapshots.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <cJSON.h>
+
+// POST /configuration, one section, what the dashboard sends when a section is saved
+static const char POST_BODY[] =
+    R"({"section_name":"Flowers","enabled":true,"duration_seconds":600,"wet_threshold":0.55,)"
+    R"("target_litres":12.5})";
+
+// PUT /configuration, the whole configuration at once
+static const char PUT_BODY[] =
+    R"({"version":12,"schedule":{"hour":6,"minute":30},"sections":[)"
+    R"({"section_name":"Vegetables","enabled":true,"duration_seconds":900,"wet_threshold":0.6,)"
+    R"("target_litres":0},)"
+    R"({"section_name":"Flowers","enabled":true,"duration_seconds":600,"wet_threshold":0.55,)"
+    R"("target_litres":12.5},)"
+    R"({"section_name":"Terrace","enabled":false,"duration_seconds":300,"wet_threshold":0.5,)"
+    R"("target_litres":0},)"
+    R"({"section_name":"Grass","enabled":true,"duration_seconds":1200,"wet_threshold":0.65,)"
+    R"("target_litres":40}]})";
+
+struct HeapUse {
+    size_t now;
+    size_t peak;
+    uint32_t allocations;
+
+    void add(size_t size) {
+        now += size;
+        peak = std::max(peak, now);
+        allocations++;
+    }
+};
+
+// JsonReader is expected to take nothing from heap, anything it would take goes through new
+static bool count_new = false;
+static HeapUse new_heap = {};
+
+void* operator new(size_t size) {
+    if (count_new) {
+        new_heap.add(size);
+    }
+
+    if (auto* ptr = malloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+// cJSON allocates through these hooks, so its heap use is counted exactly
+static HeapUse cjson_heap = {};
+
+static void* counting_malloc(size_t size) {
+    auto* block = (uint8_t*)malloc(size + sizeof(max_align_t));
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    *(size_t*)block = size;
+    cjson_heap.add(size);
+
+    return block + sizeof(max_align_t);
+}
+
+static void counting_free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    auto* block = (uint8_t*)ptr - sizeof(max_align_t);
+    cjson_heap.now -= *(size_t*)block;
+    free(block);
+}
+
+struct MemorySource {
+    const char* data;
+    size_t len;
+    size_t pos;
+};
+
+// Hands out the body in whatever pieces the reader asks for, like httpd_req_recv does
+static int read_memory(void* ctx, char* buf, size_t len) {
+    auto* src = (MemorySource*)ctx;
+    size_t n = std::min(len, src->len - src->pos);
+
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+
+    return n;
+}
+
+/// Stores the value token of a section member
+static void assign(SectionSettings& section,
+                   const char* key,
+                   const JsonReader& reader,
+                   JsonReader::Token token) {
+    if (strcmp(key, "section_name") == 0) {
+        snprintf(section.name, sizeof(section.name), "%s", reader.text());
+    } else if (strcmp(key, "enabled") == 0) {
+        section.enabled = token == JsonReader::Token::True;
+    } else if (strcmp(key, "duration_seconds") == 0) {
+        section.duration_seconds = reader.number();
+    } else if (strcmp(key, "wet_threshold") == 0) {
+        section.wet_threshold = reader.number();
+    } else if (strcmp(key, "target_litres") == 0) {
+        section.target_litres = reader.number();
+    }
+}
+
+/// Decodes either body, sections are the objects at given depth, one of them for POST
+static bool decode_with_reader(const char* body, int section_depth, BulkConfiguration& conf) {
+    auto src = MemorySource{.data = body, .len = strlen(body), .pos = 0};
+    JsonReader reader(read_memory, &src);
+
+    char key[JsonReader::MAX_TEXT + 1] = {};
+    int depth = 0;
+
+    for (auto token = reader.next(); token != JsonReader::Token::End; token = reader.next()) {
+        switch (token) {
+            case JsonReader::Token::Error:
+                return false;
+
+            case JsonReader::Token::BeginObject:
+                depth++;
+                if (depth == section_depth) {
+                    if (conf.sections_count == MAX_SECTIONS) {
+                        return false;
+                    }
+                    conf.sections[conf.sections_count++] = {};
+                }
+                break;
+
+            case JsonReader::Token::BeginArray:
+                depth++;
+                break;
+
+            case JsonReader::Token::EndObject:
+            case JsonReader::Token::EndArray:
+                depth--;
+                break;
+
+            case JsonReader::Token::Key:
+                strcpy(key, reader.text());
+                break;
+
+            default:
+                if (depth == 1 && strcmp(key, "version") == 0) {
+                    conf.base_version = reader.number();
+                } else if (depth == 2 && strcmp(key, "hour") == 0) {
+                    conf.schedule.hour = reader.number();
+                } else if (depth == 2 && strcmp(key, "minute") == 0) {
+                    conf.schedule.minute = reader.number();
+                } else if (depth == section_depth && conf.sections_count > 0) {
+                    assign(conf.sections[conf.sections_count - 1], key, reader, token);
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+static double number(const cJSON* object, const char* name) {
+    const auto* item = cJSON_GetObjectItem(object, name);
+
+    return cJSON_IsNumber(item) ? item->valuedouble : 0;
+}
+
+static void pick_section(const cJSON* item, SectionSettings& section) {
+    section = {};
+
+    const auto* name = cJSON_GetObjectItem(item, "section_name");
+    if (cJSON_IsString(name)) {
+        snprintf(section.name, sizeof(section.name), "%s", name->valuestring);
+    }
+
+    section.enabled = cJSON_IsTrue(cJSON_GetObjectItem(item, "enabled"));
+    section.duration_seconds = number(item, "duration_seconds");
+    section.wet_threshold = number(item, "wet_threshold");
+    section.target_litres = number(item, "target_litres");
+}
+
+static bool decode_post_with_cjson(const char* body, int, BulkConfiguration& conf) {
+    auto* root = cJSON_Parse(body);
+    if (root == nullptr) {
+        return false;
+    }
+
+    pick_section(root, conf.sections[conf.sections_count++]);
+    cJSON_Delete(root);
+
+    return true;
+}
+
+static bool decode_put_with_cjson(const char* body, int, BulkConfiguration& conf) {
+    auto* root = cJSON_Parse(body);
+    if (root == nullptr) {
+        return false;
+    }
+
+    conf.base_version = number(root, "version");
+
+    const auto* schedule = cJSON_GetObjectItem(root, "schedule");
+    conf.schedule.hour = number(schedule, "hour");
+    conf.schedule.minute = number(schedule, "minute");
+
+    const cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "sections")) {
+        if (conf.sections_count == MAX_SECTIONS) {
+            break;
+        }
+
+        pick_section(item, conf.sections[conf.sections_count++]);
+    }
+
+    cJSON_Delete(root);
+
+    return true;
+}
+
+static bool same(const BulkConfiguration& a, const BulkConfiguration& b) {
+    if (a.base_version != b.base_version || a.schedule.hour != b.schedule.hour ||
+        a.schedule.minute != b.schedule.minute || a.sections_count != b.sections_count) {
+        return false;
+    }
+
+    for (int i = 0; i < a.sections_count; i++) {
+        const auto& x = a.sections[i];
+        const auto& y = b.sections[i];
+
+        if (strcmp(x.name, y.name) != 0 || x.enabled != y.enabled ||
+            x.duration_seconds != y.duration_seconds || x.wet_threshold != y.wet_threshold ||
+            x.target_litres != y.target_litres) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+using Decoder = bool (*)(const char* body, int section_depth, BulkConfiguration& conf);
+
+/// Nanoseconds per parse, conf holds the last result. False if any parse failed.
+static bool measure(Decoder decode,
+                    const char* body,
+                    int section_depth,
+                    int runs,
+                    BulkConfiguration& conf,
+                    double& ns) {
+    bool ok = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        conf = {};
+        ok &= decode(body, section_depth, conf);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ns = std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+    return ok;
+}
+
+static bool compare(const char* name, const char* body, int section_depth, Decoder cjson, int runs) {
+    auto reader_conf = BulkConfiguration{};
+    auto cjson_conf = BulkConfiguration{};
+    double reader_ns = 0;
+    double cjson_ns = 0;
+
+    new_heap = {};
+    count_new = true;
+    bool ok = measure(decode_with_reader, body, section_depth, runs, reader_conf, reader_ns);
+    count_new = false;
+
+    auto hooks = cJSON_Hooks{.malloc_fn = counting_malloc, .free_fn = counting_free};
+    cJSON_InitHooks(&hooks);
+    cjson_heap = {};
+    ok &= measure(cjson, body, section_depth, runs, cjson_conf, cjson_ns);
+    cJSON_InitHooks(nullptr);
+
+    if (!ok || !same(reader_conf, cjson_conf)) {
+        fprintf(stderr, "%s: parsers disagree on the sample body\n", name);
+        return false;
+    }
+
+    printf("%s, %zu byte body, %d runs each\n", name, strlen(body), runs);
+    printf("  JsonReader %8.0f ns per parse, %u allocations each, heap peak %zu bytes\n",
+           reader_ns,
+           new_heap.allocations / runs,
+           new_heap.peak);
+    printf("  cJSON      %8.0f ns per parse, %u allocations each, heap peak %zu bytes\n",
+           cjson_ns,
+           cjson_heap.allocations / runs,
+           cjson_heap.peak);
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int runs = 100000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            runs = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--runs N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("JsonReader is %zu bytes on the stack, its buffer included\n", sizeof(JsonReader));
+
+    bool ok = compare("POST /configuration", POST_BODY, 1, decode_post_with_cjson, runs);
+    ok &= compare("PUT /configuration", PUT_BODY, 3, decode_put_with_cjson, runs);
+
+    return ok ? 0 : 1;
+}
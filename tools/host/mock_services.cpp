@@ -0,0 +1,422 @@
+#include "mock_services.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <thread>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+static const char* TAG = "Mock";
+
+// Raw readings of the mocked probes
+static const uint16_t DRY_RAW = 3000;
+static const uint16_t WET_RAW = 1200;
+
+void MockLatency::spend() const {
+    static thread_local std::minstd_rand random(esp_timer_get_time());
+
+    auto us = base_us;
+    if (jitter_us > 0) {
+        us += std::uniform_int_distribution<int64_t>(0, jitter_us)(random);
+    }
+
+    if (us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+MockClock::MockClock(Reactor& reactor,
+                     EventBus& events,
+                     SockPtr watering,
+                     SockPtr web,
+                     MockLatency latency,
+                     MockAlarms alarms)
+    : ServiceBase(reactor, events),
+      watering_(std::move(watering)),
+      web_(std::move(web)),
+      latency_(latency),
+      alarms_(alarms),
+      interrupt_arrived_(xSemaphoreCreateBinary()) {
+    reactor_.listen(*web_, Lane::Web, "web");
+    reactor_.on(*web_, Message::Type::Status, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::Status;
+        resp.seq = msg.seq;
+        resp.clock_status = get_status();
+
+        web_->send(resp);
+    });
+
+    // After the web, so on the web lane alarms are served behind pending web requests
+    reactor_.on_signal(interrupt_arrived_, alarms_.lane, "rtc_int", [this] { on_interrupt(); });
+    reactor_.listen(*watering_, alarms_.lane, "watering");
+}
+
+void MockClock::start() {
+    if (alarms_.period > 0) {
+        xTaskCreate(rtc_task, "rtc", 2048, this, 10, NULL);
+    }
+}
+
+/// Stands in for the RTC interrupt handler, raises an alarm every period
+void MockClock::rtc_task(void* param) {
+    auto* that = (MockClock*)param;
+
+    for (;;) {
+        vTaskDelay(that->alarms_.period);
+
+        that->isr_time_us_ = esp_timer_get_time();
+        xSemaphoreGiveFromISR(that->interrupt_arrived_, NULL);
+    }
+}
+
+void MockClock::on_interrupt() {
+    auto latency = esp_timer_get_time() - isr_time_us_;
+    irq_latency_max_us_ = std::max(irq_latency_max_us_.load(), latency);
+
+    auto msg = Message{};
+    msg.type = Message::Type::Alarm1Expired;
+    watering_->send(msg);
+
+    counters_.alarms_handled[0]++;
+}
+
+ClockStatus MockClock::get_status() {
+    ClockStatus res = {};
+
+    time_t now = time(nullptr);
+    res.time_valid = true;
+    localtime_r(&now, &res.time);
+
+    res.temperature_valid = true;
+    res.temperature = 21.25f;
+
+    res.alarm1_set = true;
+    res.alarm1.tm_hour = 18;
+    res.alarm1.tm_min = 30;
+
+    res.irq_latency_max_us = irq_latency_max_us_;
+
+    res.sockets.add(watering_->status("watering"));
+    res.sockets.add(web_->status("web"));
+
+    return res;
+}
+
+MockMoisture::MockMoisture(Reactor& reactor, EventBus& events, SockPtr web, MockLatency latency)
+    : ServiceBase(reactor, events), web_(std::move(web)), latency_(latency) {
+    counters_.channels_count = CHANNELS;
+    calibration_.fill({.dry_raw = DRY_RAW, .wet_raw = WET_RAW});
+
+    reactor_.listen(*web_, Lane::Web, "web");
+    reactor_.on(*web_, Message::Type::Status, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::Status;
+        resp.seq = msg.seq;
+        resp.moisture_status = get_status();
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::Calibrate, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::Calibrate;
+        resp.seq = msg.seq;
+        resp.calibration_result = calibrate(msg.calibration_request);
+
+        web_->send(resp);
+    });
+}
+
+MoistureStatus MockMoisture::get_status() {
+    MoistureStatus res = {};
+    res.channels_count = CHANNELS;
+
+    for (int i = 0; i < CHANNELS; i++) {
+        auto& channel = res.channels[i];
+        const auto& calibration = calibration_[i];
+
+        channel.raw = 2000 + 150 * i;
+        channel.voltage = channel.raw * 3300 / 4095;
+        channel.moisture = (float)((int)calibration.dry_raw - (int)channel.raw) /
+                           ((int)calibration.dry_raw - (int)calibration.wet_raw);
+        channel.confidence = 1;
+        channel.calibration = calibration;
+
+        counters_.reads[i]++;
+    }
+
+    res.sockets.add(web_->status("web"));
+
+    return res;
+}
+
+CalibrationResult MockMoisture::calibrate(const CalibrationRequest& req) {
+    auto res = CalibrationResult{.error = nullptr, .channel = req.channel};
+
+    if (req.channel < 0 || req.channel >= CHANNELS) {
+        res.error = "unknown channel";
+        return res;
+    }
+
+    auto& calibration = calibration_[req.channel];
+    uint16_t raw = req.raw < 0 ? 2000 : req.raw;
+
+    if (req.point == CalibrationRequest::Point::Dry) {
+        calibration.dry_raw = raw;
+    } else {
+        calibration.wet_raw = raw;
+    }
+
+    res.calibration = calibration;
+    status_version_.bump();
+
+    return res;
+}
+
+MockWatering::MockWatering(Reactor& reactor,
+                           EventBus& events,
+                           SockPtr clock,
+                           SockPtr web,
+                           SockPtr web_stop,
+                           MockLatency latency,
+                           MockAlarms alarms)
+    : ServiceBase(reactor, events),
+      clock_(std::move(clock)),
+      web_(std::move(web)),
+      web_stop_(std::move(web_stop)),
+      latency_(latency) {
+    static const char* NAMES[SECTIONS] = {"Vegetables", "Flowers", "Terrace", "Grass"};
+
+    counters_.sections_count = SECTIONS;
+    for (int i = 0; i < SECTIONS; i++) {
+        counters_.names[i] = NAMES[i];
+        sections_[i] = SectionConfiguration{.name = NAMES[i],
+                                            .enabled = i == 0,
+                                            .duration_seconds = 5 * 60,
+                                            .wet_threshold = 0.6f,
+                                            .target_litres = 0};
+    }
+
+    reactor_.listen(*web_, Lane::Web, "web");
+    reactor_.on(*web_, Message::Type::Status, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::Status;
+        resp.seq = msg.seq;
+        resp.watering_status = get_status();
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::GetConfiguration, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::GetConfiguration;
+        resp.seq = msg.seq;
+        resp.configuration = get_configuration();
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::SetConfiguration, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::GetConfiguration;
+        resp.seq = msg.seq;
+        resp.configuration = set_configuration(msg.section_settings);
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::SetBulkConfiguration, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::SetBulkConfiguration;
+        resp.seq = msg.seq;
+        resp.configuration_result = apply_configuration(msg.bulk_configuration);
+
+        web_->send(resp);
+    });
+    reactor_.on(*web_, Message::Type::Job, [this](const Message& msg) {
+        latency_.spend();
+
+        Message resp = {};
+        resp.type = Message::Type::Job;
+        resp.seq = msg.seq;
+        resp.job_result = handle_job(msg);
+
+        web_->send(resp);
+    });
+
+    // Stop closes valves and nothing else, it takes no simulated service time
+    reactor_.listen(*web_stop_, Lane::Control, "web_stop");
+    reactor_.on(*web_stop_, Message::Type::Job, [this](const Message& msg) {
+        Message resp = {};
+        resp.type = Message::Type::Job;
+        resp.seq = msg.seq;
+        resp.job_result = handle_job(msg);
+
+        web_stop_->send(resp);
+    });
+
+    // Alarm only starts the cycle on the device, here it is just timed. Registered after the web
+    // like the clock's.
+    reactor_.listen(*clock_, alarms.lane, "clock");
+    reactor_.on(*clock_, Message::Type::Alarm1Expired, [this](const Message& msg) {
+        alarm_latency_last_us_ = esp_timer_get_time() - msg.sent_us;
+        alarm_latency_max_us_ = std::max(alarm_latency_max_us_.load(), alarm_latency_last_us_);
+    });
+}
+
+WateringStatus MockWatering::get_status() {
+    WateringStatus res = {};
+    res.current_section = sections_[0].name;
+    res.alarm_latency_last_us = alarm_latency_last_us_;
+    res.alarm_latency_max_us = alarm_latency_max_us_;
+    res.uptime_ms = esp_timer_get_time() / 1000;
+    res.sections_count = SECTIONS;
+
+    for (int i = 0; i < SECTIONS; i++) {
+        res.forecast[i] = SectionForecast{.drying_rate = nanf(""),
+                                          .moisture_at_cycle = 0.5f,
+                                          .moisture_day_after = 0.4f,
+                                          .planned_seconds = sections_[i].duration_seconds};
+    }
+
+    res.jobs_queued = jobs_queued_;
+    res.paused = paused_;
+    res.sockets.add(clock_->status("clock"));
+    res.sockets.add(web_->status("web"));
+    res.sockets.add(web_stop_->status("web_stop"));
+
+    return res;
+}
+
+WateringConfiguration MockWatering::get_configuration() {
+    WateringConfiguration res = {};
+    res.applied = true;
+    res.version = config_version_.get();
+    res.schedule = schedule_;
+    res.sections_count = SECTIONS;
+
+    for (int i = 0; i < SECTIONS; i++) {
+        res.sections[i] = sections_[i];
+    }
+
+    return res;
+}
+
+int MockWatering::find_section(const char* name) const {
+    for (int i = 0; i < SECTIONS; i++) {
+        if (strncmp(sections_[i].name, name, sizeof(SectionSettings::name)) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+WateringConfiguration MockWatering::set_configuration(const SectionSettings& settings) {
+    int section = find_section(settings.name);
+
+    if (section < 0) {
+        auto res = get_configuration();
+        res.applied = false;
+        return res;
+    }
+
+    auto& conf = sections_[section];
+    conf.enabled = settings.enabled;
+    conf.duration_seconds = settings.duration_seconds;
+    conf.wet_threshold = settings.wet_threshold;
+    conf.target_litres = settings.target_litres;
+    config_version_.bump();
+
+    return get_configuration();
+}
+
+ConfigurationResult MockWatering::apply_configuration(const BulkConfiguration& conf) {
+    auto result = [this](ConfigurationResult::Status status, const char* error) {
+        return ConfigurationResult{
+            .status = status, .version = config_version_.get(), .error = error};
+    };
+
+    if (conf.base_version != config_version_.get()) {
+        return result(ConfigurationResult::Status::Conflict, "configuration changed meanwhile");
+    }
+
+    if (conf.sections_count != SECTIONS) {
+        return result(ConfigurationResult::Status::Invalid, "all sections must be given");
+    }
+
+    for (int i = 0; i < SECTIONS; i++) {
+        if (find_section(conf.sections[i].name) < 0) {
+            return result(ConfigurationResult::Status::Invalid, "unknown section");
+        }
+    }
+
+    for (int i = 0; i < SECTIONS; i++) {
+        auto& section = sections_[find_section(conf.sections[i].name)];
+        section.enabled = conf.sections[i].enabled;
+        section.duration_seconds = conf.sections[i].duration_seconds;
+        section.wet_threshold = conf.sections[i].wet_threshold;
+        section.target_litres = conf.sections[i].target_litres;
+    }
+
+    schedule_ = conf.schedule;
+    config_version_.bump();
+
+    return result(ConfigurationResult::Status::Applied, nullptr);
+}
+
+JobResult MockWatering::handle_job(const Message& msg) {
+    const auto& req = msg.job_request;
+    auto res = JobResult{};
+
+    switch (req.action) {
+        case JobRequest::Action::Water:
+            if (find_section(req.section_name) < 0) {
+                res.error = "unknown section";
+                break;
+            }
+            res.job_id = next_job_id_++;
+            jobs_queued_++;
+            counters_.jobs++;
+            break;
+
+        case JobRequest::Action::Pause:
+            paused_ = true;
+            break;
+
+        case JobRequest::Action::Resume:
+            paused_ = false;
+            break;
+
+        case JobRequest::Action::StopAll:
+            ESP_LOGI(TAG, "Stopping all watering");
+            jobs_queued_ = 0;
+            paused_ = false;
+            counters_.stops++;
+            res.stop_latency_us = esp_timer_get_time() - msg.job_request.admitted_us;
+            break;
+    }
+
+    res.jobs_queued = jobs_queued_;
+    res.paused = paused_;
+    status_version_.bump();
+
+    return res;
+}
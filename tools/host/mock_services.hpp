@@ -0,0 +1,146 @@
+#pragma once
+
+#include "service_base.hpp"
+#include "service_counters.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <freertos/semphr.h>
+
+/// Time a mocked service takes to answer a request. The reactor task is blocked meanwhile, like
+/// it is by I2C or ADC access of the real service.
+struct MockLatency {
+    int64_t base_us;
+    // Uniformly distributed on top of the base
+    int64_t jitter_us;
+
+    void spend() const;
+};
+
+/// RTC alarms raised by the mocked clock, to measure how long the control plane waits behind the
+/// web. Each alarm takes the path of a real one: interrupt semaphore, clock handler, Alarm1Expired
+/// to watering.
+struct MockAlarms {
+    // 0 raises none
+    TickType_t period;
+    // Lane of the interrupt and the clock to watering socket, Control as in the firmware
+    Reactor::Lane lane;
+};
+
+/// Stand-ins for the services, registered to the reactor the same way, answering the web with
+/// made up but plausible state. No hardware is touched.
+class MockClock : public ServiceBase {
+ public:
+    MockClock(Reactor& reactor,
+              EventBus& events,
+              SockPtr watering,
+              SockPtr web,
+              MockLatency latency,
+              MockAlarms alarms);
+
+    /// Starts raising alarms
+    void start() override;
+
+    const ClockCounters& counters() const {
+        return counters_;
+    }
+
+    /// From the interrupt until its handler ran, worst so far
+    int64_t irq_latency_max_us() const {
+        return irq_latency_max_us_;
+    }
+
+ private:
+    static void rtc_task(void* param);
+
+    void on_interrupt();
+    ClockStatus get_status();
+
+    SockPtr watering_;
+    SockPtr web_;
+    MockLatency latency_;
+    MockAlarms alarms_;
+    ClockCounters counters_;
+
+    SemaphoreHandle_t interrupt_arrived_;
+    std::atomic<int64_t> isr_time_us_ = 0;
+    std::atomic<int64_t> irq_latency_max_us_ = 0;
+};
+
+class MockMoisture : public ServiceBase {
+ public:
+    MockMoisture(Reactor& reactor, EventBus& events, SockPtr web, MockLatency latency);
+
+    void start() override {
+    }
+
+    const MoistureCounters& counters() const {
+        return counters_;
+    }
+
+ private:
+    static const int CHANNELS = 4;
+
+    MoistureStatus get_status();
+    CalibrationResult calibrate(const CalibrationRequest& req);
+
+    SockPtr web_;
+    MockLatency latency_;
+    MoistureCounters counters_;
+    std::array<ChannelCalibration, CHANNELS> calibration_;
+};
+
+class MockWatering : public ServiceBase {
+ public:
+    MockWatering(Reactor& reactor,
+                 EventBus& events,
+                 SockPtr clock,
+                 SockPtr web,
+                 SockPtr web_stop,
+                 MockLatency latency,
+                 MockAlarms alarms);
+
+    void start() override {
+    }
+
+    const StateVersion& configuration_version() const {
+        return config_version_;
+    }
+
+    const WateringCounters& counters() const {
+        return counters_;
+    }
+
+    /// From Alarm1Expired leaving the clock until it was handled, worst so far
+    int64_t alarm_latency_max_us() const {
+        return alarm_latency_max_us_;
+    }
+
+ private:
+    static const int SECTIONS = 4;
+
+    WateringStatus get_status();
+    WateringConfiguration get_configuration();
+    WateringConfiguration set_configuration(const SectionSettings& settings);
+    ConfigurationResult apply_configuration(const BulkConfiguration& conf);
+    JobResult handle_job(const Message& msg);
+    int find_section(const char* name) const;
+
+    SockPtr clock_;
+    SockPtr web_;
+    SockPtr web_stop_;
+    MockLatency latency_;
+    WateringCounters counters_;
+    StateVersion config_version_;
+
+    Schedule schedule_ = {.hour = 18, .minute = 30};
+    std::array<SectionConfiguration, SECTIONS> sections_;
+    uint32_t next_job_id_ = 1;
+    int jobs_queued_ = 0;
+    bool paused_ = false;
+
+    int64_t alarm_latency_last_us_ = 0;
+    std::atomic<int64_t> alarm_latency_max_us_ = 0;
+};
@@ -0,0 +1,84 @@
+#include <esp_app_desc.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <random>
+
+static const auto start = std::chrono::steady_clock::now();
+
+static esp_log_level_t log_level = ESP_LOG_INFO;
+
+int64_t esp_timer_get_time() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    static const char LETTERS[] = "NEWIDV";
+
+    if (level > log_level) {
+        return;
+    }
+
+    // One line in one write, lines of different tasks do not interleave
+    char line[512];
+    int n = snprintf(line,
+                     sizeof(line),
+                     "%c (%lld) %s: ",
+                     LETTERS[level],
+                     (long long)(esp_timer_get_time() / 1000),
+                     tag);
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + n, sizeof(line) - n, format, args);
+    va_end(args);
+
+    fprintf(stderr, "%s\n", line);
+}
+
+uint32_t esp_random() {
+    static std::random_device device;
+
+    return device();
+}
+
+int esp_app_get_elf_sha256(char* buf, size_t size) {
+    return snprintf(buf, size, "%s", "0000000000000000");
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_HTTPD_RESP_SEND:
+            return "ESP_ERR_HTTPD_RESP_SEND";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
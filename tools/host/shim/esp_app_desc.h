@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+/// Fills buf with hex digits, a fixed value on the host
+int esp_app_get_elf_sha256(char* buf, size_t size);
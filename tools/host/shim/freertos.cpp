@@ -0,0 +1,254 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One lock guards all queues, like a kernel on a single core. Posting to a member and to its set
+// is then atomic, and the set never disagrees with its members. Waiters are woken on any change
+// and check their own condition, cheap enough for a handful of tasks.
+static std::mutex kernel;
+static std::condition_variable changed;
+
+static const auto start = std::chrono::steady_clock::now();
+
+struct QueueDefinition {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    // Ring of length items, empty for semaphores, which only count
+    std::vector<uint8_t> storage;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+
+    // Set the queue belongs to, if any
+    QueueDefinition* set = nullptr;
+};
+
+using Lock = std::unique_lock<std::mutex>;
+
+/// Waits until ready() holds or wait ticks pass, returns the last result of ready()
+template <typename F>
+static bool wait_for(Lock& lock, TickType_t wait, F ready) {
+    if (wait == portMAX_DELAY) {
+        changed.wait(lock, ready);
+        return true;
+    }
+
+    return changed.wait_for(lock, std::chrono::milliseconds(wait * portTICK_PERIOD_MS), ready);
+}
+
+static void push_locked(QueueDefinition* queue, const void* item, bool overwrite) {
+    auto previous = queue->count;
+
+    if (overwrite && queue->count > 0) {
+        queue->count--;
+    }
+
+    if (queue->item_size > 0) {
+        auto tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->storage[tail * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+
+    // Overwriting an item that was there already does not post to the set again
+    if (queue->set && (previous == 0 || !overwrite)) {
+        configASSERT(queue->set->count < queue->set->length);
+        push_locked(queue->set, &queue, false);
+    }
+}
+
+static void pop_locked(QueueDefinition* queue, void* item, bool peek) {
+    if (queue->item_size > 0 && item) {
+        memcpy(item, &queue->storage[queue->head * queue->item_size], queue->item_size);
+    }
+
+    if (!peek) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return new QueueDefinition{.length = length,
+                               .item_size = item_size,
+                               .storage = std::vector<uint8_t>(length * item_size)};
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length,
+                                 UBaseType_t item_size,
+                                 uint8_t* storage,
+                                 StaticQueue_t* queue) {
+    return xQueueCreate(length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t wait) {
+    Lock lock(kernel);
+
+    if (!wait_for(lock, wait, [queue] { return queue->count < queue->length; })) {
+        return errQUEUE_FULL;
+    }
+
+    push_locked(queue, item, false);
+    changed.notify_all();
+
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    configASSERT(queue->length == 1);
+
+    Lock lock(kernel);
+    push_locked(queue, item, true);
+    changed.notify_all();
+
+    return pdPASS;
+}
+
+static BaseType_t receive(QueueHandle_t queue, void* item, TickType_t wait, bool peek) {
+    Lock lock(kernel);
+
+    if (!wait_for(lock, wait, [queue] { return queue->count > 0; })) {
+        return errQUEUE_EMPTY;
+    }
+
+    pop_locked(queue, item, peek);
+    if (!peek) {
+        changed.notify_all();
+    }
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    return receive(queue, item, wait, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait) {
+    return receive(queue, item, wait, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    Lock lock(kernel);
+
+    return queue->count;
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length) {
+    return xQueueCreate(length, sizeof(QueueSetMemberHandle_t));
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set) {
+    Lock lock(kernel);
+
+    if (member->set || member->count > 0) {
+        return pdFAIL;
+    }
+
+    member->set = set;
+
+    return pdPASS;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t wait) {
+    QueueSetMemberHandle_t member = nullptr;
+
+    if (xQueueReceive(set, &member, wait) != pdPASS) {
+        return nullptr;
+    }
+
+    return member;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    auto* mutex = xQueueCreate(1, 0);
+    xSemaphoreGive(mutex);
+
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    auto* semaphore = xQueueCreate(max, 0);
+    semaphore->count = initial;
+
+    return semaphore;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+    if (woken) {
+        *woken = pdFALSE;
+    }
+
+    return xSemaphoreGive(semaphore);
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code,
+                       const char* name,
+                       uint32_t stack_size,
+                       void* arg,
+                       UBaseType_t priority,
+                       TaskHandle_t* handle) {
+    std::thread thread(code, arg);
+
+    // Linux limits thread names to 15 characters
+    char short_name[16] = {};
+    strncpy(short_name, name, sizeof(short_name) - 1);
+    pthread_setname_np(thread.native_handle(), short_name);
+
+    thread.detach();
+
+    if (handle) {
+        *handle = nullptr;
+    }
+
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code,
+                               const char* name,
+                               uint32_t stack_size,
+                               void* arg,
+                               UBaseType_t priority,
+                               StackType_t* stack,
+                               StaticTask_t* task) {
+    xTaskCreate(code, name, stack_size, arg, priority, nullptr);
+
+    return nullptr;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return (TickType_t)(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() /
+                        portTICK_PERIOD_MS);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "queue.h"
+
+// Semaphores are queues of empty items, as in FreeRTOS. Mutex has no priority inheritance and
+// is not recursive.
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+
+// Storage is not used, semaphores are always on heap
+#define xSemaphoreCreateBinaryStatic(storage) ((void)(storage), xSemaphoreCreateBinary())
+#define xSemaphoreCreateMutexStatic(storage) ((void)(storage), xSemaphoreCreateMutex())
+#define xSemaphoreCreateCountingStatic(max, initial, storage) \
+    ((void)(storage), xSemaphoreCreateCounting(max, initial))
+
+#define xSemaphoreTake(semaphore, wait) xQueueReceive(semaphore, nullptr, wait)
+#define xSemaphoreGive(semaphore) xQueueSendToBack(semaphore, nullptr, 0)
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+struct tskTaskControlBlock;
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+/// Runs the task on a detached thread, stack size and priority are not applied
+BaseType_t xTaskCreate(TaskFunction_t code,
+                       const char* name,
+                       uint32_t stack_size,
+                       void* arg,
+                       UBaseType_t priority,
+                       TaskHandle_t* handle);
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code,
+                               const char* name,
+                               uint32_t stack_size,
+                               void* arg,
+                               UBaseType_t priority,
+                               StackType_t* stack,
+                               StaticTask_t* task);
+
+void vTaskDelay(TickType_t ticks);
+
+/// Ticks since the program started
+TickType_t xTaskGetTickCount();
@@ -0,0 +1,806 @@
+#include <esp_http_server.h>
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+static const char* TAG = "httpd";
+
+// Longest request line and headers accepted
+static const size_t MAX_HEADER_SIZE = 4096;
+
+static int port_override = -1;
+static int max_open_sockets_override = -1;
+static int lru_purge_override = -1;
+
+struct Session {
+    // -1 if the slot is free
+    int fd = -1;
+    uint64_t lru = 0;
+    // Request was handed over to another task, the socket is not polled until it completes
+    bool async = false;
+    // Close was asked for while the request was away
+    bool close_pending = false;
+    // Received past the end of the request header, start of the body or of the next request
+    std::string pending;
+};
+
+struct Server {
+    httpd_config_t config;
+    int listen_fd = -1;
+    // Written to wake the server task up, for queued work, closes and completed async requests
+    int wake[2] = {-1, -1};
+    uint16_t port = 0;
+
+    std::vector<httpd_uri_t> handlers;
+
+    // Guards what other tasks touch, sessions and the queues below
+    std::mutex lock;
+    std::vector<Session> sessions;
+    uint64_t lru_counter = 0;
+    httpd_host_stats_t stats = {};
+    std::deque<std::pair<httpd_work_fn_t, void*>> work;
+    std::vector<int> to_close;
+};
+
+/// State of a request and its response, behind httpd_req_t::aux
+struct Aux {
+    Server* server;
+    Session* session;
+    int fd;
+
+    std::vector<std::pair<std::string, std::string>> headers;
+    // Body bytes not read yet
+    size_t body_left;
+
+    const char* status = "200 OK";
+    const char* type = HTTPD_TYPE_TEXT;
+    std::vector<std::pair<const char*, const char*>> resp_headers;
+    // Chunked response started
+    bool chunked = false;
+    // Sending failed, session is closed once the request is done
+    bool failed = false;
+    // Handler called httpd_req_async_handler_begin()
+    bool went_async = false;
+};
+
+static Aux* aux_of(httpd_req_t* r) {
+    return (Aux*)r->aux;
+}
+
+static void wake_up(Server* server) {
+    char c = 0;
+    (void)!write(server->wake[1], &c, 1);
+}
+
+static bool send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        auto n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/// Status line and headers, length is -1 for a chunked response
+static bool send_head(Aux* aux, ssize_t length) {
+    std::string head = "HTTP/1.1 ";
+    head += aux->status;
+    head += "\r\nContent-Type: ";
+    head += aux->type;
+    head += "\r\n";
+
+    if (length < 0) {
+        head += "Transfer-Encoding: chunked\r\n";
+    } else {
+        head += "Content-Length: " + std::to_string(length) + "\r\n";
+    }
+
+    for (auto& [field, value] : aux->resp_headers) {
+        head += field;
+        head += ": ";
+        head += value;
+        head += "\r\n";
+    }
+    head += "\r\n";
+
+    return send_all(aux->fd, head.data(), head.size());
+}
+
+static esp_err_t sent(Aux* aux, bool ok) {
+    if (!ok) {
+        aux->failed = true;
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    aux_of(r)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    aux_of(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    auto* aux = aux_of(r);
+
+    if (aux->resp_headers.size() >= aux->server->config.max_resp_headers) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+
+    aux->resp_headers.emplace_back(field, value);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    auto* aux = aux_of(r);
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+
+    return sent(aux, send_head(aux, buf_len) && send_all(aux->fd, buf, buf_len));
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    auto* aux = aux_of(r);
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+
+    if (!aux->chunked) {
+        aux->chunked = true;
+        if (!send_head(aux, -1)) {
+            return sent(aux, false);
+        }
+    }
+
+    if (buf == nullptr || buf_len == 0) {
+        return sent(aux, send_all(aux->fd, "0\r\n\r\n", 5));
+    }
+
+    char size[16];
+    int n = snprintf(size, sizeof(size), "%zx\r\n", (size_t)buf_len);
+
+    return sent(aux,
+                send_all(aux->fd, size, n) && send_all(aux->fd, buf, buf_len) &&
+                    send_all(aux->fd, "\r\n", 2));
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t* r, const char* str) {
+    return httpd_resp_send(r, str, str ? strlen(str) : 0);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    const char* status = "500 Internal Server Error";
+    const char* text = "Server has encountered an unexpected error";
+
+    switch (error) {
+        case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+            status = "501 Method Not Implemented";
+            text = "Request method is not supported by server";
+            break;
+        case HTTPD_505_VERSION_NOT_SUPPORTED:
+            status = "505 Version Not Supported";
+            text = "HTTP version not supported by server";
+            break;
+        case HTTPD_400_BAD_REQUEST:
+            status = "400 Bad Request";
+            text = "Bad request syntax";
+            break;
+        case HTTPD_401_UNAUTHORIZED:
+            status = "401 Unauthorized";
+            text = "No permission -- see authorization schemes";
+            break;
+        case HTTPD_403_FORBIDDEN:
+            status = "403 Forbidden";
+            text = "Request forbidden -- authorization will not help";
+            break;
+        case HTTPD_404_NOT_FOUND:
+            status = "404 Not Found";
+            text = "Nothing matches the given URI";
+            break;
+        case HTTPD_405_METHOD_NOT_ALLOWED:
+            status = "405 Method Not Allowed";
+            text = "Specified method is invalid for this resource";
+            break;
+        case HTTPD_408_REQ_TIMEOUT:
+            status = "408 Request Timeout";
+            text = "Server closed this connection";
+            break;
+        case HTTPD_411_LENGTH_REQUIRED:
+            status = "411 Length Required";
+            text = "Client must specify Content-Length";
+            break;
+        case HTTPD_414_URI_TOO_LONG:
+            status = "414 URI Too Long";
+            text = "URI is too long";
+            break;
+        case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE:
+            status = "431 Request Header Fields Too Large";
+            text = "Header fields are too long";
+            break;
+        default:
+            break;
+    }
+
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+
+    return httpd_resp_sendstr(req, msg ? msg : text);
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    auto* aux = aux_of(r);
+    auto& pending = aux->session->pending;
+
+    size_t len = std::min(buf_len, aux->body_left);
+    if (len == 0) {
+        return 0;
+    }
+
+    if (!pending.empty()) {
+        len = std::min(len, pending.size());
+        memcpy(buf, pending.data(), len);
+        pending.erase(0, len);
+        aux->body_left -= len;
+
+        return len;
+    }
+
+    auto n = recv(aux->fd, buf, len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (n <= 0) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+
+    aux->body_left -= n;
+    return n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    return aux_of(r)->fd;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r,
+                                      const char* field,
+                                      char* val,
+                                      size_t val_size) {
+    for (auto& [name, value] : aux_of(r)->headers) {
+        if (strcasecmp(name.c_str(), field) != 0) {
+            continue;
+        }
+
+        if (val_size == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        snprintf(val, val_size, "%s", value.c_str());
+        return value.size() < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    auto* aux = aux_of(r);
+    auto* copy = new httpd_req_t(*r);
+    copy->aux = new Aux(*aux);
+
+    aux->went_async = true;
+    {
+        std::lock_guard<std::mutex> guard(aux->server->lock);
+        aux->session->async = true;
+    }
+
+    *out = copy;
+    return ESP_OK;
+}
+
+/// Reads and drops what the handler left of the body, so the next request starts where it should
+static bool discard_body(httpd_req_t* r) {
+    char buf[256];
+
+    while (aux_of(r)->body_left > 0) {
+        if (httpd_req_recv(r, buf, sizeof(buf)) <= 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    auto* aux = aux_of(r);
+    auto* server = aux->server;
+    bool keep = discard_body(r) && !aux->failed;
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        aux->session->async = false;
+        aux->session->lru = ++server->lru_counter;
+
+        if (!keep || aux->session->close_pending) {
+            server->to_close.push_back(aux->fd);
+        }
+    }
+    wake_up(server);
+
+    delete aux;
+    delete r;
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void* arg) {
+    auto* server = (Server*)handle;
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        server->work.emplace_back(work, arg);
+    }
+    wake_up(server);
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    auto* server = (Server*)handle;
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        server->to_close.push_back(sockfd);
+    }
+    wake_up(server);
+
+    return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    auto* server = (Server*)hd;
+    std::lock_guard<std::mutex> guard(server->lock);
+
+    for (auto& session : server->sessions) {
+        if (session.fd == fd) {
+            return HTTPD_WS_CLIENT_HTTP;
+        }
+    }
+
+    return HTTPD_WS_CLIENT_INVALID;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req, httpd_ws_frame_t* pkt, size_t max_len) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t* frame) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    auto* server = (Server*)handle;
+
+    if (server->handlers.size() >= server->config.max_uri_handlers) {
+        ESP_LOGW(TAG, "No slot left for %s", uri_handler->uri);
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+
+    for (auto& existing : server->handlers) {
+        if (existing.method == uri_handler->method && strcmp(existing.uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+
+    server->handlers.push_back(*uri_handler);
+    return ESP_OK;
+}
+
+/// Closes the session with the socket unless its request is away, then it is closed on completion
+static void close_session(Server* server, int fd) {
+    std::lock_guard<std::mutex> guard(server->lock);
+
+    for (auto& session : server->sessions) {
+        if (session.fd != fd) {
+            continue;
+        }
+
+        if (session.async) {
+            session.close_pending = true;
+            return;
+        }
+
+        ESP_LOGD(TAG, "Closing session %d", fd);
+        close(fd);
+        session = Session{};
+        server->stats.open--;
+        return;
+    }
+}
+
+static void accept_session(Server* server) {
+    int fd = accept(server->listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+        return;
+    }
+
+    timeval recv_timeout = {.tv_sec = server->config.recv_wait_timeout, .tv_usec = 0};
+    timeval send_timeout = {.tv_sec = server->config.send_wait_timeout, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int lru_fd = -1;
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+
+        Session* free_slot = nullptr;
+        Session* lru = nullptr;
+        for (auto& session : server->sessions) {
+            if (session.fd < 0) {
+                free_slot = free_slot ? free_slot : &session;
+            } else if (!session.async && (!lru || session.lru < lru->lru)) {
+                lru = &session;
+            }
+        }
+
+        if (free_slot) {
+            *free_slot = Session{};
+            free_slot->fd = fd;
+            free_slot->lru = ++server->lru_counter;
+
+            server->stats.accepted++;
+            server->stats.open++;
+            server->stats.open_max = std::max(server->stats.open_max, server->stats.open);
+            return;
+        }
+
+        if (server->config.lru_purge_enable && lru) {
+            lru_fd = lru->fd;
+            close(lru_fd);
+            *lru = Session{};
+            lru->fd = fd;
+            lru->lru = ++server->lru_counter;
+
+            server->stats.accepted++;
+            server->stats.purged++;
+        } else {
+            server->stats.refused++;
+        }
+    }
+
+    if (lru_fd < 0) {
+        ESP_LOGW(TAG, "No slot for new connection, closing it");
+        close(fd);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Closed least recently used session %d for a new connection", lru_fd);
+}
+
+/// Reads until the end of the request header, what follows it is left in pending
+static bool read_head(Session& session, std::string& head) {
+    for (;;) {
+        auto end = session.pending.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            head = session.pending.substr(0, end + 2);
+            session.pending.erase(0, end + 4);
+            return true;
+        }
+
+        if (session.pending.size() > MAX_HEADER_SIZE) {
+            return false;
+        }
+
+        char buf[1024];
+        auto n = recv(session.fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+
+        session.pending.append(buf, n);
+    }
+}
+
+static int parse_method(const std::string& name) {
+    static const std::pair<const char*, http_method> METHODS[] = {
+        {"DELETE", HTTP_DELETE},
+        {"GET", HTTP_GET},
+        {"HEAD", HTTP_HEAD},
+        {"POST", HTTP_POST},
+        {"PUT", HTTP_PUT},
+    };
+
+    for (auto& [text, method] : METHODS) {
+        if (name == text) {
+            return method;
+        }
+    }
+
+    return -1;
+}
+
+/// Reads one request from the session and runs its handler. Returns false if the session is to
+/// be closed.
+static bool serve_request(Server* server, Session& session) {
+    std::string head;
+    if (!read_head(session, head)) {
+        return false;
+    }
+
+    httpd_req_t req = {};
+    Aux aux = {};
+    aux.server = server;
+    aux.session = &session;
+    aux.fd = session.fd;
+    aux.body_left = 0;
+    req.handle = server;
+    req.aux = &aux;
+
+    auto line_end = head.find("\r\n");
+    auto request_line = head.substr(0, line_end);
+    auto first_space = request_line.find(' ');
+    auto second_space = request_line.find(' ', first_space + 1);
+
+    if (first_space == std::string::npos || second_space == std::string::npos) {
+        httpd_resp_send_err(&req, HTTPD_400_BAD_REQUEST, nullptr);
+        return false;
+    }
+
+    auto uri = request_line.substr(first_space + 1, second_space - first_space - 1);
+    if (uri.size() > HTTPD_MAX_URI_LEN) {
+        httpd_resp_send_err(&req, HTTPD_414_URI_TOO_LONG, nullptr);
+        return false;
+    }
+    memcpy((char*)req.uri, uri.c_str(), uri.size() + 1);
+    req.method = parse_method(request_line.substr(0, first_space));
+
+    for (auto pos = line_end + 2; pos < head.size();) {
+        auto end = head.find("\r\n", pos);
+        auto line = head.substr(pos, end - pos);
+        pos = end + 2;
+
+        auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+
+        auto value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        aux.headers.emplace_back(line.substr(0, colon), value);
+
+        if (strcasecmp(aux.headers.back().first.c_str(), "Content-Length") == 0) {
+            req.content_len = strtoul(value.c_str(), nullptr, 10);
+            aux.body_left = req.content_len;
+        }
+    }
+
+    // Query is not part of the match, like with the default IDF matcher
+    auto path = uri.substr(0, uri.find('?'));
+    const httpd_uri_t* handler = nullptr;
+    bool path_known = false;
+
+    for (auto& candidate : server->handlers) {
+        if (path == candidate.uri) {
+            path_known = true;
+            if (candidate.method == req.method) {
+                handler = &candidate;
+                break;
+            }
+        }
+    }
+
+    esp_err_t ret = ESP_OK;
+
+    if (handler == nullptr) {
+        ret = httpd_resp_send_err(
+            &req, path_known ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, nullptr);
+    } else if (handler->is_websocket) {
+        ret = httpd_resp_send_err(
+            &req, HTTPD_501_METHOD_NOT_IMPLEMENTED, "WebSocket is not supported by the host shim");
+    } else {
+        req.user_ctx = handler->user_ctx;
+        ret = handler->handler(&req);
+    }
+
+    if (aux.went_async) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        session.lru = ++server->lru_counter;
+    }
+
+    return ret == ESP_OK && !aux.failed && discard_body(&req);
+}
+
+static void run_work(Server* server) {
+    char buf[64];
+    while (read(server->wake[0], buf, sizeof(buf)) > 0) {
+    }
+
+    for (;;) {
+        std::pair<httpd_work_fn_t, void*> item;
+        {
+            std::lock_guard<std::mutex> guard(server->lock);
+            if (server->work.empty()) {
+                break;
+            }
+            item = server->work.front();
+            server->work.pop_front();
+        }
+
+        item.first(item.second);
+    }
+
+    std::vector<int> to_close;
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        std::swap(to_close, server->to_close);
+    }
+
+    for (int fd : to_close) {
+        close_session(server, fd);
+    }
+}
+
+static void server_task(void* arg) {
+    auto* server = (Server*)arg;
+
+    for (;;) {
+        std::vector<pollfd> fds = {{.fd = server->wake[0], .events = POLLIN, .revents = 0},
+                                   {.fd = server->listen_fd, .events = POLLIN, .revents = 0}};
+        {
+            std::lock_guard<std::mutex> guard(server->lock);
+            for (auto& session : server->sessions) {
+                if (session.fd >= 0 && !session.async) {
+                    fds.push_back({.fd = session.fd, .events = POLLIN, .revents = 0});
+                }
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            continue;
+        }
+
+        if (fds[0].revents) {
+            run_work(server);
+        }
+
+        if (fds[1].revents) {
+            accept_session(server);
+        }
+
+        for (size_t i = 2; i < fds.size(); i++) {
+            if (!fds[i].revents) {
+                continue;
+            }
+
+            // Only the server task frees slots, the session stays where it is meanwhile
+            Session* session = nullptr;
+            {
+                std::lock_guard<std::mutex> guard(server->lock);
+                for (auto& candidate : server->sessions) {
+                    if (candidate.fd == fds[i].fd && !candidate.async) {
+                        session = &candidate;
+                    }
+                }
+            }
+
+            // Client may have sent the next request already, it would not wake poll up
+            bool keep = session != nullptr;
+            while (keep) {
+                keep = serve_request(server, *session);
+                if (!keep || session->async ||
+                    session->pending.find("\r\n\r\n") == std::string::npos) {
+                    break;
+                }
+            }
+
+            if (session && !keep) {
+                close_session(server, fds[i].fd);
+            }
+        }
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    auto* server = new Server;
+    server->config = *config;
+
+    if (port_override >= 0) {
+        server->config.server_port = port_override;
+    }
+    if (max_open_sockets_override > 0) {
+        server->config.max_open_sockets = max_open_sockets_override;
+    }
+    if (lru_purge_override >= 0) {
+        server->config.lru_purge_enable = lru_purge_override;
+    }
+
+    server->sessions.resize(server->config.max_open_sockets);
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(server->config.server_port);
+
+    if (bind(server->listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, config->backlog_conn) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %d: %s", server->config.server_port, strerror(errno));
+        close(server->listen_fd);
+        delete server;
+        return ESP_FAIL;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(server->listen_fd, (sockaddr*)&addr, &len);
+    server->port = ntohs(addr.sin_port);
+
+    configASSERT(pipe(server->wake) == 0);
+    fcntl(server->wake[0], F_SETFL, O_NONBLOCK);
+
+    xTaskCreate(server_task, "httpd", config->stack_size, server, config->task_priority, nullptr);
+
+    *handle = server;
+    return ESP_OK;
+}
+
+void httpd_host_override_port(uint16_t port) {
+    port_override = port;
+}
+
+uint16_t httpd_host_port(httpd_handle_t handle) {
+    return ((Server*)handle)->port;
+}
+
+void httpd_host_override_sessions(int max_open_sockets, int lru_purge_enable) {
+    max_open_sockets_override = max_open_sockets;
+    lru_purge_override = lru_purge_enable;
+}
+
+httpd_host_stats_t httpd_host_get_stats(httpd_handle_t handle) {
+    auto* server = (Server*)handle;
+    std::lock_guard<std::mutex> guard(server->lock);
+
+    return server->stats;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// The host network stack stands in for lwIP, the BSD socket API is the same
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
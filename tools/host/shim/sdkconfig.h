@@ -0,0 +1,17 @@
+#pragma once
+
+// Configuration of the host build, stands in for the one idf.py generates. Values follow
+// sdkconfig.defaults and the Kconfig defaults, unless noted.
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LWIP_IPV6 1
+
+#ifndef CONFIG_GARDEN_WEB_WORKERS
+#define CONFIG_GARDEN_WEB_WORKERS 2
+#endif
+
+// Off by default here, the load generator runs all its clients from one address and limits would
+// answer most of it with 429
+#ifndef CONFIG_GARDEN_WEB_RATE_LIMIT
+#define CONFIG_GARDEN_WEB_RATE_LIMIT 0
+#endif
@@ -0,0 +1,193 @@
+// Volume watering decisions of VolumeTarget: pulses a job gets, when it is done by volume, when
+// the time cap ends it instead, and a job interrupted and resumed. Flow is simulated, the job is
+// checked once per FLOW_CHECK like Watering does, against a pulse counter that may wrap.
+//
+//     garden_volume_check
+
+#include "volume_target.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+// Same as the firmware defaults
+static const uint32_t PULSES_PER_LITRE = 450;
+static const int64_t FLOW_CHECK_US = 1000 * 1000;
+static const int64_t S = 1000 * 1000;
+
+static int failed = 0;
+
+#define CHECK(cond)                                                                                \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                 \
+            failed++;                                                                              \
+        }                                                                                          \
+    } while (0)
+
+/// How a pass with the valve open ended and how long the valve was open
+struct Run {
+    VolumeTarget::Outcome outcome;
+    int64_t open_us;
+};
+
+/// Pulse counter of the meter, wraps like the PCNT accumulator
+struct Meter {
+    uint32_t counter;
+    double pulses_per_s;
+    double fraction = 0;
+
+    void advance(int64_t us) {
+        fraction += pulses_per_s * us / S;
+        auto whole = (uint32_t)fraction;
+        counter += whole;
+        fraction -= whole;
+    }
+};
+
+/// Valve opened on the job until it ends or for at most run_us, like one pass of Watering::water
+static Run water(VolumeTarget& volume, int64_t& left_us, Meter& meter, int64_t run_us = INT64_MAX) {
+    uint32_t at_open = meter.counter;
+    int64_t open_us = 0;
+
+    for (;;) {
+        auto outcome = volume.check(meter.counter - at_open, open_us, left_us);
+        if (outcome != VolumeTarget::Outcome::Watering || open_us >= run_us) {
+            // Closing the valve keeps what was delivered and the time left
+            volume.add(meter.counter - at_open);
+            left_us -= open_us;
+            return Run{outcome, open_us};
+        }
+
+        auto step = std::min(FLOW_CHECK_US, left_us - open_us);
+        meter.advance(step);
+        open_us += step;
+    }
+}
+
+static void pulses() {
+    CHECK(!VolumeTarget().set());
+    CHECK(!VolumeTarget(0, PULSES_PER_LITRE).set());
+    CHECK(!VolumeTarget(-1, PULSES_PER_LITRE).set());
+    CHECK(!VolumeTarget(NAN, PULSES_PER_LITRE).set());
+
+    // Any litres are at least a pulse
+    CHECK(VolumeTarget(0.0001f, PULSES_PER_LITRE).target() == 1);
+    CHECK(VolumeTarget(2.5f, PULSES_PER_LITRE).target() == 1125);
+    CHECK(VolumeTarget(1e12f, PULSES_PER_LITRE).target() == UINT32_MAX);
+}
+
+static void volume_before_cap() {
+    // 10 l at 4 l/min is done in 150 s, well within 10 minutes
+    VolumeTarget volume(10, PULSES_PER_LITRE);
+    int64_t left_us = 600 * S;
+    Meter meter{.counter = 0, .pulses_per_s = 4.0 * PULSES_PER_LITRE / 60};
+
+    auto run = water(volume, left_us, meter);
+    CHECK(run.outcome == VolumeTarget::Outcome::Volume);
+    CHECK(run.open_us == 150 * S);
+    CHECK(volume.delivered() == volume.target());
+}
+
+static void cap_before_volume() {
+    // Pressure dropped, 0.5 l/min gets 5 of the 10 l before the 10 minutes run out
+    VolumeTarget volume(10, PULSES_PER_LITRE);
+    int64_t left_us = 600 * S;
+    Meter meter{.counter = 0, .pulses_per_s = 0.5 * PULSES_PER_LITRE / 60};
+
+    auto run = water(volume, left_us, meter);
+    CHECK(run.outcome == VolumeTarget::Outcome::Cap);
+    CHECK(run.open_us == 600 * S);
+    CHECK(left_us == 0);
+    CHECK(volume.delivered() == 5 * PULSES_PER_LITRE);
+}
+
+static void no_flow() {
+    // Dead meter or closed main, only the cap ends the job
+    VolumeTarget volume(10, PULSES_PER_LITRE);
+    int64_t left_us = 90 * S;
+    Meter meter{.counter = 0, .pulses_per_s = 0};
+
+    auto run = water(volume, left_us, meter);
+    CHECK(run.outcome == VolumeTarget::Outcome::Cap);
+    CHECK(run.open_us == 90 * S);
+    CHECK(volume.eta_us(0, run.open_us) == -1);
+}
+
+static void time_only() {
+    // No target waters for the time whatever flows
+    VolumeTarget volume;
+    int64_t left_us = 30 * S;
+    Meter meter{.counter = 0, .pulses_per_s = 1000};
+
+    auto run = water(volume, left_us, meter);
+    CHECK(run.outcome == VolumeTarget::Outcome::Cap);
+    CHECK(run.open_us == 30 * S);
+}
+
+static void counter_wraps() {
+    VolumeTarget volume(10, PULSES_PER_LITRE);
+    int64_t left_us = 600 * S;
+    Meter meter{.counter = UINT32_MAX - 1000, .pulses_per_s = 4.0 * PULSES_PER_LITRE / 60};
+
+    auto run = water(volume, left_us, meter);
+    CHECK(run.outcome == VolumeTarget::Outcome::Volume);
+    CHECK(run.open_us == 150 * S);
+}
+
+static void resumed() {
+    // Paused after a minute, resumed at lower pressure, goes on from 4 l delivered
+    VolumeTarget volume(10, PULSES_PER_LITRE);
+    int64_t left_us = 600 * S;
+    Meter meter{.counter = 0, .pulses_per_s = 4.0 * PULSES_PER_LITRE / 60};
+
+    auto first = water(volume, left_us, meter, 60 * S);
+    CHECK(first.outcome == VolumeTarget::Outcome::Watering);
+    CHECK(volume.delivered() == 4 * PULSES_PER_LITRE);
+    CHECK(left_us == 540 * S);
+
+    // 6 l left at 2 l/min
+    meter.pulses_per_s = 2.0 * PULSES_PER_LITRE / 60;
+    auto second = water(volume, left_us, meter);
+    CHECK(second.outcome == VolumeTarget::Outcome::Volume);
+    CHECK(second.open_us == 180 * S);
+    CHECK(left_us == 360 * S);
+}
+
+static void volume_wins_tie() {
+    // Target and cap reached in the same check, the water was delivered
+    VolumeTarget volume(1, PULSES_PER_LITRE);
+    CHECK(volume.check(PULSES_PER_LITRE, 60 * S, 60 * S) == VolumeTarget::Outcome::Volume);
+    CHECK(volume.check(PULSES_PER_LITRE - 1, 60 * S, 60 * S) == VolumeTarget::Outcome::Cap);
+    CHECK(volume.check(PULSES_PER_LITRE - 1, 59 * S, 60 * S) == VolumeTarget::Outcome::Watering);
+}
+
+static void eta() {
+    // 1 l of 10 in 15 s, 9 l left at the same flow take 135 s
+    VolumeTarget volume(10, PULSES_PER_LITRE);
+    CHECK(volume.eta_us(PULSES_PER_LITRE, 15 * S) == 135 * S);
+    CHECK(volume.eta_us(0, 15 * S) == -1);
+    CHECK(volume.eta_us(20 * PULSES_PER_LITRE, 15 * S) == 0);
+    CHECK(VolumeTarget().eta_us(PULSES_PER_LITRE, 15 * S) == -1);
+}
+
+int main() {
+    pulses();
+    volume_before_cap();
+    cap_before_volume();
+    no_flow();
+    time_only();
+    counter_wraps();
+    resumed();
+    volume_wins_tie();
+    eta();
+
+    if (failed) {
+        printf("%d checks failed\n", failed);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,283 @@
+// WebServer on a development machine, the services replaced by mocks answering with configurable
+// latency. Wired like StartApplication(), so the web handlers, worker pool and reactor run as on
+// the device, over the esp_http_server shim.
+//
+//     garden_web_host --port 8080 --latency watering=20:10
+//     tools/load_test.py 127.0.0.1 --port 8080 -c 4 -e status
+
+#include "event_bus.hpp"
+#include "mock_services.hpp"
+#include "reactor.hpp"
+#include "socket.hpp"
+#include "web_server.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <unistd.h>
+
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char* TAG = "WebHost";
+
+// Same as the firmware
+static const TickType_t SEND_DEADLINE = pdMS_TO_TICKS(100);
+static const size_t SERVICE_QUEUE_DEPTH = 2;
+
+struct Options {
+    int port = 8080;
+    const char* port_file = nullptr;
+    // 0 runs until killed
+    int duration_s = 0;
+    esp_log_level_t log_level = ESP_LOG_WARN;
+
+    MockAlarms alarms = {.period = 0, .lane = Reactor::Lane::Control};
+
+    // Below 0 keeps what the firmware configures
+    int max_open_sockets = -1;
+    int lru_purge = -1;
+
+    MockLatency clock = {};
+    MockLatency moisture = {};
+    MockLatency watering = {};
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [--port N] [--port-file FILE] [--latency SERVICE=MS[:JITTER_MS]]...\n"
+            "          [--max-open-sockets N] [--lru-purge on|off]\n"
+            "          [--alarm-period MS] [--control-lane control|web]\n"
+            "          [--duration S] [--log error|warn|info|debug]\n"
+            "\n"
+            "  --port        0 picks a free port, see --port-file (default 8080)\n"
+            "  --port-file   write the port listened on to FILE once serving\n"
+            "  --latency     time clock, moisture or watering takes to answer, jitter is added\n"
+            "                uniformly on top (default 0)\n"
+            "  --max-open-sockets, --lru-purge\n"
+            "                session limit and policy instead of the firmware's\n"
+            "  --alarm-period\n"
+            "                raise an RTC alarm every MS, its latency is printed on exit\n"
+            "  --control-lane\n"
+            "                lane of the alarm path, web queues it behind web requests\n"
+            "  --duration    exit after S seconds and print session counts (default: run until\n"
+            "                killed)\n",
+            name);
+    exit(2);
+}
+
+static bool parse_latency(const char* arg, Options& options) {
+    const char* eq = strchr(arg, '=');
+    if (!eq) {
+        return false;
+    }
+
+    MockLatency* latency = nullptr;
+    std::string service(arg, eq - arg);
+
+    if (service == "clock") {
+        latency = &options.clock;
+    } else if (service == "moisture") {
+        latency = &options.moisture;
+    } else if (service == "watering") {
+        latency = &options.watering;
+    } else {
+        return false;
+    }
+
+    double base_ms = 0;
+    double jitter_ms = 0;
+    if (sscanf(eq + 1, "%lf:%lf", &base_ms, &jitter_ms) < 1 || base_ms < 0 || jitter_ms < 0) {
+        return false;
+    }
+
+    *latency = MockLatency{.base_us = (int64_t)(base_ms * 1000),
+                           .jitter_us = (int64_t)(jitter_ms * 1000)};
+    return true;
+}
+
+static bool parse_log_level(const char* arg, Options& options) {
+    static const std::pair<const char*, esp_log_level_t> LEVELS[] = {
+        {"error", ESP_LOG_ERROR}, {"warn", ESP_LOG_WARN}, {"info", ESP_LOG_INFO},
+        {"debug", ESP_LOG_DEBUG}};
+
+    for (const auto& [name, level] : LEVELS) {
+        if (strcmp(arg, name) == 0) {
+            options.log_level = level;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (!value) {
+            usage(argv[0]);
+        }
+
+        bool ok = true;
+        if (strcmp(arg, "--port") == 0) {
+            options.port = atoi(value);
+            ok = options.port >= 0 && options.port <= 65535;
+        } else if (strcmp(arg, "--port-file") == 0) {
+            options.port_file = value;
+        } else if (strcmp(arg, "--latency") == 0) {
+            ok = parse_latency(value, options);
+        } else if (strcmp(arg, "--max-open-sockets") == 0) {
+            options.max_open_sockets = atoi(value);
+            ok = options.max_open_sockets > 0;
+        } else if (strcmp(arg, "--lru-purge") == 0) {
+            options.lru_purge = strcmp(value, "on") == 0 ? 1 : strcmp(value, "off") == 0 ? 0 : -1;
+            ok = options.lru_purge >= 0;
+        } else if (strcmp(arg, "--alarm-period") == 0) {
+            options.alarms.period = pdMS_TO_TICKS(atoi(value));
+        } else if (strcmp(arg, "--control-lane") == 0) {
+            ok = strcmp(value, "control") == 0 || strcmp(value, "web") == 0;
+            options.alarms.lane =
+                strcmp(value, "web") == 0 ? Reactor::Lane::Web : Reactor::Lane::Control;
+        } else if (strcmp(arg, "--duration") == 0) {
+            options.duration_s = atoi(value);
+        } else if (strcmp(arg, "--log") == 0) {
+            ok = parse_log_level(value, options);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            usage(argv[0]);
+        }
+        i++;
+    }
+
+    return options;
+}
+
+struct Services {
+    Reactor& reactor;
+    ServiceBase* services[3];
+};
+
+static void run_services(void* param) {
+    auto* ctx = (Services*)param;
+
+    for (auto* service : ctx->services) {
+        service->start();
+    }
+
+    ctx->reactor.run();
+}
+
+int main(int argc, char** argv) {
+    auto options = parse_options(argc, argv);
+    esp_log_level_set("*", options.log_level);
+
+    auto watering_clock = Socket::make(SERVICE_QUEUE_DEPTH, Socket::Overflow::Block, 0);
+
+    auto web_clock = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+    auto web_moisture = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+    auto web_watering = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+    auto web_watering_stop = Socket::make(1, Socket::Overflow::Block, SEND_DEADLINE);
+
+    static Reactor reactor;
+    static EventBus events;
+
+    static MockClock clock(reactor,
+                           events,
+                           watering_clock->connect(Socket::Overflow::Block, 0),
+                           web_clock->connect(),
+                           options.clock,
+                           options.alarms);
+    static MockMoisture moisture(reactor, events, web_moisture->connect(), options.moisture);
+    static MockWatering watering(reactor,
+                                 events,
+                                 std::move(watering_clock),
+                                 web_watering->connect(),
+                                 web_watering_stop->connect(),
+                                 options.watering,
+                                 options.alarms);
+
+    auto versions = StateVersions{.clock = clock.status_version(),
+                                  .moisture = moisture.status_version(),
+                                  .watering = watering.status_version(),
+                                  .configuration = watering.configuration_version()};
+
+    auto counters = ServiceCounters{.clock = clock.counters(),
+                                    .moisture = moisture.counters(),
+                                    .watering = watering.counters()};
+
+    static WebServer web_server(reactor,
+                                events,
+                                versions,
+                                counters,
+                                std::move(web_clock),
+                                std::move(web_moisture),
+                                std::move(web_watering),
+                                std::move(web_watering_stop));
+
+    static Services services = {reactor, {&clock, &moisture, &watering}};
+    xTaskCreate(run_services, "services", 1024 * 6, &services, 2, NULL);
+
+    httpd_host_override_port(options.port);
+    httpd_host_override_sessions(options.max_open_sockets, options.lru_purge);
+    auto server = web_server.start_webserver();
+    if (!server) {
+        ESP_LOGE(TAG, "Server did not start");
+        return 1;
+    }
+
+    auto port = httpd_host_port(server);
+    fprintf(stderr, "Serving on http://127.0.0.1:%u/\n", port);
+
+    if (options.port_file) {
+        // Written whole under a temporary name, a reader polling for it never sees half of it
+        std::string tmp = std::string(options.port_file) + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f || fprintf(f, "%u\n", port) < 0 || fclose(f) != 0 ||
+            rename(tmp.c_str(), options.port_file) != 0) {
+            ESP_LOGE(TAG, "Cannot write %s", options.port_file);
+            return 1;
+        }
+    }
+
+    for (int elapsed = 0; options.duration_s == 0 || elapsed < options.duration_s; elapsed++) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+
+    auto stats = httpd_host_get_stats(server);
+    fprintf(stderr,
+            "Sessions: %" PRIu32 " accepted, %" PRIu32 " purged, %" PRIu32 " refused, %" PRIu32
+            " open at most\n",
+            stats.accepted,
+            stats.purged,
+            stats.refused,
+            stats.open_max);
+
+    if (options.alarms.period > 0) {
+        auto queued = reactor.queue_latency(Reactor::Lane::Control).snapshot();
+        fprintf(stderr,
+                "Alarms: %" PRIu32 " handled, interrupt latency max %" PRId64
+                " us, alarm latency max %" PRId64 " us, control lane queue mean %" PRId64 " us\n",
+                clock.counters().alarms_handled[0].load(),
+                clock.irq_latency_max_us(),
+                watering.alarm_latency_max_us(),
+                queued.count ? queued.sum_us / queued.count : 0);
+    }
+
+    // Tasks are detached threads blocked in the kernel shim, leave without running destructors
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+}
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Starts the host web server and runs the load generator against it.
+
+By default every endpoint of load_test.py is requested for a few seconds by
+one client, any error fails the test. Options not listed below go to
+load_test.py and override those defaults.
+
+With --max-alarm-latency-ms the server raises RTC alarms meanwhile, the test
+fails if the watering mock got any later than that after the clock sent it.
+
+With --max-stop-latency-ms POST /stop is sent every half second meanwhile, the
+test fails if any stop is refused or took longer than that from admission.
+
+    web_smoke.py build/garden_web_host [--server-arg=ARG]... [load_test.py options]
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.request
+
+TOOLS_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+ENDPOINTS = ["dashboard", "version", "status", "configuration", "metrics"]
+
+
+def wait_for_port(path, server, timeout=10):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if server.poll() is not None:
+            sys.exit(f"server exited with {server.returncode}")
+        if os.path.exists(path):
+            with open(path) as f:
+                return int(f.read())
+        time.sleep(0.05)
+    sys.exit("server did not start")
+
+
+def get(port, path):
+    with urllib.request.urlopen(f"http://127.0.0.1:{port}{path}", timeout=5) as res:
+        return res.read().decode()
+
+
+def check_alarms(port, max_latency_ms):
+    metrics = get(port, "/metrics")
+    handled = re.search(r'^garden_alarms_handled_total\{alarm="1"\} (\d+)$', metrics, re.M)
+    status = json.loads(get(port, "/status"))
+    irq_us = status["clock"]["irq_latency_max_us"]
+    alarm_us = status["watering"]["alarm_latency_max_us"]
+
+    count = int(handled.group(1)) if handled else 0
+    print(
+        f"{count} alarms, interrupt latency max {irq_us / 1000:.2f} ms, "
+        f"alarm latency max {alarm_us / 1000:.2f} ms"
+    )
+
+    if count == 0:
+        return "no alarm was handled"
+    if alarm_us > max_latency_ms * 1000:
+        return f"alarm latency above {max_latency_ms:g} ms"
+    return None
+
+
+def post(port, path):
+    req = urllib.request.Request(f"http://127.0.0.1:{port}{path}", data=b"", method="POST")
+    with urllib.request.urlopen(req, timeout=5) as res:
+        return res.read().decode()
+
+
+def check_stops(port, load, max_latency_ms):
+    latencies = []
+    while load.poll() is None:
+        time.sleep(0.5)
+        try:
+            latencies.append(json.loads(post(port, "/stop"))["stop_latency_us"])
+        except OSError as e:
+            return f"stop failed: {e}"
+
+    if not latencies:
+        return "no stop was sent"
+
+    worst_ms = max(latencies) / 1000
+    print(f"{len(latencies)} stops, latency max {worst_ms:.2f} ms")
+    if worst_ms > max_latency_ms:
+        return f"stop latency above {max_latency_ms:g} ms"
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server", help="garden_web_host")
+    parser.add_argument(
+        "--server-arg", action="append", default=[], metavar="ARG", help="passed to the server"
+    )
+    parser.add_argument("--max-alarm-latency-ms", type=float, metavar="MS")
+    parser.add_argument("--max-stop-latency-ms", type=float, metavar="MS")
+    args, load_args = parser.parse_known_args()
+
+    server_args = ["--latency", "watering=2:2"] + args.server_arg
+    if args.max_alarm_latency_ms is not None:
+        server_args += ["--alarm-period", "50"]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        port_file = os.path.join(tmp, "port")
+        server = subprocess.Popen(
+            [args.server, "--port", "0", "--port-file", port_file] + server_args
+        )
+        try:
+            port = wait_for_port(port_file, server)
+            load = [
+                sys.executable,
+                os.path.join(TOOLS_DIR, "load_test.py"),
+                "127.0.0.1",
+                "--port",
+                str(port),
+                "-c",
+                "1",
+                "-d",
+                "3",
+                "--max-error-rate",
+                "0",
+            ]
+            if "-e" not in load_args and "--endpoint" not in load_args:
+                for endpoint in ENDPOINTS:
+                    load += ["-e", endpoint]
+
+            failure = None
+            run = subprocess.Popen(load + load_args)
+            if args.max_stop_latency_ms is not None:
+                failure = check_stops(port, run, args.max_stop_latency_ms)
+            if run.wait() != 0:
+                failure = "load test failed"
+            elif not failure and args.max_alarm_latency_ms is not None:
+                failure = check_alarms(port, args.max_alarm_latency_ms)
+        finally:
+            server.terminate()
+            server.wait()
+
+    if failure:
+        sys.exit(failure)
+
+
+if __name__ == "__main__":
+    main()
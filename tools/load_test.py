@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""Load generator for the garden web API.
+
+Runs a number of clients against the device for a while, each on its own
+keep-alive connection, and reports requests/s, latency percentiles and errors
+per endpoint. Results can be saved and compared with an earlier run, so a
+change to the handlers can be judged run-to-run.
+
+    tools/load_test.py 192.168.1.50 -c 4 -d 30 -e status -e metrics --save before.json
+    tools/load_test.py 192.168.1.50 -c 4 -d 30 -e status -e metrics --compare before.json
+
+With --idle, more connections are opened than the clients use. Each asks for
+/version now and then and stays open in between, like a browser tab left on the
+dashboard, so the device runs out of sessions. Their requests are reported as
+the "idle" endpoint, errors there are connections the device closed.
+
+Only the standard library is used.
+"""
+
+import argparse
+import http.client
+import json
+import socket
+import sys
+import threading
+import time
+from collections import Counter, defaultdict
+
+ENDPOINTS = {
+    "dashboard": ("GET", "/"),
+    "version": ("GET", "/version"),
+    "status": ("GET", "/status"),
+    "configuration": ("GET", "/configuration"),
+    "metrics": ("GET", "/metrics"),
+}
+
+
+class Results:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = defaultdict(list)
+        self.statuses = defaultdict(Counter)
+
+    def record(self, endpoint, status, latency):
+        with self.lock:
+            self.statuses[endpoint][status] += 1
+            if latency is not None:
+                self.latencies[endpoint].append(latency)
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    index = min(len(values) - 1, int(round(p / 100 * (len(values) - 1))))
+    return values[index]
+
+
+class Client(threading.Thread):
+    def __init__(self, args, endpoints, results, deadline, offset):
+        super().__init__(daemon=True)
+        self.args = args
+        self.endpoints = endpoints
+        self.results = results
+        self.deadline = deadline
+        # Clients start at different endpoints so the mix is even from the start
+        self.offset = offset
+        self.etags = {}
+        self.conn = None
+
+    def connect(self):
+        self.conn = http.client.HTTPConnection(
+            self.args.host, self.args.port, timeout=self.args.timeout
+        )
+
+    def request(self, endpoint):
+        method, path = ENDPOINTS[endpoint]
+        headers = {"Accept-Encoding": "gzip"}
+        if self.args.conditional and endpoint in self.etags:
+            headers["If-None-Match"] = self.etags[endpoint]
+
+        start = time.perf_counter()
+        self.conn.request(method, path, headers=headers)
+        res = self.conn.getresponse()
+        res.read()
+        latency = time.perf_counter() - start
+
+        etag = res.getheader("ETag")
+        if etag:
+            self.etags[endpoint] = etag
+
+        if res.getheader("Connection", "").lower() == "close":
+            self.conn.close()
+            self.connect()
+
+        return res.status, latency
+
+    def run(self):
+        self.connect()
+        period = 1.0 / self.args.rate if self.args.rate else 0
+        i = self.offset
+
+        while time.monotonic() < self.deadline:
+            endpoint = self.endpoints[i % len(self.endpoints)]
+            i += 1
+            started = time.monotonic()
+
+            try:
+                status, latency = self.request(endpoint)
+                self.results.record(endpoint, status, latency)
+            except (OSError, http.client.HTTPException) as e:
+                kind = "timeout" if isinstance(e, socket.timeout) else "connection"
+                self.results.record(endpoint, kind, None)
+                self.conn.close()
+                self.connect()
+
+            if period:
+                time.sleep(max(0, period - (time.monotonic() - started)))
+
+        self.conn.close()
+
+
+class IdleClient(threading.Thread):
+    """Keeps a connection open, requests /version every interval"""
+
+    def __init__(self, args, results, deadline):
+        super().__init__(daemon=True)
+        self.args = args
+        self.results = results
+        self.deadline = deadline
+        self.conn = None
+
+    def request(self):
+        start = time.perf_counter()
+        try:
+            if self.conn is None:
+                self.conn = http.client.HTTPConnection(
+                    self.args.host, self.args.port, timeout=self.args.timeout
+                )
+            self.conn.request("GET", "/version")
+            res = self.conn.getresponse()
+            res.read()
+            self.results.record("idle", res.status, time.perf_counter() - start)
+        except (OSError, http.client.HTTPException) as e:
+            kind = "timeout" if isinstance(e, socket.timeout) else "connection"
+            self.results.record("idle", kind, None)
+            self.conn.close()
+            self.conn = None
+
+    def run(self):
+        while True:
+            self.request()
+            remaining = self.deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            time.sleep(min(self.args.idle_interval, remaining))
+
+        if self.conn:
+            self.conn.close()
+
+
+def summarize(results, duration):
+    summary = {}
+    for endpoint, statuses in results.statuses.items():
+        latencies = results.latencies[endpoint]
+        total = sum(statuses.values())
+        ok = sum(n for s, n in statuses.items() if isinstance(s, int) and s < 400)
+        summary[endpoint] = {
+            "requests": total,
+            "rps": total / duration,
+            "p50_ms": ms(percentile(latencies, 50)),
+            "p90_ms": ms(percentile(latencies, 90)),
+            "p99_ms": ms(percentile(latencies, 99)),
+            "max_ms": ms(max(latencies) if latencies else None),
+            "error_rate": (total - ok) / total if total else 0.0,
+            "statuses": {str(s): n for s, n in sorted(statuses.items(), key=str)},
+        }
+    return summary
+
+
+def ms(seconds):
+    return None if seconds is None else round(seconds * 1000, 2)
+
+
+def fmt(value, width=8):
+    return ("-" if value is None else f"{value:.2f}").rjust(width)
+
+
+def print_summary(summary, baseline=None):
+    print(
+        f"{'endpoint':<14}{'requests':>9}{'req/s':>8}{'p50 ms':>9}{'p90 ms':>9}"
+        f"{'p99 ms':>9}{'max ms':>9}{'errors':>8}  statuses"
+    )
+    for endpoint, s in sorted(summary.items()):
+        statuses = " ".join(f"{k}:{v}" for k, v in s["statuses"].items())
+        print(
+            f"{endpoint:<14}{s['requests']:>9}{fmt(s['rps'])}{fmt(s['p50_ms'], 9)}"
+            f"{fmt(s['p90_ms'], 9)}{fmt(s['p99_ms'], 9)}{fmt(s['max_ms'], 9)}"
+            f"{s['error_rate']:>8.1%}  {statuses}"
+        )
+
+        before = (baseline or {}).get(endpoint)
+        if before:
+            print(
+                f"{'  vs baseline':<23}{delta(s['rps'], before['rps'])}"
+                f"{delta(s['p50_ms'], before['p50_ms'], 9)}"
+                f"{delta(s['p90_ms'], before['p90_ms'], 9)}"
+                f"{delta(s['p99_ms'], before['p99_ms'], 9)}"
+                f"{delta(s['max_ms'], before['max_ms'], 9)}"
+                f"{(s['error_rate'] - before['error_rate']):>+8.1%}"
+            )
+
+
+def delta(now, before, width=8):
+    if now is None or before is None or before == 0:
+        return "-".rjust(width)
+    return f"{(now - before) / before:+.0%}".rjust(width)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="address of the device")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("-c", "--clients", type=int, default=2, help="concurrent connections")
+    parser.add_argument("-d", "--duration", type=float, default=10, help="seconds to run")
+    parser.add_argument(
+        "-e",
+        "--endpoint",
+        action="append",
+        choices=sorted(ENDPOINTS),
+        help="endpoint to load, may be repeated, clients cycle through them (default: status)",
+    )
+    parser.add_argument(
+        "-r", "--rate", type=float, default=0, help="requests/s per client, 0 for as fast as possible"
+    )
+    parser.add_argument(
+        "--conditional", action="store_true", help="revalidate with If-None-Match like a browser"
+    )
+    parser.add_argument(
+        "--idle", type=int, default=0, metavar="N", help="connections held open besides clients"
+    )
+    parser.add_argument(
+        "--idle-interval",
+        type=float,
+        default=5,
+        metavar="S",
+        help="seconds between requests on an idle connection",
+    )
+    parser.add_argument("--timeout", type=float, default=5, help="request timeout in seconds")
+    parser.add_argument("--save", metavar="FILE", help="write results as JSON")
+    parser.add_argument("--compare", metavar="FILE", help="compare with results saved earlier")
+    parser.add_argument(
+        "--max-error-rate",
+        type=float,
+        metavar="RATE",
+        help="exit with 1 if an endpoint fails more often than that, from 0 to 1",
+    )
+    args = parser.parse_args()
+
+    endpoints = args.endpoint or ["status"]
+    results = Results()
+    deadline = time.monotonic() + args.duration
+
+    print(
+        f"{args.clients} clients, {args.idle} idle, {args.duration:g} s, {', '.join(endpoints)} "
+        f"on {args.host}:{args.port}",
+        file=sys.stderr,
+    )
+
+    # Idle connections take their sessions first, clients then have to get theirs
+    idle = [IdleClient(args, results, deadline) for _ in range(args.idle)]
+    for client in idle:
+        client.start()
+        time.sleep(0.01)
+
+    start = time.monotonic()
+    clients = [Client(args, endpoints, results, deadline, i) for i in range(args.clients)]
+    for client in clients:
+        client.start()
+    for client in clients + idle:
+        client.join()
+    duration = time.monotonic() - start
+
+    summary = summarize(results, duration)
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)["endpoints"]
+
+    print_summary(summary, baseline)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({"args": vars(args), "endpoints": summary}, f, indent=2)
+
+    if args.max_error_rate is not None:
+        # Idle connections are there to be closed by the device, only clients count
+        failing = [
+            e for e, s in summary.items() if e != "idle" and s["error_rate"] > args.max_error_rate
+        ]
+        if failing or not summary:
+            print(
+                f"error rate above {args.max_error_rate:.1%}: {', '.join(failing)}",
+                file=sys.stderr,
+            )
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()